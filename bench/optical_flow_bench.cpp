@@ -0,0 +1,1317 @@
+/**
+ * @file optical_flow_bench.cpp
+ * @brief Standalone throughput, latency and accuracy benchmark
+ *
+ * Replays an image sequence through OpticalFlowTracking without MATLAB and
+ * reports frames per second, per-stage latency and velocity error as JSON
+ * (run summary) or CSV (one row per frame), so runs can be diffed in CI.
+ *
+ * Sources:
+ * - synthetic: translating (and optionally rotating, noisy) periodic texture
+ *   with a known ground-truth velocity
+ * - dir:<path>: every image in a directory, in lexicographic order
+ * - video:<path>: any file readable by cv::VideoCapture
+ *
+ * Frames are fed through ImageIngestion from a column-major buffer, the same
+ * path the S-function uses, so the ingestion stage is part of the timings.
+ *
+ * With --suite a fixed set of synthetic scenes (translation, rotation,
+ * altitude, noise) is replayed through every tracker mode and an accuracy
+ * vs. throughput table is reported. Compared against a stored baseline the
+ * bench exits with status 1 when an RMS velocity error or the frame rate
+ * regresses past the tolerances, so CI can gate on it without Simulink.
+ *
+ * --arena-threads N measures the contention of the Mat arena: N threads
+ * create and release the Mats of a tracking step concurrently.
+ */
+
+#include "optical_flow_velocity.hpp"
+#include "image_ingestion.hpp"
+#include "mat_arena_allocator.hpp"
+#include "stage_profiler.hpp"
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Benchmark configuration parsed from the command line
+ */
+struct BenchConfig {
+    std::string source = "synthetic";   ///< synthetic, dir:<path> or video:<path>
+    std::string format = "json";        ///< json (summary) or csv (per frame)
+    std::string output;                 ///< Output file (stdout if empty)
+    std::string input_type = "double";  ///< Simulink-side pixel type to ingest
+    int frames = 300;                   ///< Frames to process (synthetic, or limit)
+    int warmup = 5;                     ///< Leading frames excluded from statistics
+    int width = 640;                    ///< Synthetic frame width (pixels)
+    int height = 480;                   ///< Synthetic frame height (pixels)
+    double fps = 30.0;                  ///< Frame rate, gives the time step
+    double altitude = 5.0;              ///< Height above ground passed to the tracker (meters)
+    double velocity_x = 1.0;            ///< Synthetic ground-truth velocity, forward (m/s)
+    double velocity_y = 0.5;            ///< Synthetic ground-truth velocity, left (m/s)
+    double focal = 0.004;               ///< Camera focal length (meters)
+    double cmos_width = 0.0048;         ///< Sensor width (meters)
+    double cmos_height = 0.0036;        ///< Sensor height (meters)
+    int procedure = OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC; ///< Feature procedure
+    int pipeline = OpticalFlowTracking::PIPELINE_SYNCHRONOUS; ///< Pipeline mode
+    int conversion = VelocityConversion::MODE_FAST; ///< Velocity conversion mode
+    int method = OpticalFlowTracking::OPTICAL_FLOW_LUCAS_KANADE; ///< Optical flow backend
+    int detector = OpticalFlowTracking::FEATURE_EXTRACTION_OPENCV_SIMPLE; ///< Corner detector
+    int detector_threshold = OpticalFlowTracking::DEFAULT_FAST_THRESHOLD; ///< FAST/AGAST threshold
+    int max_corners = OpticalFlowTracking::DEFAULT_MAX_CORNERS; ///< Corner budget
+    double quality_level = OpticalFlowTracking::DEFAULT_QUALITY_LEVEL; ///< Shi-Tomasi quality
+    double min_distance = OpticalFlowTracking::DEFAULT_MIN_DISTANCE; ///< Corner spacing (pixels)
+    int block_size = OpticalFlowTracking::DEFAULT_BLOCK_SIZE; ///< Shi-Tomasi block size
+    double max_track_error = 0.0;       ///< LK error limit (0 = none)
+    double max_fb_error = 0.0;          ///< Forward-backward error limit (pixels, 0 = none)
+    double latency_target = 0.0;        ///< Step time target of the feature budget (seconds, 0 = off)
+    double keyframe = 0.0;              ///< Keyframe promotion displacement (pixels, 0 = off)
+    double early_out = 0.0;             ///< Largest shift of a skipped frame (pixels, 0 = off)
+    int tiles = 0;                      ///< Parallel tracking bands (0 = one LK call)
+    double rotation[3] = {0.0, 0.0, 0.0}; ///< Synthetic angular rate about X, Y, Z (rad/s)
+    double noise = 0.0;                 ///< Synthetic pixel noise standard deviation (gray levels)
+    unsigned seed = 1;                  ///< Synthetic texture seed
+    cv::Rect roi;                       ///< Processed region (full frame if empty)
+    int decimation = 1;                 ///< Area-averaging decimation of the region
+    bool suite = false;                 ///< Run the regression suite instead of one sequence
+    std::string baseline;               ///< Suite baseline to compare against
+    std::string write_baseline;         ///< File the suite results are stored to as a baseline
+    double rmse_tolerance = 0.10;       ///< Allowed relative growth of the suite RMS errors
+    double fps_tolerance = 0.15;        ///< Allowed relative drop of the suite frame rate
+    int arena_threads = 0;              ///< Threads of the arena contention run (0 = off)
+    bool compensate = false;            ///< Pass the angular rate even when it is zero
+    double gyro_bias = 0.0;             ///< Added to the reported rate, not seen by the scene (rad/s)
+};
+
+/**
+ * @brief Check whether the synthetic camera rotates
+ */
+bool hasRotation(const BenchConfig& config) {
+    return config.rotation[0] != 0.0 || config.rotation[1] != 0.0 || config.rotation[2] != 0.0;
+}
+
+/**
+ * @brief Check whether the tracker compensates the angular rate
+ */
+bool compensatesRotation(const BenchConfig& config) {
+    return config.compensate || config.gyro_bias != 0.0 || hasRotation(config);
+}
+
+/**
+ * @brief Measurements of one processed frame
+ */
+struct FrameRecord {
+    int index;                          ///< Frame index in the sequence
+    double stage[StageProfiler::NUM_STAGES]; ///< Stage times of this frame (seconds)
+    int features;                       ///< Number of tracked features
+    double ego_x;                       ///< Robust ego velocity, forward (m/s)
+    double ego_y;                       ///< Robust ego velocity, left (m/s)
+    double feature_rmse;                ///< RMS per-feature velocity error (m/s, NaN if unknown)
+    unsigned long long heap_allocations; ///< OpenCV allocations the arena could not serve
+    bool skipped;                       ///< Tracking skipped by the early-out
+    bool keyframe;                      ///< Frame promoted to a new keyframe
+};
+
+void printUsage(const char* argv0) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --source S        synthetic | dir:<path> | video:<path> (default synthetic)\n"
+        "  --frames N        frames to process (default 300)\n"
+        "  --warmup N        leading frames excluded from statistics (default 5)\n"
+        "  --size WxH        synthetic frame size (default 640x480)\n"
+        "  --velocity VX,VY  synthetic ground-truth velocity in m/s (default 1,0.5)\n"
+        "  --fps F           frame rate (default 30)\n"
+        "  --altitude H      height above ground in meters (default 5)\n"
+        "  --camera F,W,H    focal length, sensor width, sensor height in meters\n"
+        "  --procedure P     feature procedure 1, 2 or 3 (default 1)\n"
+        "  --pipeline M      pipeline mode 0, 1 or 2 (default 0)\n"
+        "  --conversion C    0 = exact, 1 = fast (default 1)\n"
+        "  --method M        100 = LK (CPU), 101 = DIS dense, 102 = LK (CUDA) (default 100)\n"
+        "  --detector D      1000 = Shi-Tomasi, 1001 = FAST grid, 1002 = AGAST grid (default 1000)\n"
+        "  --corners N,Q,D,B max corners, quality level, min distance, block size\n"
+        "                    (default 1000,0.1,8,2)\n"
+        "  --fast-threshold T FAST/AGAST intensity threshold (default 20)\n"
+        "  --reject E,FB     LK error and forward-backward limits, 0 disables (default 0,0)\n"
+        "  --latency-target T step time target in ms for the feature budget, 0 = off (default 0)\n"
+        "  --keyframe D      track from keyframes promoted past D pixels, 0 = off (default 0)\n"
+        "  --early-out S     skip frames shifted less than S pixels, 0 = off (default 0)\n"
+        "  --tiles N         track features in N parallel image bands, 0 = off (default 0)\n"
+        "  --input-type T    double | single | uint8 (default double)\n"
+        "  --roi X,Y,W,H     process only this region, 0-based pixels (default full frame)\n"
+        "  --decimation N    area-averaging decimation of the region (default 1)\n"
+        "  --rotation X,Y,Z  synthetic angular rate in rad/s, compensated by the tracker\n"
+        "                    (default 0,0,0)\n"
+        "  --noise S         synthetic Gaussian pixel noise in gray levels (default 0)\n"
+        "  --seed N          synthetic texture seed (default 1)\n"
+        "  --format F        json | csv (default json)\n"
+        "  --output FILE     write the report to FILE instead of stdout\n"
+        "  --suite           replay the synthetic scenes through every tracker mode\n"
+        "  --baseline FILE   fail the suite on regressions against FILE\n"
+        "  --write-baseline FILE store the suite results in FILE\n"
+        "  --tolerance R,F   allowed relative RMS error growth and frame rate drop\n"
+        "                    (default 0.1,0.15)\n"
+        "  --arena-threads N time concurrent Mat allocations from N threads\n",
+        argv0);
+}
+
+/**
+ * @brief Parse the command line into a configuration
+ *
+ * @return false on an unknown option or malformed value
+ */
+bool parseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if (arg == "--suite") {
+            config.suite = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (arg == "--source") {
+            config.source = value;
+        } else if (arg == "--frames") {
+            config.frames = std::atoi(value);
+        } else if (arg == "--warmup") {
+            config.warmup = std::atoi(value);
+        } else if (arg == "--size") {
+            if (std::sscanf(value, "%dx%d", &config.width, &config.height) != 2) {
+                return false;
+            }
+        } else if (arg == "--velocity") {
+            if (std::sscanf(value, "%lf,%lf", &config.velocity_x, &config.velocity_y) != 2) {
+                return false;
+            }
+        } else if (arg == "--fps") {
+            config.fps = std::atof(value);
+        } else if (arg == "--altitude") {
+            config.altitude = std::atof(value);
+        } else if (arg == "--camera") {
+            if (std::sscanf(value, "%lf,%lf,%lf", &config.focal, &config.cmos_width,
+                            &config.cmos_height) != 3) {
+                return false;
+            }
+        } else if (arg == "--procedure") {
+            config.procedure = std::atoi(value);
+        } else if (arg == "--pipeline") {
+            config.pipeline = std::atoi(value);
+        } else if (arg == "--conversion") {
+            config.conversion = std::atoi(value) != 0 ? VelocityConversion::MODE_FAST
+                                                      : VelocityConversion::MODE_EXACT;
+        } else if (arg == "--method") {
+            config.method = std::atoi(value);
+        } else if (arg == "--detector") {
+            config.detector = std::atoi(value);
+        } else if (arg == "--corners") {
+            if (std::sscanf(value, "%d,%lf,%lf,%d", &config.max_corners, &config.quality_level,
+                            &config.min_distance, &config.block_size) != 4) {
+                return false;
+            }
+        } else if (arg == "--fast-threshold") {
+            config.detector_threshold = std::atoi(value);
+        } else if (arg == "--reject") {
+            if (std::sscanf(value, "%lf,%lf", &config.max_track_error,
+                            &config.max_fb_error) != 2) {
+                return false;
+            }
+        } else if (arg == "--latency-target") {
+            config.latency_target = std::atof(value) * 1e-3;
+        } else if (arg == "--keyframe") {
+            config.keyframe = std::atof(value);
+        } else if (arg == "--early-out") {
+            config.early_out = std::atof(value);
+        } else if (arg == "--tiles") {
+            config.tiles = std::atoi(value);
+        } else if (arg == "--input-type") {
+            config.input_type = value;
+        } else if (arg == "--roi") {
+            if (std::sscanf(value, "%d,%d,%d,%d", &config.roi.x, &config.roi.y,
+                            &config.roi.width, &config.roi.height) != 4) {
+                return false;
+            }
+        } else if (arg == "--decimation") {
+            config.decimation = std::atoi(value);
+        } else if (arg == "--rotation") {
+            if (std::sscanf(value, "%lf,%lf,%lf", &config.rotation[0], &config.rotation[1],
+                            &config.rotation[2]) != 3) {
+                return false;
+            }
+        } else if (arg == "--noise") {
+            config.noise = std::atof(value);
+        } else if (arg == "--baseline") {
+            config.baseline = value;
+        } else if (arg == "--write-baseline") {
+            config.write_baseline = value;
+        } else if (arg == "--tolerance") {
+            if (std::sscanf(value, "%lf,%lf", &config.rmse_tolerance,
+                            &config.fps_tolerance) != 2) {
+                return false;
+            }
+        } else if (arg == "--arena-threads") {
+            config.arena_threads = std::atoi(value);
+        } else if (arg == "--seed") {
+            config.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--format") {
+            config.format = value;
+        } else if (arg == "--output") {
+            config.output = value;
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if (config.frames <= 0 || config.width <= 0 || config.height <= 0 || config.fps <= 0.0 ||
+        config.decimation <= 0) {
+        std::fprintf(stderr, "Frames, size, fps and decimation must be positive\n");
+        return false;
+    }
+    if (config.noise < 0.0 || config.rmse_tolerance < 0.0 || config.fps_tolerance < 0.0) {
+        std::fprintf(stderr, "Noise and tolerances must not be negative\n");
+        return false;
+    }
+    if (!config.suite && (!config.baseline.empty() || !config.write_baseline.empty())) {
+        std::fprintf(stderr, "Baselines are only used with --suite\n");
+        return false;
+    }
+    if (!OpticalFlowTracking::isMethodAvailable(config.method)) {
+        std::fprintf(stderr, "Optical flow method %d is not available\n", config.method);
+        return false;
+    }
+    if (config.format != "json" && config.format != "csv") {
+        std::fprintf(stderr, "Unknown format %s\n", config.format.c_str());
+        return false;
+    }
+    if (config.input_type != "double" && config.input_type != "single" &&
+        config.input_type != "uint8") {
+        std::fprintf(stderr, "Unknown input type %s\n", config.input_type.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Frame provider for the three source kinds
+ */
+class FrameSource {
+public:
+    explicit FrameSource(const BenchConfig& config)
+        : _config(config),
+          _next(0),
+          _shift_x(0.0),
+          _shift_y(0.0),
+          _angle(0.0),
+          _offset(0.0, 0.0) {
+    }
+
+    /**
+     * @brief Open the configured source
+     *
+     * @return false if the directory or video cannot be read
+     */
+    bool open() {
+        const std::string& source = _config.source;
+        if (source == "synthetic") {
+            openSynthetic();
+            return true;
+        }
+        if (source.compare(0, 4, "dir:") == 0) {
+            cv::glob(source.substr(4), _files, false);
+            std::sort(_files.begin(), _files.end());
+            return !_files.empty();
+        }
+        if (source.compare(0, 6, "video:") == 0) {
+            return _video.open(source.substr(6));
+        }
+        return false;
+    }
+
+    /**
+     * @brief Whether the source has a known ground-truth velocity
+     */
+    bool hasGroundTruth() const { return !_texture.empty(); }
+
+    /**
+     * @brief Read the next frame as 8-bit grayscale
+     *
+     * @return false at the end of the sequence
+     */
+    bool read(cv::Mat& gray) {
+        if (_next >= _config.frames) {
+            return false;
+        }
+
+        if (hasGroundTruth()) {
+            renderSynthetic(_next, gray);
+        } else if (!_files.empty()) {
+            if (_next >= static_cast<int>(_files.size())) {
+                return false;
+            }
+            gray = cv::imread(_files[_next], cv::IMREAD_GRAYSCALE);
+        } else {
+            if (!_video.read(_frame)) {
+                return false;
+            }
+            if (_frame.channels() == 3) {
+                cv::cvtColor(_frame, gray, cv::COLOR_BGR2GRAY);
+            } else {
+                _frame.copyTo(gray);
+            }
+        }
+        _next++;
+        return !gray.empty();
+    }
+
+private:
+    /**
+     * @brief Build the periodic texture and the per-frame motion
+     *
+     * The motion inverts the tracker's model: forward velocity moves the
+     * image along rows, leftward velocity moves it against the columns.
+     * Rates about X and Y add the opposite bearing change as a shift, the
+     * rate about Z rotates the image about its centre.
+     */
+    void openSynthetic() {
+        const int w = _config.width;
+        const int h = _config.height;
+
+        // Blobby random texture, corners come from the interpolated blobs
+        cv::RNG rng(_config.seed);
+        cv::Mat coarse(std::max(2, h / 6), std::max(2, w / 6), CV_8UC1);
+        rng.fill(coarse, cv::RNG::UNIFORM, 0, 256);
+        cv::Mat tile;
+        cv::resize(coarse, tile, cv::Size(w, h), 0, 0, cv::INTER_CUBIC);
+
+        // 3x3 periodic copy, a frame rotated about the middle tile stays inside it
+        cv::repeat(tile, 3, 3, _texture);
+
+        const double dt = 1.0 / _config.fps;
+        const double fov_h = 2.0 * std::atan(_config.cmos_width / (2.0 * _config.focal));
+        const double fov_v = 2.0 * std::atan(_config.cmos_height / (2.0 * _config.focal));
+        _shift_y = (std::atan(_config.velocity_x * dt / _config.altitude) -
+                    _config.rotation[1] * dt) * h / fov_v;
+        _shift_x = -(std::atan(_config.velocity_y * dt / _config.altitude) +
+                     _config.rotation[0] * dt) * w / fov_h;
+        _angle = _config.rotation[2] * dt;
+    }
+
+    /**
+     * @brief Render frame k of the moving texture with sub-pixel accuracy
+     *
+     * Frames are rendered in order, every call advances the accumulated
+     * offset by one frame.
+     */
+    void renderSynthetic(int k, cv::Mat& gray) {
+        const int w = _config.width;
+        const int h = _config.height;
+
+        // Every frame maps p to c + R (p - c) + shift, so frame k shows texture point
+        // t at p = c + R_k (t - c) + offset_k with R_k a rotation by k * angle
+        const double cos_k = std::cos(_angle * k);
+        const double sin_k = std::sin(_angle * k);
+        const double cx = (w - 1) * 0.5;
+        const double cy = (h - 1) * 0.5;
+
+        // Texture point at the frame centre, wrapped into the middle tile
+        auto wrap = [](double v, int period) {
+            const double r = std::fmod(v, static_cast<double>(period));
+            return r < 0.0 ? r + period : r;
+        };
+        const double tx = w + wrap(cx - cos_k * _offset.x + sin_k * _offset.y, w);
+        const double ty = h + wrap(cy - sin_k * _offset.x - cos_k * _offset.y, h);
+
+        // Inverse map t = t_centre + R_k^T (p - c)
+        const cv::Mat map = (cv::Mat_<double>(2, 3) <<
+            cos_k, -sin_k, tx - cos_k * cx + sin_k * cy,
+            sin_k, cos_k, ty - sin_k * cx - cos_k * cy);
+        cv::warpAffine(_texture, gray, map, cv::Size(w, h),
+                       cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+
+        const double cos_a = std::cos(_angle);
+        const double sin_a = std::sin(_angle);
+        _offset = cv::Point2d(cos_a * _offset.x + sin_a * _offset.y + _shift_x,
+                              -sin_a * _offset.x + cos_a * _offset.y + _shift_y);
+
+        if (_config.noise > 0.0) {
+            // Seeded per frame, so every tracker mode sees the same noisy sequence
+            cv::RNG rng(_config.seed + 7919u * static_cast<unsigned>(k + 1));
+            _noise.create(h, w, CV_16SC1);
+            rng.fill(_noise, cv::RNG::NORMAL, 0.0, _config.noise);
+            cv::add(gray, _noise, gray, cv::noArray(), CV_8U);
+        }
+    }
+
+    const BenchConfig& _config;         ///< Benchmark configuration
+    int _next;                          ///< Index of the next frame
+    std::vector<cv::String> _files;     ///< Directory source file list
+    cv::VideoCapture _video;            ///< Video source
+    cv::Mat _frame;                     ///< Video decode buffer
+    cv::Mat _texture;                   ///< Periodic synthetic texture (3x3 tiles)
+    cv::Mat _noise;                     ///< Noise of the current synthetic frame
+    double _shift_x;                    ///< Synthetic shift per frame along columns (pixels)
+    double _shift_y;                    ///< Synthetic shift per frame along rows (pixels)
+    double _angle;                      ///< Synthetic rotation per frame about the centre (radians)
+    cv::Point2d _offset;                ///< Accumulated shift of the next synthetic frame (pixels)
+};
+
+/**
+ * @brief Column-major buffers mimicking the Simulink input signal
+ */
+struct SimulinkFrame {
+    std::vector<double> f64;            ///< double input, normalized 0-1
+    std::vector<float> f32;             ///< single input, normalized 0-1
+    std::vector<uint8_t> u8;            ///< uint8 input, 0-255
+
+    void fill(const cv::Mat& gray, const std::string& type) {
+        const size_t n = static_cast<size_t>(gray.rows) * gray.cols;
+        f64.resize(type == "double" ? n : 0);
+        f32.resize(type == "single" ? n : 0);
+        u8.resize(type == "uint8" ? n : 0);
+        for (int c = 0; c < gray.cols; ++c) {
+            for (int r = 0; r < gray.rows; ++r) {
+                const size_t i = static_cast<size_t>(c) * gray.rows + r;
+                const uchar v = gray.at<uchar>(r, c);
+                if (!f64.empty()) {
+                    f64[i] = v / 255.0;
+                } else if (!f32.empty()) {
+                    f32[i] = v / 255.0f;
+                } else {
+                    u8[i] = v;
+                }
+            }
+        }
+    }
+
+    void ingest(const ImageIngestion& ingestion, cv::Mat& image) const {
+        if (!f64.empty()) {
+            ingestion.ingest(f64.data(), image);
+        } else if (!f32.empty()) {
+            ingestion.ingest(f32.data(), image);
+        } else {
+            ingestion.ingest(u8.data(), image);
+        }
+    }
+};
+
+/**
+ * @brief Accuracy and throughput of one replayed sequence
+ */
+struct RunSummary {
+    int frames;                         ///< Measured frames
+    double fps;                         ///< Frames per second of tracker busy time
+    double mean_features;               ///< Mean tracked features per frame
+    unsigned long long heap_allocations; ///< OpenCV allocations the arena could not serve
+    int skipped_frames;                 ///< Frames skipped by the early-out
+    int keyframes;                      ///< Keyframe promotions
+    int truth_frames;                   ///< Frames with an ego velocity (tracked or skipped) and a ground truth
+    int feature_frames;                 ///< Frames with features and a ground truth
+    double ego_rmse_x;                  ///< RMS ego velocity error, forward (m/s, NaN if unknown)
+    double ego_rmse_y;                  ///< RMS ego velocity error, left (m/s, NaN if unknown)
+    double feature_rmse;                ///< RMS per-feature velocity error (m/s, NaN if unknown)
+};
+
+RunSummary summarize(const BenchConfig& config, const std::vector<FrameRecord>& records,
+                     bool has_truth) {
+    // Throughput over the measured frames only
+    double busy = 0.0;
+    double ego_sq_x = 0.0;
+    double ego_sq_y = 0.0;
+    double feature_sq = 0.0;
+    double feature_sum = 0.0;
+    RunSummary summary = {};
+    for (const FrameRecord& r : records) {
+        busy += r.stage[StageProfiler::STAGE_TOTAL];
+        feature_sum += r.features;
+        summary.heap_allocations += r.heap_allocations;
+        summary.skipped_frames += r.skipped ? 1 : 0;
+        summary.keyframes += r.keyframe ? 1 : 0;
+        if (!has_truth) {
+            continue;
+        }
+        // Skipped frames report the ego velocity of the global shift, it is scored as well
+        if (r.features > 0 || r.skipped) {
+            ego_sq_x += (r.ego_x - config.velocity_x) * (r.ego_x - config.velocity_x);
+            ego_sq_y += (r.ego_y - config.velocity_y) * (r.ego_y - config.velocity_y);
+            summary.truth_frames++;
+        }
+        if (r.features > 0) {
+            feature_sq += r.feature_rmse * r.feature_rmse;
+            summary.feature_frames++;
+        }
+    }
+    const double n = static_cast<double>(std::max<size_t>(records.size(), 1));
+
+    summary.frames = static_cast<int>(records.size());
+    summary.fps = busy > 0.0 ? records.size() / busy : 0.0;
+    summary.mean_features = feature_sum / n;
+    summary.ego_rmse_x = std::nan("");
+    summary.ego_rmse_y = std::nan("");
+    summary.feature_rmse = std::nan("");
+    if (summary.truth_frames > 0) {
+        summary.ego_rmse_x = std::sqrt(ego_sq_x / summary.truth_frames);
+        summary.ego_rmse_y = std::sqrt(ego_sq_y / summary.truth_frames);
+    }
+    if (summary.feature_frames > 0) {
+        summary.feature_rmse = std::sqrt(feature_sq / summary.feature_frames);
+    }
+    return summary;
+}
+
+/**
+ * @brief Find the first frame whose velocities differ between two runs
+ *
+ * @param tolerance Largest difference of a velocity or RMS error (m/s)
+ * @return Index of the frame, -1 if all frames match
+ */
+int firstMismatch(const std::vector<FrameRecord>& a, const std::vector<FrameRecord>& b,
+                  double tolerance) {
+    auto same = [tolerance](double x, double y) {
+        return std::fabs(x - y) <= tolerance || (std::isnan(x) && std::isnan(y));
+    };
+    const size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i].features != b[i].features || !same(a[i].ego_x, b[i].ego_x) ||
+            !same(a[i].ego_y, b[i].ego_y) || !same(a[i].feature_rmse, b[i].feature_rmse)) {
+            return a[i].index;
+        }
+    }
+    return (a.size() == b.size()) ? -1 : static_cast<int>(n);
+}
+
+/**
+ * @brief Print a number as JSON, null if it is not finite
+ */
+void printJsonNumber(std::FILE* out, const char* format, double value) {
+    if (std::isfinite(value)) {
+        std::fprintf(out, format, value);
+    } else {
+        std::fprintf(out, "null");
+    }
+}
+
+void writeJson(std::FILE* out, const BenchConfig& config, const StageProfiler& profiler,
+               const RunSummary& summary, double wall_time) {
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"source\": \"%s\",\n", config.source.c_str());
+    std::fprintf(out, "  \"input_type\": \"%s\",\n", config.input_type.c_str());
+    std::fprintf(out, "  \"procedure\": %d,\n", config.procedure);
+    std::fprintf(out, "  \"pipeline\": %d,\n", config.pipeline);
+    std::fprintf(out, "  \"conversion\": %d,\n", config.conversion);
+    std::fprintf(out, "  \"method\": %d,\n", config.method);
+    std::fprintf(out, "  \"detector\": %d,\n", config.detector);
+    std::fprintf(out, "  \"decimation\": %d,\n", config.decimation);
+    std::fprintf(out, "  \"tiles\": %d,\n", config.tiles);
+    std::fprintf(out, "  \"reject\": [%.3f, %.3f],\n", config.max_track_error,
+                 config.max_fb_error);
+    std::fprintf(out, "  \"latency_target_ms\": %.3f,\n", config.latency_target * 1e3);
+    std::fprintf(out, "  \"rotation\": [%.4f, %.4f, %.4f],\n", config.rotation[0],
+                 config.rotation[1], config.rotation[2]);
+    std::fprintf(out, "  \"noise\": %.3f,\n", config.noise);
+    std::fprintf(out, "  \"frames\": %d,\n", summary.frames);
+    std::fprintf(out, "  \"fps\": %.3f,\n", summary.fps);
+    std::fprintf(out, "  \"wall_time_s\": %.6f,\n", wall_time);
+    std::fprintf(out, "  \"mean_features\": %.2f,\n", summary.mean_features);
+    std::fprintf(out, "  \"heap_allocations\": %llu,\n", summary.heap_allocations);
+    std::fprintf(out, "  \"skipped_frames\": %d,\n", summary.skipped_frames);
+    std::fprintf(out, "  \"keyframes\": %d,\n", summary.keyframes);
+
+    std::fprintf(out, "  \"stages\": {\n");
+    for (int stage = 0; stage < StageProfiler::NUM_STAGES; ++stage) {
+        const StageProfiler::Summary s = profiler.summary(stage);
+        std::fprintf(out, "    \"%s\": {\"count\": %llu, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+                     "\"max_ms\": %.4f}%s\n",
+                     StageProfiler::stageName(stage), static_cast<unsigned long long>(s.count),
+                     s.p50 * 1e3, s.p99 * 1e3, s.max * 1e3,
+                     stage + 1 < StageProfiler::NUM_STAGES ? "," : "");
+    }
+    std::fprintf(out, "  },\n");
+
+    if (summary.truth_frames > 0) {
+        std::fprintf(out, "  \"velocity_error\": {\"truth\": [%.6f, %.6f], "
+                     "\"ego_rmse\": [%.6f, %.6f], \"feature_rmse\": ",
+                     config.velocity_x, config.velocity_y, summary.ego_rmse_x,
+                     summary.ego_rmse_y);
+        printJsonNumber(out, "%.6f", summary.feature_rmse);
+        std::fprintf(out, "}\n");
+    } else {
+        std::fprintf(out, "  \"velocity_error\": null\n");
+    }
+    std::fprintf(out, "}\n");
+}
+
+void writeCsv(std::FILE* out, const std::vector<FrameRecord>& records) {
+    std::fprintf(out, "frame");
+    for (int stage = 0; stage < StageProfiler::NUM_STAGES; ++stage) {
+        std::fprintf(out, ",%s_ms", StageProfiler::stageName(stage));
+    }
+    std::fprintf(out, ",features,heap_allocations,ego_vx,ego_vy,feature_rmse\n");
+
+    for (const FrameRecord& r : records) {
+        std::fprintf(out, "%d", r.index);
+        for (int stage = 0; stage < StageProfiler::NUM_STAGES; ++stage) {
+            std::fprintf(out, ",%.4f", r.stage[stage] * 1e3);
+        }
+        std::fprintf(out, ",%d,%llu,%.6f,%.6f,", r.features, r.heap_allocations,
+                     r.ego_x, r.ego_y);
+        if (std::isnan(r.feature_rmse)) {
+            std::fprintf(out, "\n");
+        } else {
+            std::fprintf(out, "%.6f\n", r.feature_rmse);
+        }
+    }
+}
+
+/**
+ * @brief Create the tracker of a run with the configured settings
+ */
+std::unique_ptr<OpticalFlowTracking> makeTracker(const BenchConfig& config) {
+    std::unique_ptr<OpticalFlowTracking> tracker(
+        new OpticalFlowTracking(config.method,
+                                static_cast<float>(1.0 / config.fps),
+                                static_cast<float>(config.focal),
+                                static_cast<float>(config.cmos_width),
+                                static_cast<float>(config.cmos_height),
+                                config.procedure));
+    tracker->setFeatureDetector(config.detector, config.detector_threshold);
+    tracker->setDetectorParameters(config.max_corners, config.quality_level,
+                                   config.min_distance, config.block_size);
+    tracker->setVelocityConversionMode(config.conversion);
+    tracker->setRobustAggregation(true);
+    tracker->setOutlierRejection(static_cast<float>(config.max_track_error),
+                                 static_cast<float>(config.max_fb_error));
+    tracker->setLatencyTarget(config.latency_target);
+    if (config.keyframe > 0.0) {
+        tracker->setKeyframeMode(true, static_cast<float>(config.keyframe));
+    }
+    tracker->setEarlyOut(static_cast<float>(config.early_out));
+    tracker->setParallelTracking(config.tiles);
+    tracker->setRotationCompensation(compensatesRotation(config));
+    tracker->setPipelineMode(config.pipeline);
+    return tracker;
+}
+
+/**
+ * @brief Replay the configured source through a tracker
+ *
+ * The first frame sizes the ingestion stage and acquires the Mat arena,
+ * which the caller releases once the tracker is gone.
+ *
+ * @param records Measurements of the frames after the warm-up
+ * @param has_truth Set if the source has a known ground-truth velocity
+ * @param wall_time Wall-clock time of the replay (seconds)
+ * @return 0 on success, otherwise the exit status of the failure
+ */
+int replay(const BenchConfig& config, OpticalFlowTracking& tracker,
+           std::vector<FrameRecord>& records, bool& has_truth, double& wall_time) {
+    FrameSource source(config);
+    if (!source.open()) {
+        std::fprintf(stderr, "Cannot open source %s\n", config.source.c_str());
+        return 1;
+    }
+    has_truth = source.hasGroundTruth();
+
+    OpticalFlowResult result(OpticalFlowTracking::DEFAULT_MAX_CORNERS);
+    StageProfiler& profiler = tracker.profiler();
+    records.reserve(config.frames);
+
+    // The synthetic camera rate, as a gyro would report it
+    const cv::Vec3f angular_rate(static_cast<float>(config.rotation[0] + config.gyro_bias),
+                                 static_cast<float>(config.rotation[1] + config.gyro_bias),
+                                 static_cast<float>(config.rotation[2] + config.gyro_bias));
+    cv::Mat gray;
+    cv::Mat image;
+    SimulinkFrame input;
+    std::unique_ptr<ImageIngestion> ingestion;
+    int index = 0;
+    const auto wall_start = std::chrono::steady_clock::now();
+
+    while (source.read(gray)) {
+        if (!ingestion) {
+            const cv::Rect roi = config.roi.empty() ? cv::Rect(0, 0, gray.cols, gray.rows)
+                                                    : config.roi;
+            if (roi.x < 0 || roi.y < 0 || roi.x + roi.width > gray.cols ||
+                roi.y + roi.height > gray.rows || roi.width / config.decimation < 1 ||
+                roi.height / config.decimation < 1) {
+                std::fprintf(stderr, "Region of interest does not fit the %dx%d frames\n",
+                             gray.cols, gray.rows);
+                return 2;
+            }
+            ingestion.reset(new ImageIngestion(gray.rows, gray.cols, roi, config.decimation));
+            const cv::Size size = ingestion->outputSize();
+
+            // Same arena as the S-function, the tracker allocates its buffers on the first step
+            MatArenaAllocator::instance().acquire(MatArenaAllocator::frameBudget(size));
+            tracker.setRegionOfInterest(gray.size(),
+                                        cv::Rect(roi.x, roi.y, size.width * config.decimation,
+                                                 size.height * config.decimation));
+        }
+        input.fill(gray, config.input_type);
+
+        // Statistics cover the measured frames only
+        if (index == config.warmup) {
+            profiler.reset();
+        }
+
+        // Same sequence of calls as mdlOutputs
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t allocations_before = MatArenaAllocator::instance().systemAllocations();
+        tracker._set_delta_t_(1.0 / config.fps);
+        if (compensatesRotation(config)) {
+            tracker.setAngularRate(angular_rate);
+        }
+        {
+            // Ingest straight into the tracker's current buffer, as the S-function does
+            OPTICAL_FLOW_PROFILE_SCOPE(&profiler, StageProfiler::STAGE_INGESTION);
+            input.ingest(*ingestion, tracker.frameBuffer());
+            image = tracker.frameBuffer();
+        }
+        try {
+            tracker.calculateRealVel(image, static_cast<float>(config.altitude), result);
+        } catch (const cv::Exception& e) {
+            std::fprintf(stderr, "Frame %d: %s\n", index, e.what());
+            result.reset();
+        }
+        profiler.record(StageProfiler::STAGE_TOTAL, std::chrono::steady_clock::now() - start);
+
+        if (index >= config.warmup) {
+            FrameRecord record;
+            record.index = index;
+            for (int stage = 0; stage < StageProfiler::NUM_STAGES; ++stage) {
+                record.stage[stage] = profiler.last(stage);
+            }
+            record.features = result.count;
+            record.ego_x = result.ego_vel_x;
+            record.ego_y = result.ego_vel_y;
+            record.feature_rmse = std::nan("");
+            record.heap_allocations = MatArenaAllocator::instance().systemAllocations() -
+                                      allocations_before;
+            record.skipped = result.skipped;
+            record.keyframe = result.keyframe;
+            if (has_truth && result.count > 0) {
+                double sq = 0.0;
+                for (int i = 0; i < result.count; ++i) {
+                    const double ex = result.vel_x[i] - config.velocity_x;
+                    const double ey = result.vel_y[i] - config.velocity_y;
+                    sq += ex * ex + ey * ey;
+                }
+                record.feature_rmse = std::sqrt(sq / result.count);
+            }
+            records.push_back(record);
+        }
+        index++;
+    }
+    wall_time = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wall_start).count();
+    return 0;
+}
+
+/**
+ * @brief Synthetic scene of the regression suite
+ */
+struct SuiteScene {
+    const char* name;                   ///< Scene name in reports and baselines
+    double altitude;                    ///< Height above ground (meters)
+    double velocity_x;                  ///< Ground-truth velocity, forward (m/s)
+    double velocity_y;                  ///< Ground-truth velocity, left (m/s)
+    double rotation[3];                 ///< Angular rate about X, Y, Z (rad/s)
+    double noise;                       ///< Pixel noise standard deviation (gray levels)
+};
+
+/**
+ * @brief Scenes of the suite, each isolating one effect on the flow
+ *
+ * The altitude scene scales the velocity with the height, its pixel flow
+ * matches the translation scene and only the conversion differs.
+ */
+const SuiteScene SUITE_SCENES[] = {
+    {"translation", 5.0, 1.0, 0.5, {0.0, 0.0, 0.0}, 0.0},
+    {"rotation", 5.0, 1.0, 0.5, {0.2, -0.1, 0.3}, 0.0},
+    {"altitude", 20.0, 4.0, 2.0, {0.0, 0.0, 0.0}, 0.0},
+    {"noise", 5.0, 1.0, 0.5, {0.0, 0.0, 0.0}, 4.0},
+};
+
+/**
+ * @brief Gyro bias of the gyro_bias suite mode (rad/s)
+ *
+ * Rotates the frame by about 3e-8 rad at 30 frames/s, a velocity change of
+ * a few micrometers per second at the suite altitudes.
+ */
+constexpr double SUITE_GYRO_BIAS = 1e-6;
+
+/**
+ * @brief Largest velocity difference between a run and the mode it must stay close to (m/s)
+ */
+constexpr double SUITE_CONTINUITY_TOLERANCE = 1e-4;
+
+/**
+ * @brief Tracker mode of the suite, one feature switched on over the reference
+ */
+struct SuiteMode {
+    const char* name;                   ///< Mode name in reports and baselines
+    void (*apply)(BenchConfig& config); ///< Changes to the reference settings
+    const char* close_to;               ///< Mode this run must stay close to (nullptr = none)
+};
+
+/**
+ * @brief Modes of the suite, the reference first
+ *
+ * Pyramid reuse across frames is always on and has no mode of its own.
+ * Modes whose optical flow method is not built in are skipped. The early-out
+ * threshold lies just above the per-frame shift of the scenes without
+ * rotation, so about every other frame is skipped and scored from its
+ * global shift. The latency target is below any achievable step time and
+ * pins the budget to its floor, which keeps that run host independent.
+ * compensated always enables rotation compensation, so the scenes without
+ * rotation compensate a zero rate. gyro_bias adds SUITE_GYRO_BIAS to the
+ * rate the tracker is given, the frames are unchanged. Its velocities must
+ * stay within SUITE_CONTINUITY_TOLERANCE of compensated in every scene.
+ */
+const SuiteMode SUITE_MODES[] = {
+    {"baseline", [](BenchConfig&) {}, nullptr},
+    {"fast_tan", [](BenchConfig& c) { c.conversion = VelocityConversion::MODE_FAST; }, nullptr},
+    {"reuse", [](BenchConfig& c) {
+        c.procedure = OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_INCREMENTAL;
+    }, nullptr},
+    {"keyframe", [](BenchConfig& c) { c.keyframe = 8.0; }, nullptr},
+    {"overlap", [](BenchConfig& c) {
+        c.pipeline = OpticalFlowTracking::PIPELINE_OVERLAP_DETECTION;
+    }, nullptr},
+    {"deferred", [](BenchConfig& c) {
+        c.pipeline = OpticalFlowTracking::PIPELINE_DEFERRED;
+    }, nullptr},
+    {"early_out", [](BenchConfig& c) { c.early_out = 4.0; }, nullptr},
+    {"roi", [](BenchConfig& c) {
+        c.roi = cv::Rect(c.width / 4, c.height / 4, c.width / 2, c.height / 2);
+        c.decimation = 2;
+    }, nullptr},
+    {"rejection", [](BenchConfig& c) {
+        c.max_track_error = 20.0;
+        c.max_fb_error = 1.0;
+    }, nullptr},
+    {"latency", [](BenchConfig& c) { c.latency_target = 1e-4; }, nullptr},
+    {"compensated", [](BenchConfig& c) { c.compensate = true; }, nullptr},
+    {"gyro_bias", [](BenchConfig& c) {
+        c.compensate = true;
+        c.gyro_bias = SUITE_GYRO_BIAS;
+    }, "compensated"},
+    {"tiles", [](BenchConfig& c) { c.tiles = 4; }, nullptr},
+    {"dis", [](BenchConfig& c) { c.method = OpticalFlowTracking::OPTICAL_FLOW_DIS_DENSE; }, nullptr},
+    {"cuda", [](BenchConfig& c) {
+        c.method = OpticalFlowTracking::OPTICAL_FLOW_LUCAS_KANADE_CUDA;
+    }, nullptr},
+};
+
+/**
+ * @brief Absolute RMS error growth always tolerated (m/s)
+ *
+ * Keeps runs that are already close to the ground truth from failing on
+ * the last digits.
+ */
+constexpr double RMSE_SLACK = 1e-3;
+
+/**
+ * @brief Stored result of one suite run
+ */
+struct BaselineEntry {
+    std::string scene;                  ///< Scene name
+    std::string mode;                   ///< Mode name
+    double ego_rmse;                    ///< RMS ego velocity error (m/s)
+    double feature_rmse;                ///< RMS per-feature velocity error (m/s)
+    double fps;                         ///< Frames per second
+};
+
+/**
+ * @brief Result of one suite run
+ */
+struct SuiteRow {
+    const char* scene;                  ///< Scene name
+    const char* mode;                   ///< Mode name
+    RunSummary summary;                 ///< Accuracy and throughput
+    double ego_rmse;                    ///< RMS ego velocity error magnitude (m/s, NaN if unknown)
+    const BaselineEntry* baseline;      ///< Stored result, nullptr if there is none
+    bool regressed;                     ///< Past the baseline tolerance or unlike the reference
+};
+
+/**
+ * @brief Reference settings of a suite run
+ *
+ * Frame size, frame count, corner budget and input type keep their command
+ * line values, everything a mode switches is reset.
+ */
+BenchConfig suiteReference(const BenchConfig& config, const SuiteScene& scene) {
+    BenchConfig run = config;
+    run.source = "synthetic";
+    run.altitude = scene.altitude;
+    run.velocity_x = scene.velocity_x;
+    run.velocity_y = scene.velocity_y;
+    std::copy(scene.rotation, scene.rotation + 3, run.rotation);
+    run.noise = scene.noise;
+    run.procedure = OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC;
+    run.pipeline = OpticalFlowTracking::PIPELINE_SYNCHRONOUS;
+    run.conversion = VelocityConversion::MODE_EXACT;
+    run.method = OpticalFlowTracking::OPTICAL_FLOW_LUCAS_KANADE;
+    run.latency_target = 0.0;
+    run.keyframe = 0.0;
+    run.early_out = 0.0;
+    run.tiles = 0;
+    run.roi = cv::Rect();
+    run.decimation = 1;
+    run.max_track_error = 0.0;
+    run.max_fb_error = 0.0;
+    run.compensate = false;
+    run.gyro_bias = 0.0;
+    return run;
+}
+
+/**
+ * @brief Read a baseline written by writeBaseline()
+ *
+ * @return false if the file cannot be opened
+ */
+bool readBaseline(const std::string& path, std::vector<BaselineEntry>& entries) {
+    std::FILE* in = std::fopen(path.c_str(), "r");
+    if (in == nullptr) {
+        return false;
+    }
+    char line[256];
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        char scene[64];
+        char mode[64];
+        BaselineEntry entry;
+        if (line[0] == '#' ||
+            std::sscanf(line, "%63s %63s %lf %lf %lf", scene, mode, &entry.ego_rmse,
+                        &entry.feature_rmse, &entry.fps) != 5) {
+            continue;
+        }
+        entry.scene = scene;
+        entry.mode = mode;
+        entries.push_back(entry);
+    }
+    std::fclose(in);
+    return true;
+}
+
+/**
+ * @brief Store the suite results as a baseline, one run per line
+ *
+ * @return false if the file cannot be written
+ */
+bool writeBaseline(const std::string& path, const BenchConfig& config,
+                   const std::vector<SuiteRow>& rows) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        return false;
+    }
+    std::fprintf(out, "# optical_flow_bench --suite, %dx%d, %d frames, %s input\n",
+                 config.width, config.height, config.frames, config.input_type.c_str());
+    std::fprintf(out, "# scene mode ego_rmse feature_rmse fps\n");
+    for (const SuiteRow& row : rows) {
+        std::fprintf(out, "%s %s %.6f %.6f %.3f\n", row.scene, row.mode, row.ego_rmse,
+                     row.summary.feature_rmse, row.summary.fps);
+    }
+    std::fclose(out);
+    return true;
+}
+
+/**
+ * @brief Compare a run with its baseline
+ *
+ * RMS errors may grow by the relative tolerance plus RMSE_SLACK, the frame
+ * rate may drop by its tolerance. A run without a measurable error fails.
+ */
+bool isRegression(const SuiteRow& row, const BenchConfig& config) {
+    const BaselineEntry& base = *row.baseline;
+    const double factor = 1.0 + config.rmse_tolerance;
+    return !(row.ego_rmse <= base.ego_rmse * factor + RMSE_SLACK) ||
+           !(row.summary.feature_rmse <= base.feature_rmse * factor + RMSE_SLACK) ||
+           row.summary.fps < base.fps * (1.0 - config.fps_tolerance);
+}
+
+void writeSuiteJson(std::FILE* out, const BenchConfig& config,
+                    const std::vector<SuiteRow>& rows) {
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"size\": [%d, %d],\n", config.width, config.height);
+    std::fprintf(out, "  \"frames\": %d,\n", config.frames);
+    std::fprintf(out, "  \"input_type\": \"%s\",\n", config.input_type.c_str());
+    std::fprintf(out, "  \"tolerance\": [%.3f, %.3f],\n", config.rmse_tolerance,
+                 config.fps_tolerance);
+    std::fprintf(out, "  \"runs\": [\n");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const SuiteRow& row = rows[i];
+        std::fprintf(out, "    {\"scene\": \"%s\", \"mode\": \"%s\", \"fps\": %.3f, "
+                     "\"mean_features\": %.2f, \"ego_rmse\": ",
+                     row.scene, row.mode, row.summary.fps, row.summary.mean_features);
+        printJsonNumber(out, "%.6f", row.ego_rmse);
+        std::fprintf(out, ", \"feature_rmse\": ");
+        printJsonNumber(out, "%.6f", row.summary.feature_rmse);
+        if (row.baseline != nullptr) {
+            std::fprintf(out, ", \"baseline\": {\"ego_rmse\": %.6f, \"feature_rmse\": %.6f, "
+                         "\"fps\": %.3f}",
+                         row.baseline->ego_rmse, row.baseline->feature_rmse, row.baseline->fps);
+        } else {
+            std::fprintf(out, ", \"baseline\": null");
+        }
+        std::fprintf(out, ", \"regressed\": %s}%s\n", row.regressed ? "true" : "false",
+                     i + 1 < rows.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n");
+    std::fprintf(out, "}\n");
+}
+
+void writeSuiteCsv(std::FILE* out, const std::vector<SuiteRow>& rows) {
+    std::fprintf(out, "scene,mode,fps,mean_features,ego_rmse,feature_rmse,"
+                 "baseline_fps,baseline_ego_rmse,baseline_feature_rmse,regressed\n");
+    for (const SuiteRow& row : rows) {
+        std::fprintf(out, "%s,%s,%.3f,%.2f,%.6f,%.6f,", row.scene, row.mode, row.summary.fps,
+                     row.summary.mean_features, row.ego_rmse, row.summary.feature_rmse);
+        if (row.baseline != nullptr) {
+            std::fprintf(out, "%.3f,%.6f,%.6f,", row.baseline->fps, row.baseline->ego_rmse,
+                         row.baseline->feature_rmse);
+        } else {
+            std::fprintf(out, ",,,");
+        }
+        std::fprintf(out, "%d\n", row.regressed ? 1 : 0);
+    }
+}
+
+/**
+ * @brief Print the accuracy vs. throughput table of the suite
+ */
+void printSuiteTable(std::FILE* out, const std::vector<SuiteRow>& rows) {
+    std::fprintf(out, "%-12s %-9s %9s %10s %12s %9s  %s\n", "scene", "mode", "features",
+                 "ego_rmse", "feature_rmse", "fps", "baseline");
+    for (const SuiteRow& row : rows) {
+        const char* status = row.baseline == nullptr ? "-" : row.regressed ? "REGRESSED" : "ok";
+        std::fprintf(out, "%-12s %-9s %9.1f %10.5f %12.5f %9.1f  %s\n", row.scene, row.mode,
+                     row.summary.mean_features, row.ego_rmse, row.summary.feature_rmse,
+                     row.summary.fps, status);
+    }
+}
+
+/**
+ * @brief Replay every suite scene through every available mode
+ *
+ * @return 0 if no run regressed, 1 on a regression or failure
+ */
+int runSuite(const BenchConfig& config) {
+    std::vector<BaselineEntry> baseline;
+    if (!config.baseline.empty() && !readBaseline(config.baseline, baseline)) {
+        std::fprintf(stderr, "Cannot read baseline %s\n", config.baseline.c_str());
+        return 1;
+    }
+
+    std::vector<SuiteRow> rows;
+    const size_t num_modes = sizeof(SUITE_MODES) / sizeof(SUITE_MODES[0]);
+    for (const SuiteScene& scene : SUITE_SCENES) {
+        std::vector<std::vector<FrameRecord>> mode_records(num_modes);
+        for (size_t m = 0; m < num_modes; ++m) {
+            const SuiteMode& mode = SUITE_MODES[m];
+            BenchConfig run = suiteReference(config, scene);
+            mode.apply(run);
+            if (!OpticalFlowTracking::isMethodAvailable(run.method)) {
+                std::fprintf(stderr, "Skipping %s/%s, optical flow method %d is not available\n",
+                             scene.name, mode.name, run.method);
+                continue;
+            }
+
+            std::vector<FrameRecord>& records = mode_records[m];
+            bool has_truth = false;
+            double wall_time = 0.0;
+            int status = 0;
+            {
+                std::unique_ptr<OpticalFlowTracking> tracker = makeTracker(run);
+                status = replay(run, *tracker, records, has_truth, wall_time);
+            }
+            // Every run sizes the arena for its own tracker
+            MatArenaAllocator::instance().release();
+            if (status != 0) {
+                return status;
+            }
+
+            SuiteRow row;
+            row.scene = scene.name;
+            row.mode = mode.name;
+            row.summary = summarize(run, records, has_truth);
+            row.ego_rmse = std::hypot(row.summary.ego_rmse_x, row.summary.ego_rmse_y);
+            row.baseline = nullptr;
+            for (const BaselineEntry& entry : baseline) {
+                if (entry.scene == scene.name && entry.mode == mode.name) {
+                    row.baseline = &entry;
+                }
+            }
+            row.regressed = row.baseline != nullptr && isRegression(row, config);
+            for (size_t other = 0; mode.close_to != nullptr && other < m; ++other) {
+                if (std::strcmp(SUITE_MODES[other].name, mode.close_to) != 0) {
+                    continue;
+                }
+                const int frame = firstMismatch(records, mode_records[other],
+                                                SUITE_CONTINUITY_TOLERANCE);
+                if (frame >= 0) {
+                    std::fprintf(stderr, "%s/%s differs from %s/%s at frame %d\n", scene.name,
+                                 mode.name, scene.name, mode.close_to, frame);
+                    row.regressed = true;
+                }
+            }
+            rows.push_back(row);
+        }
+    }
+
+    std::FILE* out = stdout;
+    if (!config.output.empty()) {
+        out = std::fopen(config.output.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+            return 1;
+        }
+    }
+    if (config.format == "csv") {
+        writeSuiteCsv(out, rows);
+    } else {
+        writeSuiteJson(out, config, rows);
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    // The table goes to stderr, the report on stdout stays machine readable
+    printSuiteTable(stderr, rows);
+    if (!config.write_baseline.empty() && !writeBaseline(config.write_baseline, config, rows)) {
+        std::fprintf(stderr, "Cannot write %s\n", config.write_baseline.c_str());
+        return 1;
+    }
+    const long regressions = std::count_if(rows.begin(), rows.end(),
+                                           [](const SuiteRow& row) { return row.regressed; });
+    if (regressions > 0) {
+        std::fprintf(stderr, "%ld of %d suite runs regressed\n", regressions,
+                     static_cast<int>(rows.size()));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Time the Mats of one tracking step created by several threads at once
+ *
+ * Each step allocates the feature, status and error vectors of a full
+ * corner budget, two small temporaries and a half frame, then releases
+ * them, as the camera loop, LK bands and prefetch threads do.
+ *
+ * @return Nanoseconds per Mat created and released, per thread
+ */
+double timeArenaSteps(const BenchConfig& config, int threads, int steps) {
+    const int corners = OpticalFlowTracking::DEFAULT_MAX_CORNERS;
+    const int widths[] = {corners, 4 * corners, 8 * corners, 8 * corners, 256, 16,
+                          config.width * config.height / 2};
+    auto worker = [&widths, steps] {
+        for (int step = 0; step < steps; ++step) {
+            cv::Mat mats[sizeof(widths) / sizeof(widths[0])];
+            for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+                mats[i].create(1, widths[i], CV_8UC1);
+            }
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    const double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return elapsed * 1e9 / (static_cast<double>(steps) * (sizeof(widths) / sizeof(widths[0])));
+}
+
+/**
+ * @brief Report the arena cost per Mat with one and with N threads
+ */
+int runArenaContention(const BenchConfig& config) {
+    const int steps = 20000;
+    MatArenaAllocator& arena = MatArenaAllocator::instance();
+    arena.acquire(config.arena_threads *
+                  MatArenaAllocator::frameBudget(cv::Size(config.width, config.height)));
+
+    // The first run populates the caches and size classes
+    timeArenaSteps(config, config.arena_threads, steps / 10);
+    const uint64_t allocations_before = arena.systemAllocations();
+    const double single = timeArenaSteps(config, 1, steps);
+    const double contended = timeArenaSteps(config, config.arena_threads, steps);
+    const uint64_t allocations = arena.systemAllocations() - allocations_before;
+    arena.release();
+
+    std::printf("{\n");
+    std::printf("  \"arena_threads\": %d,\n", config.arena_threads);
+    std::printf("  \"ns_per_mat_single\": %.1f,\n", single);
+    std::printf("  \"ns_per_mat_contended\": %.1f,\n", contended);
+    std::printf("  \"heap_allocations\": %llu\n", static_cast<unsigned long long>(allocations));
+    std::printf("}\n");
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (config.suite) {
+        return runSuite(config);
+    }
+    if (config.arena_threads > 0) {
+        return runArenaContention(config);
+    }
+
+    std::unique_ptr<OpticalFlowTracking> tracker = makeTracker(config);
+    std::vector<FrameRecord> records;
+    bool has_truth = false;
+    double wall_time = 0.0;
+    const int status = replay(config, *tracker, records, has_truth, wall_time);
+    if (status != 0) {
+        return status;
+    }
+
+    std::FILE* out = stdout;
+    if (!config.output.empty()) {
+        out = std::fopen(config.output.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+            return 1;
+        }
+    }
+
+    if (config.format == "csv") {
+        writeCsv(out, records);
+    } else {
+        writeJson(out, config, tracker->profiler(), summarize(config, records, has_truth),
+                  wall_time);
+    }
+
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
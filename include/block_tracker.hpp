@@ -0,0 +1,92 @@
+/**
+ * @file block_tracker.hpp
+ * @brief Tracker type shared by the S-function and its generated code
+ *
+ * This file selects the tracker the Simulink block is built around and
+ * writes its per-feature output, so the MEX S-function and the code
+ * generation wrapper always agree on both.
+ */
+
+#ifndef BLOCK_TRACKER_HPP
+#define BLOCK_TRACKER_HPP
+
+#include "optical_flow_tracking_batch.hpp"
+#include "fixed_optical_flow_tracking.hpp"
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @brief Number of feature columns on the velocity output port
+ */
+static constexpr int MAX_OUTPUT_FEATURES = 1000;
+
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+#ifndef OPTICAL_FLOW_FIXED_WINDOW_SIZE
+#define OPTICAL_FLOW_FIXED_WINDOW_SIZE 16
+#endif
+#ifndef OPTICAL_FLOW_FIXED_MAX_LEVEL
+#define OPTICAL_FLOW_FIXED_MAX_LEVEL 2
+#endif
+
+/**
+ * @brief Single-camera tracker specialized for the frame size the block was built for
+ *
+ * Selected by defining OPTICAL_FLOW_FIXED_HEIGHT and OPTICAL_FLOW_FIXED_WIDTH
+ * (CMake option FIXED_FRAME_SIZE). The Lucas-Kanade window and pyramid depth
+ * come from OPTICAL_FLOW_FIXED_WINDOW_SIZE and OPTICAL_FLOW_FIXED_MAX_LEVEL,
+ * P(7) and P(8) are ignored.
+ */
+using TrackerBatch = FixedOpticalFlowTracking<OPTICAL_FLOW_FIXED_HEIGHT, OPTICAL_FLOW_FIXED_WIDTH,
+                                              MAX_OUTPUT_FEATURES, OPTICAL_FLOW_FIXED_WINDOW_SIZE,
+                                              OPTICAL_FLOW_FIXED_MAX_LEVEL>;
+#else
+/**
+ * @brief Trackers for a runtime-configured number of cameras and frame size
+ */
+using TrackerBatch = OpticalFlowTrackingBatch;
+#endif
+
+/**
+ * @brief Feature columns a variable-size velocity port needs for the last step
+ *
+ * @param batch Trackers after the step
+ * @return Largest valid feature count of all cameras, at most MAX_OUTPUT_FEATURES
+ */
+inline int featureColumns(const TrackerBatch &batch) {
+    int columns = 0;
+    for (int camera = 0; camera < batch.size(); ++camera) {
+        columns = std::max(columns, std::min(batch.result(camera).count, MAX_OUTPUT_FEATURES));
+    }
+    return columns;
+}
+
+/**
+ * @brief Write the per-feature velocities of the last step
+ *
+ * One 2 x columns page per camera in column-major order, [vx; vy] per
+ * feature. Columns past a camera's feature count are zeroed, with a single
+ * camera and columns from featureColumns() there are none.
+ *
+ * @param batch Trackers after the step
+ * @param columns Feature columns per page, MAX_OUTPUT_FEATURES for the fixed-size port
+ * @param out Output of 2 x columns x cameras elements, double or single
+ */
+template <typename T>
+void writeFeatureVelocities(const TrackerBatch &batch, int columns, T* out) {
+    for (int camera = 0; camera < batch.size(); ++camera) {
+        const OpticalFlowResult& result = batch.result(camera);
+        T* page = out + static_cast<size_t>(camera) * 2 * columns;
+        const int valid_features = std::min(result.count, columns);
+
+        // Straight from the result arrays, no intermediate buffer
+        const float* vel_x = result.vel_x.data();
+        const float* vel_y = result.vel_y.data();
+        for (int i = 0; i < valid_features; i++) {
+            page[2 * i] = static_cast<T>(vel_x[i]);
+            page[2 * i + 1] = static_cast<T>(vel_y[i]);
+        }
+        std::fill(page + 2 * valid_features, page + 2 * columns, T(0));
+    }
+}
+
+#endif // BLOCK_TRACKER_HPP
@@ -0,0 +1,115 @@
+/**
+ * @file budget_controller.hpp
+ * @brief Closed-loop control of the per-frame tracking effort
+ *
+ * This file defines the BudgetController class, which scales the corner
+ * budget, the pyramid depth and the Lucas-Kanade iteration count from the
+ * measured step time so a latency target is met.
+ */
+
+#ifndef BUDGET_CONTROLLER_HPP
+#define BUDGET_CONTROLLER_HPP
+
+/**
+ * @class BudgetController
+ * @brief Effort controller with proportional decrease and additive recovery
+ *
+ * The controller keeps a single effort value between 0 and 1. Every measured
+ * step updates it:
+ * - above the target, effort is scaled by target / time with a margin, so a
+ *   step twice as slow as allowed roughly halves the work of the next one;
+ * - below HEADROOM times the target, effort grows by RECOVERY_STEP, so more
+ *   work is only taken on gradually once there is room for it;
+ * - in between it is left unchanged, which keeps the budget from
+ *   oscillating around the target.
+ *
+ * The budget interpolates linearly between a floor and a ceiling with the
+ * effort, pyramid levels and iterations rounded to whole values. Step time
+ * is roughly proportional to the number of tracked corners times the
+ * iterations, so the proportional decrease lands close to the target within
+ * a frame or two.
+ */
+class BudgetController {
+public:
+    /**
+     * @brief Fraction of the target below which effort is increased again
+     */
+    static constexpr double HEADROOM = 0.8;
+
+    /**
+     * @brief Effort added per step with headroom
+     */
+    static constexpr double RECOVERY_STEP = 0.05;
+
+    /**
+     * @brief Margin applied to the proportional decrease
+     */
+    static constexpr double DECREASE_MARGIN = 0.9;
+
+    /**
+     * @brief Settings that bound the cost of one step
+     */
+    struct Budget {
+        int max_corners;            ///< Corner budget of the detector
+        int max_level;              ///< Maximum 0-based pyramid level used for tracking
+        int max_iterations;         ///< Lucas-Kanade iterations per level
+    };
+
+    /**
+     * @brief Constructor, the controller starts disabled
+     */
+    BudgetController();
+
+    /**
+     * @brief Set the latency target and the range of the budget
+     *
+     * Effort restarts at 1, the ceiling.
+     *
+     * @param target Step time to stay under (seconds), 0 or less disables the controller
+     * @param ceiling Budget at full effort, the configured tracker settings
+     * @param floor Budget at zero effort, clamped to the ceiling
+     */
+    void configure(double target, const Budget &ceiling, const Budget &floor);
+
+    /**
+     * @brief Check whether a latency target is set
+     */
+    bool enabled() const { return _target > 0.0; }
+
+    /**
+     * @brief Latency target (seconds), 0 when disabled
+     */
+    double target() const { return _target; }
+
+    /**
+     * @brief Current effort between 0 and 1
+     */
+    double effort() const { return _effort; }
+
+    /**
+     * @brief Budget of the current effort, the ceiling when disabled
+     */
+    const Budget& budget() const { return _budget; }
+
+    /**
+     * @brief Feed one measured step time
+     *
+     * @param step_time Duration of the last step (seconds)
+     * @return true if the budget changed
+     */
+    bool update(double step_time);
+
+private:
+    /**
+     * @brief Recompute the budget from the effort
+     */
+    bool applyEffort();
+
+    double _target;                 ///< Latency target (seconds), 0 = disabled
+    double _effort;                 ///< Current effort between 0 and 1
+    Budget _ceiling;                ///< Budget at full effort
+    Budget _floor;                  ///< Budget at zero effort
+    Budget _budget;                 ///< Budget of the current effort
+};
+
+#endif // BUDGET_CONTROLLER_HPP
@@ -0,0 +1,271 @@
+/**
+ * @file fixed_optical_flow_tracking.hpp
+ * @brief Optical flow tracker specialized for a compile-time configuration
+ *
+ * This file defines the FixedOpticalFlowTracking class template, which
+ * fixes the frame geometry, the feature capacity and the Lucas-Kanade
+ * settings at compile time for models whose configuration never changes,
+ * such as code generated for an embedded target.
+ */
+
+#ifndef FIXED_OPTICAL_FLOW_TRACKING_HPP
+#define FIXED_OPTICAL_FLOW_TRACKING_HPP
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <array>
+#include <string>
+#include "optical_flow_velocity.hpp"
+#include "optical_flow_tracking_batch.hpp"
+
+/**
+ * @class FixedOpticalFlowTracking
+ * @brief Single-camera tracker with compile-time geometry and storage
+ *
+ * The ping-pong frame pair lives in std::array storage sized Height x Width
+ * and the result is allocated once for MaxFeatures entries, so nothing is
+ * sized at run time. The velocity conversion keeps the runtime geometry of
+ * the wrapped tracker.
+ * Window size, pyramid depth and iteration count are applied once at
+ * construction and cannot be changed afterwards. The interface mirrors
+ * OpticalFlowTrackingBatch with a single camera, so the S-function can use
+ * either type through the same calls.
+ *
+ * @tparam Height Frame height in pixels
+ * @tparam Width Frame width in pixels
+ * @tparam MaxFeatures Feature capacity, at most DEFAULT_MAX_CORNERS
+ * @tparam WindowSize Lucas-Kanade search window edge length in pixels
+ * @tparam MaxLevel Maximum 0-based pyramid level
+ * @tparam MaxIterations Lucas-Kanade iterations per pyramid level
+ */
+template <int Height, int Width,
+          int MaxFeatures = OpticalFlowTracking::DEFAULT_MAX_CORNERS,
+          int WindowSize = OpticalFlowTracking::DEFAULT_LK_WINDOW_SIZE,
+          int MaxLevel = OpticalFlowTracking::DEFAULT_LK_MAX_LEVEL,
+          int MaxIterations = OpticalFlowTracking::DEFAULT_LK_MAX_ITERATIONS>
+class FixedOpticalFlowTracking {
+public:
+    static_assert(Height > 0 && Width > 0, "Frame size must be positive");
+    static_assert(MaxFeatures > 0 && MaxFeatures <= OpticalFlowTracking::DEFAULT_MAX_CORNERS,
+                  "Feature capacity must be between 1 and DEFAULT_MAX_CORNERS");
+    static_assert(WindowSize >= 3, "Lucas-Kanade window must be at least 3 pixels");
+    static_assert(MaxLevel >= 0, "Pyramid level must not be negative");
+    static_assert(MaxIterations > 0, "At least one Lucas-Kanade iteration is required");
+
+    static constexpr int HEIGHT = Height;               ///< Frame height in pixels
+    static constexpr int WIDTH = Width;                 ///< Frame width in pixels
+    static constexpr int PIXELS = Height * Width;       ///< Pixels per frame
+    static constexpr int MAX_FEATURES = MaxFeatures;    ///< Feature capacity
+    static constexpr int WINDOW_SIZE = WindowSize;      ///< Lucas-Kanade window (pixels)
+    static constexpr int MAX_LEVEL = MaxLevel;          ///< Maximum pyramid level
+    static constexpr int MAX_ITERATIONS = MaxIterations; ///< Iterations per level
+    static constexpr double EPSILON =
+        OpticalFlowTracking::DEFAULT_LK_EPSILON;        ///< Iteration stop threshold (pixels)
+
+    /**
+     * @brief Constructor for FixedOpticalFlowTracking
+     *
+     * @param method Optical flow method (see OpticalFlowTracking)
+     * @param delta_t Initial time step between frames in seconds
+     * @param camera Camera intrinsics
+     * @param feature_procedure Feature maintenance procedure
+     */
+    FixedOpticalFlowTracking(int method, float delta_t, const CameraIntrinsics &camera,
+                             int feature_procedure =
+                                 OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC)
+        : _tracker(method, delta_t, camera.focal_length, camera.cmos_width,
+                   camera.cmos_height, feature_procedure),
+          _frame_storage(),
+          _result(MaxFeatures),
+          _error() {
+        _tracker.setFrameBuffers(cv::Mat(Height, Width, CV_8UC1, _frame_storage[0].data()),
+                                 cv::Mat(Height, Width, CV_8UC1, _frame_storage[1].data()));
+        _tracker.setPyramidParameters(WindowSize, MaxLevel);
+        _tracker.setTerminationCriteria(MaxIterations, EPSILON);
+        _tracker.setDetectorParameters(MaxFeatures, OpticalFlowTracking::DEFAULT_QUALITY_LEVEL,
+                                       OpticalFlowTracking::DEFAULT_MIN_DISTANCE,
+                                       OpticalFlowTracking::DEFAULT_BLOCK_SIZE);
+    }
+
+    // The tracker's frame buffers point into the member storage
+    FixedOpticalFlowTracking(const FixedOpticalFlowTracking&) = delete;
+    FixedOpticalFlowTracking& operator=(const FixedOpticalFlowTracking&) = delete;
+
+    /**
+     * @brief Number of cameras, always one
+     */
+    static constexpr int size() { return 1; }
+
+    /**
+     * @brief Access the underlying tracker
+     */
+    OpticalFlowTracking& tracker(int) { return _tracker; }
+
+    /**
+     * @brief Access the underlying tracker (read-only)
+     */
+    const OpticalFlowTracking& tracker(int) const { return _tracker; }
+
+    /**
+     * @brief Current frame buffer, backed by the fixed-size storage
+     *
+     * Ingestion into it must produce a Height x Width CV_8UC1 image so the
+     * buffer is written in place. The buffer alternates between steps.
+     */
+    cv::Mat& frame(int) { return _tracker.frameBuffer(); }
+
+    /**
+     * @brief Result of the last calculateRealVel() call
+     */
+    const OpticalFlowResult& result(int) const { return _result; }
+
+    /**
+     * @brief Error message of the last step (empty if none)
+     */
+    const std::string& error(int) const { return _error; }
+
+    /**
+     * @brief Select the corner detector
+     */
+    void setFeatureDetector(int detector,
+                            int threshold = OpticalFlowTracking::DEFAULT_FAST_THRESHOLD) {
+        _tracker.setFeatureDetector(detector, threshold);
+    }
+
+    /**
+     * @brief Set the detector parameters, the corner budget is capped at MaxFeatures
+     */
+    void setDetectorParameters(int max_corners, double quality_level,
+                               double min_distance, int block_size) {
+        _tracker.setDetectorParameters(std::min(max_corners, static_cast<int>(MaxFeatures)),
+                                       quality_level, min_distance, block_size);
+    }
+
+    /**
+     * @brief Select the velocity conversion mode
+     */
+    void setVelocityConversionMode(int mode) { _tracker.setVelocityConversionMode(mode); }
+
+    /**
+     * @brief Enable robust ego velocity aggregation
+     */
+    void setRobustAggregation(bool enabled,
+                              float threshold = RobustVelocityEstimator::DEFAULT_THRESHOLD) {
+        _tracker.setRobustAggregation(enabled, threshold);
+    }
+
+    /**
+     * @brief Reject unreliable tracks before the velocity conversion
+     */
+    void setOutlierRejection(float max_error, float max_fb_error) {
+        _tracker.setOutlierRejection(max_error, max_fb_error);
+    }
+
+    /**
+     * @brief Remove the camera rotation from the measured flow
+     */
+    void setRotationCompensation(bool enabled) { _tracker.setRotationCompensation(enabled); }
+
+    /**
+     * @brief Set the angular rate used for the next frame (rad/s)
+     */
+    void setAngularRate(const cv::Vec3f &angular_rate) { _tracker.setAngularRate(angular_rate); }
+
+    /**
+     * @brief Adapt the feature budget to a step time target (seconds)
+     */
+    void setLatencyTarget(double target) { _tracker.setLatencyTarget(target); }
+
+    /**
+     * @brief Track against a retained keyframe instead of the previous frame
+     */
+    void setKeyframeMode(bool enabled, float max_displacement) {
+        _tracker.setKeyframeMode(enabled, max_displacement);
+    }
+
+    /**
+     * @brief Skip tracking of frames shifted by less than @p max_shift pixels
+     */
+    void setEarlyOut(float max_shift) { _tracker.setEarlyOut(max_shift); }
+
+    /**
+     * @brief Track the features of @p tiles image bands concurrently
+     */
+    void setParallelTracking(int tiles) { _tracker.setParallelTracking(tiles); }
+
+    /**
+     * @brief Select the pipeline execution mode
+     */
+    void setPipelineMode(int mode) { _tracker.setPipelineMode(mode); }
+
+    /**
+     * @brief Append the warm-start state of the tracker
+     */
+    void saveState(std::vector<uint8_t> &state) { _tracker.saveState(state); }
+
+    /**
+     * @brief Restore the tracker from a snapshot written by saveState()
+     *
+     * @throws cv::Exception if the snapshot is not one valid tracker state
+     */
+    void restoreState(const uint8_t *data, size_t size) {
+        if (_tracker.restoreState(data, size) != size) {
+            CV_Error(cv::Error::StsBadSize, "Tracker state holds another number of cameras");
+        }
+    }
+
+    /**
+     * @brief Restrict the field of view to a sensor region
+     */
+    void setRegionOfInterest(cv::Size sensor_size, const cv::Rect &roi) {
+        _tracker.setRegionOfInterest(sensor_size, roi);
+    }
+
+    /**
+     * @brief Correct the feature locations for lens distortion
+     *
+     * Takes a camera index like OpticalFlowTrackingBatch, only camera 0 exists.
+     */
+    void setLensDistortion(int camera, const cv::Matx33d &camera_matrix,
+                           const std::vector<double> &dist_coeffs) {
+        (void)camera;
+        _tracker.setLensDistortion(camera_matrix, dist_coeffs);
+    }
+
+    /**
+     * @brief Update the time step between frames
+     *
+     * @param delta_t_ Time step in seconds between consecutive frames
+     */
+    void _set_delta_t_(double delta_t_) { _tracker._set_delta_t_(delta_t_); }
+
+    /**
+     * @brief Track the current frame
+     *
+     * A cv::Exception resets the result and records its message in error().
+     *
+     * @param height Height of the camera above the ground in meters
+     *
+     * @return true if the frame was processed without error
+     */
+    bool calculateRealVel(float height) {
+        _error.clear();
+        try {
+            const cv::Mat frame = _tracker.frameBuffer();
+            _tracker.calculateRealVel(frame, height, _result);
+        } catch (const cv::Exception &e) {
+            _result.reset();
+            _error = e.what();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    OpticalFlowTracking _tracker;   ///< Runtime tracker configured from the template arguments
+    std::array<std::array<uchar, PIXELS>, 2> _frame_storage; ///< Ping-pong frame pixels, row-major
+    OpticalFlowResult _result;      ///< Result with MaxFeatures capacity
+    std::string _error;             ///< Error of the last step
+};
+
+#endif // FIXED_OPTICAL_FLOW_TRACKING_HPP
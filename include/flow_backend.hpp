@@ -0,0 +1,292 @@
+/**
+ * @file flow_backend.hpp
+ * @brief Interchangeable optical flow backends used by the tracker
+ *
+ * This file defines the FlowBackend interface and its implementations:
+ * sparse pyramidal Lucas-Kanade on the CPU, DIS dense optical flow sampled
+ * at the feature locations, and sparse pyramidal Lucas-Kanade on a CUDA
+ * device when OpenCV was built with the cudaoptflow module.
+ */
+
+#ifndef FLOW_BACKEND_HPP
+#define FLOW_BACKEND_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/opencv_modules.hpp>
+#include <opencv2/video.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <vector>
+
+#ifdef HAVE_OPENCV_CUDAOPTFLOW
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudaoptflow.hpp>
+#endif
+
+/**
+ * @class FlowBackend
+ * @brief Frame-to-frame point motion estimator
+ *
+ * A backend keeps whatever per-frame state it needs (pyramids, device
+ * buffers) for the previous and current frame. The tracker drives it in a
+ * fixed order each step: prepare() the current frame, track() the features
+ * of the previous frame into it, then advance() so the current frame becomes
+ * the previous one. setReference() primes the previous frame on the first
+ * step or after a restart. In keyframe mode the tracker skips advance()
+ * while it keeps tracking from the same reference, so the previous frame
+ * state must stay valid across any number of prepare() and track() calls.
+ * Frames passed to setReference() and prepare() stay unmodified while they
+ * are the current or previous frame, so a backend may keep a reference to
+ * them instead of a copy.
+ */
+class FlowBackend {
+public:
+    virtual ~FlowBackend() = default;
+
+    /**
+     * @brief Set the search window, pyramid depth and termination criteria
+     *
+     * Cached frame state no longer matches, callers restart tracking.
+     *
+     * @param win_size Search window size in pixels
+     * @param max_level Maximum 0-based pyramid level
+     * @param criteria Termination criteria of the iterative search
+     */
+    virtual void configure(cv::Size win_size, int max_level, const cv::TermCriteria &criteria) = 0;
+
+    /**
+     * @brief Limit the work of the following steps
+     *
+     * Unlike configure(), cached frame state stays valid and tracking
+     * continues. Backends without such settings ignore the budget.
+     *
+     * @param max_level Maximum pyramid level used, at most the configured one
+     * @param max_iterations Iterations of the search, at most the configured count
+     */
+    virtual void setBudget(int max_level, int max_iterations) {
+        (void)max_level;
+        (void)max_iterations;
+    }
+
+    /**
+     * @brief Split tracking into horizontal image bands run concurrently
+     *
+     * Results must not depend on the number of bands. Backends that track
+     * on a device or densely ignore the setting.
+     *
+     * @param tiles Number of bands, 0 or 1 tracks all points in one call
+     */
+    virtual void setParallelTiles(int tiles) {
+        (void)tiles;
+    }
+
+    /**
+     * @brief Use a frame as the previous frame of the next tracking step
+     *
+     * @param gray Grayscale frame
+     */
+    virtual void setReference(const cv::Mat &gray) = 0;
+
+    /**
+     * @brief Prepare the current frame for tracking
+     *
+     * @param gray Grayscale frame
+     */
+    virtual void prepare(const cv::Mat &gray) = 0;
+
+    /**
+     * @brief Track points from the previous frame into the current frame
+     *
+     * @param prev Point locations in the previous frame
+     * @param next Output locations in the current frame (resized to prev)
+     * @param status Output per-point status, non-zero if tracked
+     * @param error Output per-point tracking error (backend specific)
+     */
+    virtual void track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+                       std::vector<uchar> &status, std::vector<float> &error) = 0;
+
+    /**
+     * @brief Track points from the current frame back into the previous frame
+     *
+     * Called after track() with its output, for the forward-backward
+     * consistency check. Reuses the state prepared for track().
+     *
+     * @param next Point locations in the current frame
+     * @param back Output locations in the previous frame (resized to next)
+     * @param status Per-point status, cleared for points lost on the way back
+     */
+    virtual void trackBack(const std::vector<cv::Point2f> &next, std::vector<cv::Point2f> &back,
+                           std::vector<uchar> &status) = 0;
+
+    /**
+     * @brief Make the current frame the previous one
+     */
+    virtual void advance() = 0;
+
+    /**
+     * @brief Check whether motion is known at every pixel
+     *
+     * Dense backends can track arbitrary points, so the tracker samples them
+     * on a regular grid instead of running a corner detector.
+     */
+    virtual bool isDense() const { return false; }
+};
+
+/**
+ * @class SparseLKBackend
+ * @brief Pyramidal Lucas-Kanade on the CPU (cv::calcOpticalFlowPyrLK)
+ *
+ * Pyramids are built once per frame with their derivatives and the current
+ * pyramid is reused as the previous one on the next step. A reduced level
+ * budget builds fewer levels for new frames, tracking uses the levels both
+ * pyramids have.
+ *
+ * With parallel tiles the points are grouped by horizontal band of the
+ * frame they start in, keeping their order within a band, and every band
+ * runs its own cv::calcOpticalFlowPyrLK call over all pyramid levels on the
+ * OpenCV thread pool. A band only touches the rows of each level around
+ * its points, so they stay in cache, and there is no synchronization
+ * between levels. Lucas-Kanade tracks every point independently, so the
+ * results, scattered back to the input order, are identical to a single
+ * call for any band or thread count.
+ */
+class SparseLKBackend : public FlowBackend {
+public:
+    /**
+     * @brief Fewest points per band, fewer points are tracked in fewer bands
+     */
+    static constexpr int MIN_TILE_POINTS = 32;
+
+    SparseLKBackend();
+
+    void configure(cv::Size win_size, int max_level, const cv::TermCriteria &criteria) override;
+    void setBudget(int max_level, int max_iterations) override;
+    void setParallelTiles(int tiles) override;
+    void setReference(const cv::Mat &gray) override;
+    void prepare(const cv::Mat &gray) override;
+    void track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+               std::vector<uchar> &status, std::vector<float> &error) override;
+    void trackBack(const std::vector<cv::Point2f> &next, std::vector<cv::Point2f> &back,
+                   std::vector<uchar> &status) override;
+    void advance() override;
+
+private:
+    /**
+     * @brief Track points between two cached pyramids, in bands if enabled
+     *
+     * @param from Pyramid the points are located in
+     * @param to Pyramid the points are tracked into
+     * @param points Point locations in @p from
+     * @param tracked Output locations in @p to (resized to points)
+     * @param status Output per-point status (resized to points)
+     * @param error Output per-point error (resized to points)
+     */
+    void trackPoints(const std::vector<cv::Mat> &from, const std::vector<cv::Mat> &to,
+                     const std::vector<cv::Point2f> &points, std::vector<cv::Point2f> &tracked,
+                     std::vector<uchar> &status, std::vector<float> &error);
+
+    cv::Size _win_size;             ///< Lucas-Kanade search window size
+    int _max_level;                 ///< Requested maximum pyramid level
+    int _level_budget;              ///< Maximum level built for new frames
+    int _prev_levels;               ///< Levels of the previous pyramid
+    int _curr_levels;               ///< Levels of the current pyramid
+    cv::TermCriteria _criteria;     ///< Configured termination criteria
+    cv::TermCriteria _budget_criteria; ///< Criteria with the iteration budget applied
+    std::vector<cv::Mat> _prev_pyramid; ///< Pyramid of the previous frame
+    std::vector<cv::Mat> _curr_pyramid; ///< Pyramid of the current frame
+    std::vector<uchar> _back_status; ///< Backward pass status (scratch)
+    std::vector<float> _back_error; ///< Backward pass error (scratch)
+    int _tiles;                     ///< Requested number of parallel bands
+    std::vector<int> _tile_start;   ///< First point of every band in the band order (scratch)
+    std::vector<int> _tile_fill;    ///< Next free slot of every band (scratch)
+    std::vector<int> _tile_order;   ///< Input index of every point in the band order (scratch)
+    std::vector<cv::Point2f> _tile_points; ///< Points in the band order (scratch)
+    std::vector<cv::Point2f> _tile_tracked; ///< Tracked points in the band order (scratch)
+    std::vector<uchar> _tile_status; ///< Status in the band order (scratch)
+    std::vector<float> _tile_error; ///< Error in the band order (scratch)
+};
+
+/**
+ * @class DenseDISBackend
+ * @brief DIS dense optical flow (cv::DISOpticalFlow) sampled at the points
+ *
+ * The flow field is computed once per frame over the whole image and read
+ * at each point with bilinear interpolation. The frames are referenced, not
+ * copied. The backward check computes a second field in the reverse
+ * direction. Points whose displaced location leaves the image are reported
+ * as lost. DIS does not expose a per-point residual, so the error output is
+ * zero.
+ */
+class DenseDISBackend : public FlowBackend {
+public:
+    DenseDISBackend();
+
+    void configure(cv::Size win_size, int max_level, const cv::TermCriteria &criteria) override;
+    void setReference(const cv::Mat &gray) override;
+    void prepare(const cv::Mat &gray) override;
+    void track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+               std::vector<uchar> &status, std::vector<float> &error) override;
+    void trackBack(const std::vector<cv::Point2f> &next, std::vector<cv::Point2f> &back,
+                   std::vector<uchar> &status) override;
+    void advance() override;
+    bool isDense() const override { return true; }
+
+private:
+    cv::Ptr<cv::DISOpticalFlow> _dis; ///< Dense inverse search instance
+    cv::Mat _prev;                  ///< Previous frame (shared with the tracker)
+    cv::Mat _curr;                  ///< Current frame (shared with the tracker)
+    cv::Mat _flow;                  ///< Dense flow field, CV_32FC2 (scratch)
+    cv::Mat _back_flow;             ///< Dense flow from the current to the previous frame (scratch)
+};
+
+#ifdef HAVE_OPENCV_CUDAOPTFLOW
+/**
+ * @class CudaSparseLKBackend
+ * @brief Pyramidal Lucas-Kanade on a CUDA device
+ *
+ * Frames stay resident on the device, the current frame becomes the
+ * previous one by swapping device buffers. Host transfers go through
+ * page-locked staging buffers on a private stream, so uploads and downloads
+ * are DMA transfers the driver does not have to copy again.
+ */
+class CudaSparseLKBackend : public FlowBackend {
+public:
+    CudaSparseLKBackend();
+
+    void configure(cv::Size win_size, int max_level, const cv::TermCriteria &criteria) override;
+    void setBudget(int max_level, int max_iterations) override;
+    void setReference(const cv::Mat &gray) override;
+    void prepare(const cv::Mat &gray) override;
+    void track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+               std::vector<uchar> &status, std::vector<float> &error) override;
+    void trackBack(const std::vector<cv::Point2f> &next, std::vector<cv::Point2f> &back,
+                   std::vector<uchar> &status) override;
+    void advance() override;
+
+private:
+    /**
+     * @brief Upload a frame through the pinned staging buffer
+     */
+    void upload(const cv::Mat &gray, cv::cuda::GpuMat &frame);
+
+    cv::Ptr<cv::cuda::SparsePyrLKOpticalFlow> _lk; ///< Device Lucas-Kanade instance
+    int _max_level;                 ///< Configured maximum pyramid level
+    int _max_iterations;            ///< Configured iteration count
+    cv::cuda::Stream _stream;       ///< Stream ordering all transfers and kernels
+    cv::cuda::HostMem _frame_staging;  ///< Pinned host copy of the uploaded frame
+    cv::cuda::HostMem _points_staging; ///< Pinned host copy of the input points
+    cv::cuda::HostMem _next_staging;   ///< Pinned host copy of the tracked points
+    cv::cuda::HostMem _status_staging; ///< Pinned host copy of the status
+    cv::cuda::HostMem _error_staging;  ///< Pinned host copy of the error
+    cv::cuda::HostMem _back_staging;   ///< Pinned host copy of the back-tracked points
+    cv::cuda::GpuMat _prev_frame;   ///< Device-resident previous frame
+    cv::cuda::GpuMat _curr_frame;   ///< Device-resident current frame
+    cv::cuda::GpuMat _prev_points;  ///< Device input points (1 x N, CV_32FC2)
+    cv::cuda::GpuMat _next_points;  ///< Device tracked points (1 x N, CV_32FC2)
+    cv::cuda::GpuMat _status;       ///< Device status (1 x N, CV_8UC1)
+    cv::cuda::GpuMat _error;        ///< Device error (1 x N, CV_32FC1)
+    cv::cuda::GpuMat _back_points;  ///< Device back-tracked points (1 x N, CV_32FC2)
+    cv::cuda::GpuMat _back_status;  ///< Device backward status (1 x N, CV_8UC1)
+};
+#endif
+
+#endif // FLOW_BACKEND_HPP
@@ -0,0 +1,127 @@
+/**
+ * @file frame_prefetcher.hpp
+ * @brief Background reader that keeps ingested frames ready for the tracker
+ *
+ * This file defines the FramePrefetcher class, which reads a FrameSource on
+ * a dedicated thread and queues the ingested frames in a bounded ring of
+ * preallocated images.
+ */
+
+#ifndef FRAME_PREFETCHER_HPP
+#define FRAME_PREFETCHER_HPP
+
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "frame_source.hpp"
+#include "image_ingestion.hpp"
+
+/**
+ * @class FramePrefetcher
+ * @brief Decodes and ingests frames ahead of the simulation step
+ *
+ * The worker thread reads a frame, applies the region of interest and
+ * decimation of the ingestion stage and stores the result in a free slot,
+ * so decoding and file or device I/O overlap with tracking. Slots are
+ * allocated once at construction.
+ *
+ * When the queue is full the worker waits for recorded sources, so every
+ * frame of a replay is processed, and drops the oldest queued frame for live
+ * sources, so the tracker always sees the most recent one.
+ */
+class FramePrefetcher {
+public:
+    /**
+     * @brief Maximum number of frames queued ahead of the consumer
+     */
+    static constexpr int QUEUE_CAPACITY = 4;
+
+    /**
+     * @brief Number of frame slots, the queued frames plus the one being copied out
+     */
+    static constexpr int NUM_SLOTS = QUEUE_CAPACITY + 1;
+
+    /**
+     * @brief Arena budget of one prefetcher (see MatArenaAllocator::acquire())
+     *
+     * Covers the queued frames and the decoded color and grayscale frames,
+     * doubled for the power-of-two rounding of the arena.
+     *
+     * @param sensor_size Size of the frames delivered by the source
+     * @param frame_size Size of the ingested frames
+     * @return Bytes to reserve
+     */
+    static size_t frameBudget(cv::Size sensor_size, cv::Size frame_size) {
+        return 2 * (static_cast<size_t>(NUM_SLOTS) * frame_size.area() +
+                    4 * static_cast<size_t>(sensor_size.area()));
+    }
+
+    /**
+     * @brief Constructor, starts the worker thread
+     *
+     * @param source Opened frame source, owned by the prefetcher
+     * @param ingestion Region of interest and decimation applied to every frame
+     */
+    FramePrefetcher(std::unique_ptr<FrameSource> source, const ImageIngestion &ingestion);
+
+    /**
+     * @brief Destructor, stops and joins the worker thread
+     */
+    ~FramePrefetcher();
+
+    FramePrefetcher(const FramePrefetcher&) = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+    /**
+     * @brief Copy the oldest queued frame into @p dst
+     *
+     * Blocks until a frame is available or the source has ended.
+     *
+     * @param dst Destination, (re)allocated as the ingestion output size CV_8UC1
+     * @return false once the source has ended or failed and the queue is empty
+     */
+    bool pop(cv::Mat &dst);
+
+    /**
+     * @brief Reason the source ended, empty at a regular end of stream
+     *
+     * Valid after pop() returned false.
+     */
+    const std::string& error() const { return _error; }
+
+    /**
+     * @brief Number of frames of a live source dropped because the queue was full
+     */
+    uint64_t dropped() const;
+
+private:
+    /**
+     * @brief Worker thread main loop
+     */
+    void run();
+
+    std::unique_ptr<FrameSource> _source; ///< Frame source, only used by the worker
+    ImageIngestion _ingestion;      ///< Crop and decimation of the source frames
+    bool _live;                     ///< Drop stale frames instead of waiting
+    cv::Mat _slots[NUM_SLOTS];      ///< Preallocated ingested frames
+    mutable std::mutex _mutex;      ///< Protects the slot lists and flags
+    std::condition_variable _frame_cv; ///< Signals a queued frame or the end of the source
+    std::condition_variable _slot_cv; ///< Signals a free slot or shutdown
+    int _ready[NUM_SLOTS];          ///< Ring of queued slot indices, oldest first
+    int _ready_head;                ///< Position of the oldest queued slot
+    int _ready_count;               ///< Number of queued slots
+    int _free[NUM_SLOTS];           ///< Stack of free slot indices
+    int _free_count;                ///< Number of free slots
+    uint64_t _dropped;              ///< Frames dropped for live sources
+    std::string _error;             ///< Message of the exception that ended the source
+    bool _finished;                 ///< Source ended, no more frames will be queued
+    bool _stop;                     ///< Set by the destructor to end the worker
+    std::thread _thread;            ///< Worker thread (started last)
+};
+
+#endif // FRAME_PREFETCHER_HPP
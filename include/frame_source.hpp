@@ -0,0 +1,154 @@
+/**
+ * @file frame_source.hpp
+ * @brief Frame sources read directly by the S-function instead of an input port
+ *
+ * This file defines the FrameSource interface and its implementations: any
+ * stream cv::VideoCapture can open (video files, network streams, camera
+ * indices and V4L2 devices), and raw 8-bit frame files that are memory-mapped
+ * instead of read.
+ */
+
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @class FrameSource
+ * @brief Sequential reader of grayscale frames of a fixed size
+ *
+ * Sources are created from a specification string by open():
+ * - "raw:<path>": file of consecutive row-major 8-bit frames, memory-mapped
+ * - "v4l2:<device>": V4L2 device path or index through the OpenCV V4L2 backend
+ * - "<index>": camera index through the default OpenCV backend
+ * - anything else: file name or URL opened with cv::VideoCapture
+ *
+ * read() is called from a single thread, normally the FramePrefetcher
+ * worker.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @brief Open the source described by a specification string
+     *
+     * Throws cv::Exception if the source cannot be opened or its frames do
+     * not have the requested size.
+     *
+     * @param spec Source specification (see class description)
+     * @param frame_size Size of the frames the source must deliver
+     * @return Opened source
+     */
+    static std::unique_ptr<FrameSource> open(const std::string &spec, cv::Size frame_size);
+
+    /**
+     * @brief Read the next frame
+     *
+     * The returned image may reference memory owned by the source, it stays
+     * valid until the next read() call. Throws cv::Exception if a frame has
+     * the wrong size.
+     *
+     * @param frame Output CV_8UC1 frame of the requested size
+     * @return false at the end of the stream
+     */
+    virtual bool read(cv::Mat &frame) = 0;
+
+    /**
+     * @brief Check whether frames arrive in real time
+     *
+     * Live sources keep producing frames whether or not they are consumed,
+     * so stale frames are dropped rather than queued.
+     */
+    virtual bool isLive() const { return false; }
+};
+
+/**
+ * @class VideoCaptureSource
+ * @brief Frames from cv::VideoCapture, converted to grayscale
+ */
+class VideoCaptureSource : public FrameSource {
+public:
+    /**
+     * @brief Open a file name or URL
+     *
+     * @param path File name or URL
+     * @param api OpenCV capture backend (cv::CAP_ANY to let OpenCV choose)
+     * @param frame_size Required frame size
+     */
+    VideoCaptureSource(const std::string &path, int api, cv::Size frame_size);
+
+    /**
+     * @brief Open a camera device
+     *
+     * The device is asked for @p frame_size, frames of another size are
+     * rejected by read().
+     *
+     * @param index Device index
+     * @param api OpenCV capture backend (cv::CAP_ANY or cv::CAP_V4L2)
+     * @param frame_size Required frame size
+     */
+    VideoCaptureSource(int index, int api, cv::Size frame_size);
+
+    bool read(cv::Mat &frame) override;
+    bool isLive() const override { return _live; }
+
+private:
+    cv::VideoCapture _capture;      ///< Capture stream
+    cv::Size _frame_size;           ///< Required frame size
+    bool _live;                     ///< Camera device rather than a recording
+    cv::Mat _decoded;               ///< Last decoded frame, possibly in color
+    cv::Mat _gray;                  ///< Grayscale conversion of _decoded
+};
+
+/**
+ * @class RawFileSource
+ * @brief Memory-mapped file of consecutive row-major 8-bit frames
+ *
+ * The file holds height * width bytes per frame without any header, a
+ * partial frame at its end is ignored. Frames are returned as headers on
+ * the mapping, so reading one copies nothing; the kernel is told to read
+ * the file ahead sequentially.
+ */
+class RawFileSource : public FrameSource {
+public:
+    /**
+     * @brief Map a raw frame file
+     *
+     * @param path File name
+     * @param frame_size Size of the stored frames
+     */
+    RawFileSource(const std::string &path, cv::Size frame_size);
+
+    ~RawFileSource() override;
+
+    RawFileSource(const RawFileSource&) = delete;
+    RawFileSource& operator=(const RawFileSource&) = delete;
+
+    bool read(cv::Mat &frame) override;
+
+    /**
+     * @brief Number of whole frames in the file
+     */
+    size_t frameCount() const { return _frame_count; }
+
+private:
+    cv::Size _frame_size;           ///< Size of the stored frames
+    size_t _frame_bytes;            ///< Bytes per frame
+    size_t _frame_count;            ///< Whole frames in the file
+    size_t _next;                   ///< Index of the next frame to read
+    uchar* _data;                   ///< Start of the mapping
+    size_t _mapped_bytes;           ///< Length of the mapping
+#ifdef _WIN32
+    void* _file;                    ///< File handle
+    void* _mapping;                 ///< File mapping handle
+#else
+    int _fd;                        ///< File descriptor
+#endif
+};
+
+#endif // FRAME_SOURCE_HPP
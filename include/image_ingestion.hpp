@@ -0,0 +1,136 @@
+/**
+ * @file image_ingestion.hpp
+ * @brief Conversion of Simulink image signals into OpenCV matrices
+ *
+ * This file defines the ImageIngestion class which converts column-major
+ * Simulink image buffers into row-major CV_8UC1 matrices suitable for the
+ * optical flow tracker.
+ */
+
+#ifndef IMAGE_INGESTION_HPP
+#define IMAGE_INGESTION_HPP
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+
+/**
+ * @class ImageIngestion
+ * @brief Converts contiguous column-major frames to row-major 8-bit images
+ *
+ * Simulink stores matrices in column-major order while OpenCV expects
+ * row-major images. The conversion is performed in square tiles so that both
+ * the source columns and the destination rows of a tile stay resident in the
+ * L1 cache. Scaling, clamping and narrowing to 8 bits is vectorized with
+ * AVX2, SSE4.1 or NEON when the compiler targets them, with a scalar fallback
+ * otherwise.
+ *
+ * Optionally only a region of interest of the source frame is converted,
+ * and that region can be decimated by an integer factor with area averaging
+ * (box filter) fused into the same tiled pass, so the cost scales with the
+ * pixels actually used rather than with the sensor size.
+ *
+ * Supported source types:
+ * - double: normalized 0-1, scaled to 0-255 and clamped
+ * - single: normalized 0-1, scaled to 0-255 and clamped
+ * - uint8: already 0-255, transposed without conversion
+ * - cv::Mat: row-major CV_8UC1, only cropped and decimated
+ */
+class ImageIngestion {
+public:
+    /**
+     * @brief Edge length of the square tiles used for the transpose (pixels)
+     */
+    static constexpr int TILE_SIZE = 64;
+
+    /**
+     * @brief Constructor for ImageIngestion
+     *
+     * @param height Image height in pixels (rows of the Simulink matrix)
+     * @param width Image width in pixels (columns of the Simulink matrix)
+     */
+    ImageIngestion(int height, int width);
+
+    /**
+     * @brief Constructor for a region of interest with optional decimation
+     *
+     * The output has roi.height / decimation rows and roi.width / decimation
+     * columns; source pixels that do not fill a whole decimation block are
+     * dropped. Throws cv::Exception if the region is empty or not inside the
+     * source frame, or if the decimation factor is not positive.
+     *
+     * @param height Image height in pixels (rows of the Simulink matrix)
+     * @param width Image width in pixels (columns of the Simulink matrix)
+     * @param roi Region of the source frame to convert (0-based pixels)
+     * @param decimation Integer downsampling factor (1 = native resolution)
+     */
+    ImageIngestion(int height, int width, const cv::Rect& roi, int decimation);
+
+    /**
+     * @brief Convert a normalized double-precision frame
+     *
+     * @param src Contiguous column-major source buffer (height * width values)
+     * @param dst Destination image, (re)allocated as outputSize() CV_8UC1
+     */
+    void ingest(const double* src, cv::Mat& dst) const;
+
+    /**
+     * @brief Convert a normalized single-precision frame
+     *
+     * @param src Contiguous column-major source buffer (height * width values)
+     * @param dst Destination image, (re)allocated as outputSize() CV_8UC1
+     */
+    void ingest(const float* src, cv::Mat& dst) const;
+
+    /**
+     * @brief Transpose an 8-bit frame without any value conversion
+     *
+     * @param src Contiguous column-major source buffer (height * width values)
+     * @param dst Destination image, (re)allocated as outputSize() CV_8UC1
+     */
+    void ingest(const uint8_t* src, cv::Mat& dst) const;
+
+    /**
+     * @brief Convert a row-major 8-bit frame, such as one read by a FrameSource
+     *
+     * Applies the same region of interest and decimation as the column-major
+     * overloads and produces identical pixels.
+     *
+     * @param src Row-major height x width CV_8UC1 image
+     * @param dst Destination image, (re)allocated as outputSize() CV_8UC1
+     */
+    void ingest(const cv::Mat& src, cv::Mat& dst) const;
+
+    /**
+     * @brief Get the configured image height in pixels
+     */
+    int height() const { return _height; }
+
+    /**
+     * @brief Get the configured image width in pixels
+     */
+    int width() const { return _width; }
+
+    /**
+     * @brief Get the converted region of the source frame
+     */
+    const cv::Rect& roi() const { return _roi; }
+
+    /**
+     * @brief Get the decimation factor applied to the region
+     */
+    int decimation() const { return _decimation; }
+
+    /**
+     * @brief Get the size of the converted frames
+     */
+    cv::Size outputSize() const { return _output_size; }
+
+private:
+    int _height;                    ///< Source image height in pixels
+    int _width;                     ///< Source image width in pixels
+    cv::Rect _roi;                  ///< Converted region of the source frame
+    int _decimation;                ///< Integer downsampling factor
+    cv::Size _output_size;          ///< Size of the converted frames
+};
+
+#endif // IMAGE_INGESTION_HPP
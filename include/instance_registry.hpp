@@ -0,0 +1,87 @@
+/**
+ * @file instance_registry.hpp
+ * @brief Fixed-capacity registry of per-block state for static memory mode
+ *
+ * This file defines the InstanceRegistry class template which hands out one
+ * preallocated slot per S-Function instance ID.
+ */
+
+#ifndef INSTANCE_REGISTRY_HPP
+#define INSTANCE_REGISTRY_HPP
+
+#include <atomic>
+
+/**
+ * @class InstanceRegistry
+ * @brief Lock-free slot table indexed by instance ID
+ *
+ * Each slot carries an atomic lifecycle state. acquire() claims a free slot
+ * with a single compare-and-swap and hands the caller exclusive ownership of
+ * its value; release() resets the value and frees the slot. Blocks resolve
+ * their slot once at start-up and use the returned pointer directly
+ * afterwards, so steady-state steps perform no lookups, no reference
+ * counting and no locking, and blocks stepping on different threads never
+ * touch shared data. Slots are cache-line aligned to avoid false sharing.
+ *
+ * @tparam T Per-instance value type, default constructible and move assignable
+ * @tparam Capacity Number of slots, valid instance IDs are 0 to Capacity - 1
+ */
+template <typename T, int Capacity>
+class InstanceRegistry {
+public:
+    /**
+     * @brief Number of slots in the registry
+     */
+    static constexpr int CAPACITY = Capacity;
+
+    /**
+     * @brief Claim the slot of an instance ID
+     *
+     * @param id Instance ID
+     * @return Pointer to the slot value, or nullptr if the ID is out of
+     *         range or already in use by another block
+     */
+    T* acquire(int id) {
+        if (id < 0 || id >= Capacity) {
+            return nullptr;
+        }
+        int expected = SLOT_FREE;
+        if (!_slots[id].state.compare_exchange_strong(expected, SLOT_ACTIVE,
+                                                      std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &_slots[id].value;
+    }
+
+    /**
+     * @brief Reset the value of a claimed slot and make it available again
+     *
+     * @param id Instance ID previously returned by a successful acquire()
+     */
+    void release(int id) {
+        if (id < 0 || id >= Capacity ||
+            _slots[id].state.load(std::memory_order_relaxed) != SLOT_ACTIVE) {
+            return;
+        }
+
+        // Clean up while the slot is still owned, then publish it as free
+        _slots[id].value = T();
+        _slots[id].state.store(SLOT_FREE, std::memory_order_release);
+    }
+
+private:
+    static constexpr int SLOT_FREE = 0;   ///< Slot available for acquire()
+    static constexpr int SLOT_ACTIVE = 1; ///< Slot owned by a block
+
+    /**
+     * @brief One registry entry on its own cache line
+     */
+    struct alignas(64) Slot {
+        std::atomic<int> state{SLOT_FREE}; ///< Lifecycle state
+        T value;                    ///< Per-instance value
+    };
+
+    Slot _slots[Capacity];          ///< Slot table indexed by instance ID
+};
+
+#endif // INSTANCE_REGISTRY_HPP
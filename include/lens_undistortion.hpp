@@ -0,0 +1,129 @@
+/**
+ * @file lens_undistortion.hpp
+ * @brief Lens distortion correction of tracked feature locations
+ *
+ * This file defines the LensUndistortion class, which maps distorted pixel
+ * locations to undistorted bearings through a precomputed grid instead of
+ * remapping whole frames.
+ */
+
+#ifndef LENS_UNDISTORTION_HPP
+#define LENS_UNDISTORTION_HPP
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * @class LensUndistortion
+ * @brief Grid of undistorted bearings with bilinear lookup
+ *
+ * The lens is described by an OpenCV camera matrix and distortion
+ * coefficients for the full sensor. configure() undistorts one grid node
+ * every GRID_STEP pixels of the processed frames (after region of interest
+ * and decimation) with cv::undistortPoints and stores the column and row
+ * bearings, atan(x) and atan(y) of the undistorted normalized coordinates,
+ * interleaved per node. A lookup then reads two adjacent node pairs of two
+ * grid rows and interpolates them bilinearly, so the per-feature cost is a
+ * few multiplications and no iterative undistortion or trigonometry.
+ *
+ * With a 4 pixel step and a strong wide-angle lens (k1 = -0.3 at a 90
+ * degree field of view) the interpolated bearing differences of 1-3 pixel
+ * displacements are within 0.2% of the exact values on average. The grid of
+ * a 640 x 480 frame takes about 150 KB.
+ */
+class LensUndistortion {
+public:
+    /**
+     * @brief Spacing of the grid nodes in processed frame pixels
+     */
+    static constexpr int GRID_STEP = 4;
+
+    /**
+     * @brief Constructor, no lens model is set
+     */
+    LensUndistortion();
+
+    /**
+     * @brief Set the lens model
+     *
+     * The grid is rebuilt by the next configure() call.
+     *
+     * @param camera_matrix Camera matrix of the full sensor (pixels, 0-based
+     *        principal point)
+     * @param dist_coeffs Distortion coefficients in OpenCV order
+     *        (k1, k2, p1, p2[, k3[, k4, k5, k6[, s1, s2, s3, s4[, tx, ty]]]])
+     */
+    void setModel(const cv::Matx33d &camera_matrix, const std::vector<double> &dist_coeffs);
+
+    /**
+     * @brief Remove the lens model and release the grid
+     */
+    void clear();
+
+    /**
+     * @brief Check whether a lens model is set
+     */
+    bool enabled() const { return _enabled; }
+
+    /**
+     * @brief Build the grid for the frames currently processed
+     *
+     * Does nothing if the model and the geometry are unchanged since the
+     * last call.
+     *
+     * @param sensor_size Full sensor resolution in pixels
+     * @param roi Region of the sensor covered by the frames (pixels)
+     * @param frame_size Size of the processed frames
+     */
+    void configure(cv::Size sensor_size, const cv::Rect &roi, cv::Size frame_size);
+
+    /**
+     * @brief Check whether the grid is built and lookups are valid
+     */
+    bool ready() const { return !_grid.empty(); }
+
+    /**
+     * @brief Undistorted bearings of a frame location
+     *
+     * Locations past the frame border are extrapolated from the outermost
+     * grid cells.
+     *
+     * @param p Distorted location in processed frame pixels
+     * @param col Bearing along the columns, growing with x (radians)
+     * @param row Bearing along the rows, growing with y (radians)
+     */
+    void bearings(const cv::Point2f &p, float &col, float &row) const {
+        const float gx = p.x * _inv_step;
+        const float gy = p.y * _inv_step;
+        const int ix = std::min(std::max(static_cast<int>(std::floor(gx)), 0), _cols - 2);
+        const int iy = std::min(std::max(static_cast<int>(std::floor(gy)), 0), _rows - 2);
+        const float fx = gx - static_cast<float>(ix);
+        const float fy = gy - static_cast<float>(iy);
+
+        const float* top = &_grid[2 * (static_cast<size_t>(iy) * _cols + ix)];
+        const float* bottom = top + 2 * _cols;
+        const float col_top = top[0] + fx * (top[2] - top[0]);
+        const float col_bottom = bottom[0] + fx * (bottom[2] - bottom[0]);
+        const float row_top = top[1] + fx * (top[3] - top[1]);
+        const float row_bottom = bottom[1] + fx * (bottom[3] - bottom[1]);
+        col = col_top + fy * (col_bottom - col_top);
+        row = row_top + fy * (row_bottom - row_top);
+    }
+
+private:
+    bool _enabled;                  ///< A lens model is set
+    bool _dirty;                    ///< Model changed since the grid was built
+    cv::Matx33d _camera_matrix;     ///< Camera matrix of the full sensor
+    std::vector<double> _dist_coeffs; ///< Distortion coefficients
+    cv::Size _sensor_size;          ///< Sensor size the grid was built for
+    cv::Rect _roi;                  ///< Region of interest the grid was built for
+    cv::Size _frame_size;           ///< Frame size the grid was built for
+    int _cols;                      ///< Grid nodes per row
+    int _rows;                      ///< Grid rows
+    float _inv_step;                ///< 1 / GRID_STEP
+    std::vector<float> _grid;       ///< Interleaved [col, row] bearings, row-major nodes
+};
+
+#endif // LENS_UNDISTORTION_HPP
@@ -0,0 +1,221 @@
+/**
+ * @file mat_arena_allocator.hpp
+ * @brief Pooled cv::Mat allocator backed by memory reserved at start-up
+ *
+ * This file defines the MatArenaAllocator class, which serves the buffers of
+ * every cv::Mat, including the temporaries OpenCV creates inside
+ * calcOpticalFlowPyrLK, goodFeaturesToTrack and the other kernels, from a
+ * preallocated arena so steady-state frames do not reach the system heap.
+ */
+
+#ifndef MAT_ARENA_ALLOCATOR_HPP
+#define MAT_ARENA_ALLOCATOR_HPP
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @class MatArenaAllocator
+ * @brief Size-class pool installed as the OpenCV default Mat allocator
+ *
+ * Requests are rounded up to a power-of-two size class. A block is taken
+ * from the free list of its class, carved from the reserved arena, or as a
+ * last resort obtained from the system heap; released blocks always return
+ * to their free list. Once every class a frame needs has been populated,
+ * which happens during the first frames, a step makes no system allocation.
+ * systemAllocations() counts the fallbacks so this can be verified.
+ *
+ * OpenCV has a single, process-wide default allocator, so there is one
+ * arena per module, shared by all blocks and threads. Each user reserves
+ * its budget with acquire() and gives it back with release(); the allocator
+ * is the default between the first acquire() and the last release(). Mats
+ * allocated from the arena may outlive that interval, they still return
+ * their memory to it.
+ *
+ * Cameras, LK bands, prefetch threads and the trace writer allocate
+ * concurrently, so small blocks (up to MAX_CACHED_BYTES, the UMatData
+ * records, feature and status vectors) go through a free list per thread
+ * and size class that takes no lock. A thread cache holds at most
+ * CACHE_BYTES_PER_CLASS per class, a full cache hands half of it back to
+ * the shared lists and an empty one refills from them. Larger blocks, a
+ * few per frame next to image-sized kernels, use the shared lists under
+ * the mutex. Blocks cached by a thread that exits are not reclaimed
+ * before the arena is returned to the system.
+ */
+class MatArenaAllocator : public cv::MatAllocator {
+public:
+    /**
+     * @brief Arena budget per processed pixel and tracker (bytes)
+     *
+     * Covers both cached pyramids with derivatives, the detector response
+     * and dilation images, the frame buffers and the power-of-two rounding.
+     */
+    static constexpr size_t SCRATCH_BYTES_PER_PIXEL = 96;
+
+    /**
+     * @brief Access the allocator of this module
+     */
+    static MatArenaAllocator& instance();
+
+    /**
+     * @brief Arena budget of one tracker
+     *
+     * @param frame_size Size of the frames the tracker processes
+     * @return Bytes to pass to acquire()
+     */
+    static size_t frameBudget(cv::Size frame_size) {
+        return static_cast<size_t>(frame_size.area()) * SCRATCH_BYTES_PER_PIXEL;
+    }
+
+    /**
+     * @brief Reserve arena memory and make this the default Mat allocator
+     *
+     * The arena grows so it holds the budgets of all current users; new
+     * memory is written once so its pages are resident before the first
+     * frame.
+     *
+     * @param bytes Budget of the caller (see frameBudget())
+     */
+    void acquire(size_t bytes);
+
+    /**
+     * @brief Give back a reservation made with acquire()
+     *
+     * The last user restores the previous default allocator. The arena is
+     * returned to the system if no Mat still uses it.
+     */
+    void release();
+
+    /**
+     * @brief Number of blocks obtained from the system heap since start-up
+     *
+     * The arena itself is not counted, only requests it could not serve.
+     */
+    uint64_t systemAllocations() const { return _system_allocations.load(); }
+
+    /**
+     * @brief Bytes of memory currently owned by the allocator
+     */
+    size_t capacity() const;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag access_flags,
+                  cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    MatArenaAllocator();
+    ~MatArenaAllocator() override;
+    MatArenaAllocator(const MatArenaAllocator&) = delete;
+    MatArenaAllocator& operator=(const MatArenaAllocator&) = delete;
+
+    /**
+     * @brief Header in front of every block, keeps the payload 64-byte aligned
+     */
+    struct Block {
+        Block* next;                ///< Next free block of the same class
+        int size_class;             ///< Size class index
+    };
+
+    /**
+     * @brief Header in front of every piece of system memory, links them for release
+     */
+    struct Chunk {
+        Chunk* next;                ///< Previously obtained chunk
+    };
+
+    static constexpr size_t BLOCK_HEADER_BYTES = 64;   ///< Bytes reserved for the header
+    static constexpr size_t CHUNK_HEADER_BYTES = 64;   ///< Bytes reserved for the chunk link
+    static constexpr size_t MIN_BLOCK_BYTES = 64;      ///< Payload of size class 0
+    static constexpr int NUM_SIZE_CLASSES = 40;        ///< Payloads up to 32 TiB
+    static constexpr int NUM_CACHED_CLASSES = 9;       ///< Classes served by the thread caches
+    static constexpr size_t MAX_CACHED_BYTES = MIN_BLOCK_BYTES << (NUM_CACHED_CLASSES - 1); ///< 16 KiB
+    static constexpr size_t CACHE_BYTES_PER_CLASS = 64 * 1024; ///< Payload a thread keeps per class
+
+    /**
+     * @brief Free blocks of the small size classes owned by one thread
+     *
+     * Trivially destructible, so it can be thread_local without running
+     * code from this module when a thread exits.
+     */
+    struct ThreadCache {
+        Block* free[NUM_CACHED_CLASSES]; ///< Free list per size class
+        int count[NUM_CACHED_CLASSES]; ///< Blocks in each list
+        uint64_t generation;        ///< Arena generation the blocks belong to
+    };
+
+    /**
+     * @brief Cache of the calling thread
+     */
+    static ThreadCache& threadCache();
+
+    /**
+     * @brief Size class of a request of @p bytes
+     */
+    static int sizeClass(size_t bytes);
+
+    /**
+     * @brief Blocks a thread cache keeps of a size class
+     */
+    static int cacheLimit(int size_class) {
+        return static_cast<int>(CACHE_BYTES_PER_CLASS / (MIN_BLOCK_BYTES << size_class));
+    }
+
+    /**
+     * @brief Take a block of at least @p bytes
+     */
+    void* take(size_t bytes) const;
+
+    /**
+     * @brief Return a block obtained from take()
+     */
+    void give(void* payload) const;
+
+    /**
+     * @brief Take a block from the shared lists or the arena (caller holds the mutex)
+     */
+    Block* takeShared(int size_class) const;
+
+    /**
+     * @brief Drop a cache filled before the arena was last released (caller holds the mutex)
+     */
+    void syncCache(ThreadCache& cache) const;
+
+    /**
+     * @brief Obtain @p bytes from the system heap (caller holds the mutex)
+     *
+     * @return First usable byte, behind the chunk link
+     */
+    uchar* obtain(size_t bytes) const;
+
+    /**
+     * @brief Add a chunk of @p bytes to the arena (caller holds the mutex)
+     */
+    void grow(size_t bytes);
+
+    /**
+     * @brief Return all memory to the system (caller holds the mutex, no live blocks)
+     *
+     * Invalidates the thread caches, no other thread may allocate meanwhile.
+     */
+    void releaseMemory();
+
+    mutable std::mutex _mutex;      ///< Guards all state below except the atomics
+    mutable Block* _free[NUM_SIZE_CLASSES]; ///< Shared free list per size class
+    mutable Chunk* _chunks;         ///< Memory obtained from the system, most recent first
+    mutable uchar* _cursor;         ///< Next unused byte of the current chunk
+    mutable uchar* _end;            ///< End of the current chunk
+    mutable size_t _capacity;       ///< Bytes obtained from the system
+    mutable std::atomic<size_t> _live; ///< Blocks currently handed out
+    mutable std::atomic<uint64_t> _system_allocations; ///< Requests served by the system heap
+    std::atomic<uint64_t> _generation; ///< Incremented whenever the memory is released
+    size_t _reserved;               ///< Sum of the budgets of current users
+    int _users;                     ///< Number of outstanding acquire() calls
+    cv::MatAllocator* _previous;    ///< Default allocator before the first acquire()
+};
+
+#endif // MAT_ARENA_ALLOCATOR_HPP
@@ -0,0 +1,154 @@
+/**
+ * @file optical_flow_codegen.h
+ * @brief C interface of the tracker for code generated from the Simulink block
+ *
+ * This file declares the functions s_function.tlc emits calls to, so
+ * generated code steps the trackers directly instead of going through the
+ * SimStruct interface of the S-function. The header is valid C and C++.
+ */
+
+#ifndef OPTICAL_FLOW_CODEGEN_H
+#define OPTICAL_FLOW_CODEGEN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Image element types accepted by optical_flow_codegen_step()
+ */
+#define OPTICAL_FLOW_CODEGEN_IMAGE_DOUBLE 0  /**< double, normalized 0-1 */
+#define OPTICAL_FLOW_CODEGEN_IMAGE_SINGLE 1  /**< single, normalized 0-1 */
+#define OPTICAL_FLOW_CODEGEN_IMAGE_UINT8 2   /**< uint8, 0-255 */
+
+/**
+ * @brief Block configuration, mirrors the S-function parameters
+ *
+ * Camera parameters point to num_cameras values each. The region of interest
+ * is given as a 0-based rectangle {x, y, width, height}.
+ */
+typedef struct OpticalFlowCodegenConfig {
+    int height;                     /**< Image height (pixels) */
+    int width;                      /**< Image width (pixels) */
+    int num_cameras;                /**< Camera planes per image */
+    const double* focal_length;     /**< Focal length per camera (meters) */
+    const double* cmos_height;      /**< Sensor height per camera (meters) */
+    const double* cmos_width;       /**< Sensor width per camera (meters) */
+    int roi[4];                     /**< Region of interest {x, y, width, height} */
+    int decimation;                 /**< Area-averaging decimation factor */
+    int feature_procedure;          /**< Feature maintenance procedure */
+    int lk_window_size;             /**< Lucas-Kanade window (pixels) */
+    int lk_max_level;               /**< Lucas-Kanade maximum pyramid level */
+    int conversion_mode;            /**< Velocity conversion mode */
+    double inlier_threshold;        /**< Ego velocity inlier threshold */
+    int pipeline_mode;              /**< Pipeline mode */
+    int method;                     /**< Optical flow method */
+    int detector;                   /**< Corner detector */
+    int max_corners;                /**< Maximum number of corners */
+    double quality_level;           /**< Shi-Tomasi quality level */
+    double min_distance;            /**< Minimum distance between corners (pixels) */
+    int block_size;                 /**< Shi-Tomasi block size (pixels) */
+    int detector_threshold;         /**< FAST/AGAST intensity threshold */
+    double max_track_error;         /**< Maximum Lucas-Kanade error, 0 = no limit */
+    double max_fb_error;            /**< Maximum forward-backward error, 0 = no check */
+    double height_above_ground;     /**< Camera height above ground (meters) */
+    int rate_input;                 /**< Nonzero to compensate the angular rate */
+    const double* lens_intrinsics;  /**< 0-based {fx, fy, cx, cy} per camera (pixels), NULL = no lens model */
+    const double* lens_distortion;  /**< num_distortion OpenCV coefficients per camera */
+    int num_distortion;             /**< Distortion coefficients per camera */
+    double latency_target;          /**< Step time target (seconds), 0 = fixed budget */
+    double keyframe_displacement;   /**< Keyframe promotion displacement (pixels), 0 = frame to frame */
+    double early_out;               /**< Largest shift of a skipped frame (pixels), 0 = disabled */
+    int tracking_tiles;             /**< Parallel tracking bands, 0 = one call */
+    int feature_single;             /**< Nonzero writes float instead of double velocities */
+} OpticalFlowCodegenConfig;
+
+/**
+ * @brief Bytes of block state storage the caller must provide
+ *
+ * The S-function reserves this many bytes as its first DWork vector. The
+ * storage needs no particular alignment.
+ */
+size_t optical_flow_codegen_storage_size(void);
+
+/**
+ * @brief Create the trackers in caller-provided storage
+ *
+ * The block object is constructed in place, with the fixed-size tracker
+ * the storage also holds the tracker and its frame buffers. OpenCV's
+ * working memory is served from the Mat arena acquired here.
+ *
+ * The storage does not cover every allocation: the per-camera trackers of
+ * the variable-size batch, the flow backends, the feature and result
+ * vectors, the error strings and the worker thread of the pipelined modes
+ * are still allocated from the heap, once, by this call. Steps reuse them.
+ *
+ * A storage smaller than optical_flow_codegen_storage_size(), as left by
+ * an S-function built with other options, fails with an error message.
+ *
+ * @param storage Storage of optical_flow_codegen_storage_size() bytes
+ * @param storage_bytes Size of the storage in bytes
+ * @param config Block configuration
+ * @return 0 on success, otherwise see optical_flow_codegen_error()
+ */
+int optical_flow_codegen_init(void* storage, size_t storage_bytes,
+                              const OpticalFlowCodegenConfig* config);
+
+/**
+ * @brief Process one image and write the block outputs
+ *
+ * Output layouts match the S-function ports, one column (or page) per
+ * camera. An OpenCV error on one camera zeroes that camera's outputs, the
+ * step still succeeds and optical_flow_codegen_error() holds the message.
+ *
+ * @param storage Storage passed to optical_flow_codegen_init()
+ * @param image Column-major image, height x width x num_cameras
+ * @param image_type One of the OPTICAL_FLOW_CODEGEN_IMAGE_* values
+ * @param delta_t Time since the previous image (seconds)
+ * @param height Height above ground (meters), or NULL for the configured
+ *               value. Non-positive values also fall back to it
+ * @param angular_rate Angular rate {wx, wy, wz} (rad/s), only read when the
+ *                     configuration enables rate_input
+ * @param velocities 2 x 1000 x num_cameras velocities, double or float as
+ *                   configured by feature_single, or NULL to skip them
+ * @param feature_columns Receives the columns per camera written to
+ *                        velocities, the most valid features of any camera,
+ *                        or NULL for the fixed 2 x 1000 pages
+ * @param stage_timing Per-stage timing, 7 x num_cameras (seconds)
+ * @param num_features Valid features per camera
+ * @param ego_velocity Robust ego velocity, 4 x num_cameras
+ * @param heap_allocations Heap allocations made by OpenCV during the step
+ * @param feature_budget Corners, pyramid levels and iterations of the step,
+ *                       3 x num_cameras
+ * @return 0 on success, nonzero if the trackers were not initialized
+ */
+int optical_flow_codegen_step(void* storage, const void* image, int image_type, double delta_t,
+                              const double* height, const double* angular_rate,
+                              void* velocities, int* feature_columns,
+                              double* stage_timing, double* num_features,
+                              double* ego_velocity, double* heap_allocations,
+                              double* feature_budget);
+
+/**
+ * @brief Last error message, empty if none occurred
+ *
+ * @param storage Storage passed to optical_flow_codegen_init()
+ */
+const char* optical_flow_codegen_error(void* storage);
+
+/**
+ * @brief Destroy the trackers and release the Mat arena
+ *
+ * Safe to call after a failed optical_flow_codegen_init().
+ *
+ * @param storage Storage passed to optical_flow_codegen_init()
+ */
+void optical_flow_codegen_terminate(void* storage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OPTICAL_FLOW_CODEGEN_H */
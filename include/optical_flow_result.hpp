@@ -0,0 +1,85 @@
+/**
+ * @file optical_flow_result.hpp
+ * @brief Preallocated per-frame result of the optical flow tracker
+ *
+ * This file defines the OpticalFlowResult structure shared by the tracker and
+ * its conversion kernels.
+ */
+
+#ifndef OPTICAL_FLOW_RESULT_HPP
+#define OPTICAL_FLOW_RESULT_HPP
+
+#include <vector>
+
+/**
+ * @struct OpticalFlowResult
+ * @brief Caller-owned, preallocated per-frame tracking result
+ *
+ * Results are stored as structure-of-arrays with a fixed capacity so that the
+ * tracker can fill them without any heap allocation. Only the first @c count
+ * entries of each array are valid after a call to calculateRealVel().
+ */
+struct OpticalFlowResult {
+    /**
+     * @brief Constructor allocating all arrays once
+     *
+     * @param capacity Maximum number of features the result can hold
+     */
+    explicit OpticalFlowResult(int capacity = 1000)
+        : capacity(capacity),
+          count(0),
+          success(false),
+          skipped(false),
+          keyframe(false),
+          vel_x(capacity),
+          vel_y(capacity),
+          prev_x(capacity),
+          prev_y(capacity),
+          curr_x(capacity),
+          curr_y(capacity),
+          ego_vel_x(0.0f),
+          ego_vel_y(0.0f),
+          inlier_count(0),
+          residual(0.0f),
+          budget_corners(0),
+          budget_levels(0),
+          budget_iterations(0) {}
+
+    /**
+     * @brief Mark the result as empty without releasing any memory
+     */
+    void reset() {
+        count = 0;
+        success = false;
+        skipped = false;
+        keyframe = false;
+        ego_vel_x = 0.0f;
+        ego_vel_y = 0.0f;
+        inlier_count = 0;
+        residual = 0.0f;
+        budget_corners = 0;
+        budget_levels = 0;
+        budget_iterations = 0;
+    }
+
+    int capacity;                   ///< Allocated length of every array
+    int count;                      ///< Number of valid entries
+    bool success;                   ///< True when the frame was processed
+    bool skipped;                   ///< Tracking skipped by the low-motion early-out
+    bool keyframe;                  ///< The frame became the new tracking reference
+    std::vector<float> vel_x;       ///< Estimated velocity in X direction (m/s)
+    std::vector<float> vel_y;       ///< Estimated velocity in Y direction (m/s)
+    std::vector<float> prev_x;      ///< Feature X location in the previous frame (pixels)
+    std::vector<float> prev_y;      ///< Feature Y location in the previous frame (pixels)
+    std::vector<float> curr_x;      ///< Feature X location in the current frame (pixels)
+    std::vector<float> curr_y;      ///< Feature Y location in the current frame (pixels)
+    float ego_vel_x;                ///< Robust aggregate velocity in X direction (m/s)
+    float ego_vel_y;                ///< Robust aggregate velocity in Y direction (m/s)
+    int inlier_count;               ///< Features agreeing with the aggregate velocity
+    float residual;                 ///< RMS inlier deviation from the aggregate (m/s)
+    int budget_corners;             ///< Corner budget the frame was processed with
+    int budget_levels;              ///< Maximum pyramid level the frame was tracked with
+    int budget_iterations;          ///< Lucas-Kanade iterations the frame was tracked with
+};
+
+#endif // OPTICAL_FLOW_RESULT_HPP
@@ -0,0 +1,231 @@
+/**
+ * @file optical_flow_tracking_batch.hpp
+ * @brief Batched optical flow velocity estimation for multi-camera rigs
+ *
+ * This file defines the OpticalFlowTrackingBatch class which steps one
+ * OpticalFlowTracking instance per camera in parallel.
+ */
+
+#ifndef OPTICAL_FLOW_TRACKING_BATCH_HPP
+#define OPTICAL_FLOW_TRACKING_BATCH_HPP
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "optical_flow_velocity.hpp"
+
+/**
+ * @struct CameraIntrinsics
+ * @brief Physical parameters of one camera of the rig
+ */
+struct CameraIntrinsics {
+    float focal_length;             ///< Camera focal length (meters)
+    float cmos_width;               ///< Sensor physical width (meters)
+    float cmos_height;              ///< Sensor physical height (meters)
+};
+
+/**
+ * @class OpticalFlowTrackingBatch
+ * @brief Steps N independent camera trackers in parallel
+ *
+ * All cameras share the frame size and time step. The ingested frames live
+ * in one contiguous arena (the two ping-pong planes of every tracker,
+ * 2 * N stacked planes) and the results in one
+ * preallocated array, so a batch step only touches memory allocated at
+ * construction. calculateRealVel() distributes the cameras over the OpenCV
+ * thread pool; a failure in one camera is reported for that camera only.
+ */
+class OpticalFlowTrackingBatch {
+public:
+    /**
+     * @brief Constructor for OpticalFlowTrackingBatch
+     *
+     * @param method Optical flow method (see OpticalFlowTracking)
+     * @param delta_t Initial time step between frames in seconds
+     * @param cameras Intrinsics of every camera, one tracker is created per entry
+     * @param frame_height Frame height in pixels, common to all cameras
+     * @param frame_width Frame width in pixels, common to all cameras
+     * @param result_capacity Maximum number of features reported per camera
+     * @param feature_procedure Feature maintenance procedure for all trackers
+     */
+    OpticalFlowTrackingBatch(int method, float delta_t,
+                             const std::vector<CameraIntrinsics> &cameras,
+                             int frame_height, int frame_width,
+                             int result_capacity = OpticalFlowTracking::DEFAULT_MAX_CORNERS,
+                             int feature_procedure =
+                                 OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC);
+
+    /**
+     * @brief Number of cameras in the batch
+     */
+    int size() const { return static_cast<int>(_trackers.size()); }
+
+    /**
+     * @brief Access the tracker of one camera
+     */
+    OpticalFlowTracking& tracker(int camera) { return *_trackers[camera]; }
+
+    /**
+     * @brief Access the tracker of one camera (read-only)
+     */
+    const OpticalFlowTracking& tracker(int camera) const { return *_trackers[camera]; }
+
+    /**
+     * @brief Frame buffer of one camera, the tracker's current arena plane
+     *
+     * Fill it (e.g. with ImageIngestion) before calling calculateRealVel(),
+     * the tracker then reads the frame in place. The plane alternates
+     * between steps, fetch it again for every frame.
+     */
+    cv::Mat& frame(int camera) { return _trackers[camera]->frameBuffer(); }
+
+    /**
+     * @brief Result of one camera from the last calculateRealVel() call
+     */
+    const OpticalFlowResult& result(int camera) const { return _results[camera]; }
+
+    /**
+     * @brief Error message of one camera from the last step (empty if none)
+     */
+    const std::string& error(int camera) const { return _errors[camera]; }
+
+    /**
+     * @brief Configure the Lucas-Kanade window and pyramid depth of all cameras
+     */
+    void setPyramidParameters(int window_size, int max_level);
+
+    /**
+     * @brief Select the corner detector of all cameras
+     */
+    void setFeatureDetector(int detector,
+                            int threshold = OpticalFlowTracking::DEFAULT_FAST_THRESHOLD);
+
+    /**
+     * @brief Set the corner budget and detector parameters of all cameras
+     */
+    void setDetectorParameters(int max_corners, double quality_level,
+                               double min_distance, int block_size);
+
+    /**
+     * @brief Select the velocity conversion mode of all cameras
+     */
+    void setVelocityConversionMode(int mode);
+
+    /**
+     * @brief Enable robust ego velocity aggregation on all cameras
+     */
+    void setRobustAggregation(bool enabled,
+                              float threshold = RobustVelocityEstimator::DEFAULT_THRESHOLD);
+
+    /**
+     * @brief Set the outlier rejection thresholds of all cameras
+     */
+    void setOutlierRejection(float max_error, float max_fb_error);
+
+    /**
+     * @brief Enable or disable rotation compensation of all cameras
+     */
+    void setRotationCompensation(bool enabled);
+
+    /**
+     * @brief Set the angular rate used by all cameras for the next frame
+     *
+     * @param angular_rate Rates about X (forward), Y (left) and Z (up) in rad/s
+     */
+    void setAngularRate(const cv::Vec3f &angular_rate);
+
+    /**
+     * @brief Set the step time target of the feature budget of all cameras
+     *
+     * @param target Step time to stay under (seconds), 0 disables the controller
+     */
+    void setLatencyTarget(double target);
+
+    /**
+     * @brief Track all cameras against retained keyframes
+     *
+     * @param enabled true to track against keyframes
+     * @param max_displacement Mean displacement that promotes a new keyframe (pixels)
+     */
+    void setKeyframeMode(bool enabled, float max_displacement);
+
+    /**
+     * @brief Skip tracking of frames that barely moved on all cameras
+     *
+     * @param max_shift Largest shift skipped (pixels), 0 disables the early-out
+     */
+    void setEarlyOut(float max_shift);
+
+    /**
+     * @brief Track the features of every camera in concurrent image bands
+     *
+     * @param tiles Number of bands, 0 or 1 tracks all features in one call
+     */
+    void setParallelTracking(int tiles);
+
+    /**
+     * @brief Select the pipeline execution mode of all cameras
+     */
+    void setPipelineMode(int mode);
+
+    /**
+     * @brief Append the warm-start state of every camera, in camera order
+     *
+     * @param state Buffer the snapshots are appended to
+     */
+    void saveState(std::vector<uint8_t> &state);
+
+    /**
+     * @brief Restore every camera from snapshots written by saveState()
+     *
+     * @param data Snapshot bytes
+     * @param size Size of the snapshots in bytes
+     * @throws cv::Exception if the data is not one valid state per camera
+     */
+    void restoreState(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Restrict the field of view of all cameras to a sensor region
+     */
+    void setRegionOfInterest(cv::Size sensor_size, const cv::Rect &roi);
+
+    /**
+     * @brief Set the lens model of one camera
+     *
+     * @param camera Camera index
+     * @param camera_matrix Camera matrix of the full sensor (pixels), a zero
+     *        focal length removes the lens model
+     * @param dist_coeffs Distortion coefficients in OpenCV order
+     */
+    void setLensDistortion(int camera, const cv::Matx33d &camera_matrix,
+                           const std::vector<double> &dist_coeffs);
+
+    /**
+     * @brief Update the time step between frames of all cameras
+     *
+     * @param delta_t_ Time step in seconds between consecutive frames
+     */
+    void _set_delta_t_(double delta_t_);
+
+    /**
+     * @brief Track every camera's current frame in parallel
+     *
+     * Reads frame(i) and writes result(i) for every camera. A cv::Exception
+     * raised by one camera resets its result and records its message in
+     * error(i); the other cameras are unaffected.
+     *
+     * @param height Height of the cameras above the ground in meters
+     *
+     * @return true if every camera was processed without error
+     */
+    bool calculateRealVel(float height);
+
+private:
+    std::vector<std::unique_ptr<OpticalFlowTracking>> _trackers; ///< One tracker per camera
+    cv::Mat _arena;                 ///< Stacked frame planes, (2 * N * height) x width CV_8UC1
+    std::vector<OpticalFlowResult> _results; ///< Preallocated per-camera results
+    std::vector<std::string> _errors; ///< Per-camera error of the last step
+};
+
+#endif // OPTICAL_FLOW_TRACKING_BATCH_HPP
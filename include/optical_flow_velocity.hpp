@@ -11,9 +11,19 @@
 
 #include <opencv2/video.hpp>
 #include <opencv2/video/tracking.hpp>
+#include <opencv2/features2d.hpp>
 #include <cmath>
 #include <vector>
 #include <tuple>
+#include <cstdint>
+#include <memory>
+#include "optical_flow_result.hpp"
+#include "velocity_conversion.hpp"
+#include "robust_velocity_estimator.hpp"
+#include "pipeline_worker.hpp"
+#include "flow_backend.hpp"
+#include "stage_profiler.hpp"
+#include "budget_controller.hpp"
 
 /**
  * @class OpticalFlowTracking
@@ -35,32 +45,520 @@ public:
 
     /**
      * @brief Feature extraction performed once at initialization
+     *
+     * Tracked features are carried forward between frames and only
+     * re-extracted when every feature has been lost.
      */
     static constexpr int FEATURE_EXTRACTION_PROCEDURE_ONCE = 2;
 
+    /**
+     * @brief Incremental feature maintenance on a spatial grid
+     *
+     * Tracked features are carried forward between frames and new features
+     * are only detected, through a mask, in grid cells whose feature count
+     * dropped below the configured threshold.
+     */
+    static constexpr int FEATURE_EXTRACTION_PROCEDURE_INCREMENTAL = 3;
+
+    /**
+     * @brief Default number of grid columns for incremental maintenance
+     */
+    static constexpr int DEFAULT_FEATURE_GRID_COLS = 8;
+
+    /**
+     * @brief Default number of grid rows for incremental maintenance
+     */
+    static constexpr int DEFAULT_FEATURE_GRID_ROWS = 6;
+
+    /**
+     * @brief Default minimum number of features per grid cell
+     */
+    static constexpr int DEFAULT_MIN_FEATURES_PER_CELL = 8;
+
     /**
      * @brief Use Lucas-Kanade pyramidal optical flow method
      */
     static constexpr int OPTICAL_FLOW_LUCAS_KANADE = 100;
 
+    /**
+     * @brief Use DIS dense optical flow sampled on a regular grid
+     *
+     * Motion is computed for every pixel, so features are placed on a grid
+     * instead of being detected as corners.
+     */
+    static constexpr int OPTICAL_FLOW_DIS_DENSE = 101;
+
+    /**
+     * @brief Use Lucas-Kanade pyramidal optical flow on a CUDA device
+     *
+     * Only available when OpenCV was built with the cudaoptflow module and a
+     * CUDA device is present.
+     */
+    static constexpr int OPTICAL_FLOW_LUCAS_KANADE_CUDA = 102;
+
     /**
      * @brief Use OpenCV's simple feature extraction (goodFeaturesToTrack)
      */
     static constexpr int FEATURE_EXTRACTION_OPENCV_SIMPLE = 1000;
 
+    /**
+     * @brief Use FAST corners with grid bucketing
+     *
+     * Corners are ranked by their response and at most an equal share of
+     * the corner budget is kept per cell of the feature grid, which spreads
+     * the features uniformly over the image.
+     */
+    static constexpr int FEATURE_EXTRACTION_FAST_GRID = 1001;
+
+    /**
+     * @brief Use AGAST corners with grid bucketing
+     */
+    static constexpr int FEATURE_EXTRACTION_AGAST_GRID = 1002;
+
+    /**
+     * @brief Default maximum number of tracked features
+     *
+     * Also the capacity of all per-frame buffers, detector budgets are
+     * limited to it.
+     */
+    static constexpr int DEFAULT_MAX_CORNERS = 1000;
+
+    /**
+     * @brief Default Shi-Tomasi quality level (fraction of the best corner response)
+     */
+    static constexpr double DEFAULT_QUALITY_LEVEL = 0.1;
+
+    /**
+     * @brief Default minimum distance between detected corners (pixels)
+     */
+    static constexpr double DEFAULT_MIN_DISTANCE = 8.0;
+
+    /**
+     * @brief Default Shi-Tomasi derivative covariation block size (pixels)
+     */
+    static constexpr int DEFAULT_BLOCK_SIZE = 2;
+
+    /**
+     * @brief Default FAST/AGAST intensity threshold (8-bit gray levels)
+     */
+    static constexpr int DEFAULT_FAST_THRESHOLD = 20;
+
+    /**
+     * @brief Default Lucas-Kanade search window size (pixels, square)
+     */
+    static constexpr int DEFAULT_LK_WINDOW_SIZE = 16;
+
+    /**
+     * @brief Default maximum pyramid level (0-based) for Lucas-Kanade
+     */
+    static constexpr int DEFAULT_LK_MAX_LEVEL = 2;
+
+    /**
+     * @brief Default Lucas-Kanade iterations per pyramid level
+     */
+    static constexpr int DEFAULT_LK_MAX_ITERATIONS = 8;
+
+    /**
+     * @brief Default Lucas-Kanade iteration stop threshold (pixels)
+     */
+    static constexpr double DEFAULT_LK_EPSILON = 0.03;
+
+    /**
+     * @brief Process every frame completely on the calling thread
+     */
+    static constexpr int PIPELINE_SYNCHRONOUS = 0;
+
+    /**
+     * @brief Overlap feature re-detection with the caller, no added latency
+     *
+     * After a frame is tracked and its velocities returned, re-detection of
+     * the next feature set runs on a worker thread. The next call builds its
+     * pyramid concurrently and only waits for detection right before
+     * tracking, so outputs are identical to PIPELINE_SYNCHRONOUS.
+     */
+    static constexpr int PIPELINE_OVERLAP_DETECTION = 1;
+
+    /**
+     * @brief Process frames entirely on a worker thread, one frame of latency
+     *
+     * Each call copies the frame into a ring slot, queues it and returns the
+     * result of the previously submitted frame, so tracking of frame N runs
+     * while the caller handles frame N - 1.
+     */
+    static constexpr int PIPELINE_DEFERRED = 2;
+
+    /**
+     * @brief Number of frame slots in the deferred pipeline ring
+     *
+     * One slot is being filled by the caller, one is queued or processing and
+     * one holds the result being returned.
+     */
+    static constexpr int PIPELINE_RING_SIZE = 3;
+
+    /**
+     * @brief Smallest corner budget the latency controller reduces to
+     */
+    static constexpr int BUDGET_MIN_CORNERS = 50;
+
+    /**
+     * @brief Fewest Lucas-Kanade iterations the latency controller reduces to
+     */
+    static constexpr int BUDGET_MIN_ITERATIONS = 3;
+
+    /**
+     * @brief Default mean feature displacement that promotes a new keyframe (pixels)
+     */
+    static constexpr float DEFAULT_KEYFRAME_DISPLACEMENT = 8.0f;
+
+    /**
+     * @brief Default fraction of the keyframe features below which a new keyframe is promoted
+     */
+    static constexpr float DEFAULT_KEYFRAME_SURVIVAL = 0.7f;
+
+    /**
+     * @brief Decimation of the frames compared by the low-motion early-out
+     */
+    static constexpr int EARLY_OUT_DECIMATION = 4;
+
+    /**
+     * @brief Frames skipped in a row at most by the low-motion early-out
+     */
+    static constexpr int EARLY_OUT_MAX_SKIPPED = 8;
+
+    /**
+     * @brief Minimum phase correlation peak response for a frame to be skipped
+     */
+    static constexpr double EARLY_OUT_MIN_RESPONSE = 0.2;
+
     /**
      * @brief Constructor for OpticalFlowTracking
      *
-     * @param method Optical flow method to use (currently only OPTICAL_FLOW_LUCAS_KANADE supported)
+     * @param method Optical flow method, one of the OPTICAL_FLOW_* constants
      * @param delta_t Initial time step between frames in seconds
      * @param camera_focal_length Camera focal length in meters
      * @param cmos_width Physical width of the camera sensor in meters
      * @param cmos_height Physical height of the camera sensor in meters
+     * @param feature_procedure Feature maintenance procedure, one of the
+     *        FEATURE_EXTRACTION_PROCEDURE_* constants (default: dynamic)
      *
      * @note Field of view is automatically calculated from camera parameters
+     * @throws cv::Exception if @p method is not available (see isMethodAvailable())
      */
     OpticalFlowTracking(int method, float delta_t, float camera_focal_length,
-                       float cmos_width, float cmos_height);
+                       float cmos_width, float cmos_height,
+                       int feature_procedure = FEATURE_EXTRACTION_PROCEDURE_DYNAMIC);
+
+    /**
+     * @brief Check whether an optical flow method can be used in this build
+     *
+     * @param method One of the OPTICAL_FLOW_* constants
+     * @return true if the backend is compiled in and, for CUDA, a device is present
+     */
+    static bool isMethodAvailable(int method);
+
+    /**
+     * @brief Configure the grid used by incremental feature maintenance
+     *
+     * @param cols Number of grid columns
+     * @param rows Number of grid rows
+     * @param min_features_per_cell Cells holding fewer tracked features than
+     *        this are re-detected on the next frame
+     */
+    void setFeatureGrid(int cols, int rows, int min_features_per_cell);
+
+    /**
+     * @brief Select the corner detector used for feature (re-)detection
+     *
+     * FAST and AGAST bucket their corners on the feature grid configured
+     * with setFeatureGrid().
+     *
+     * @param detector FEATURE_EXTRACTION_OPENCV_SIMPLE (Shi-Tomasi, default),
+     *        FEATURE_EXTRACTION_FAST_GRID or FEATURE_EXTRACTION_AGAST_GRID
+     * @param threshold FAST/AGAST intensity threshold (ignored by Shi-Tomasi)
+     */
+    void setFeatureDetector(int detector, int threshold = DEFAULT_FAST_THRESHOLD);
+
+    /**
+     * @brief Set the corner budget and detector parameters
+     *
+     * @param max_corners Maximum number of tracked features, at most DEFAULT_MAX_CORNERS
+     * @param quality_level Shi-Tomasi quality level relative to the best corner
+     * @param min_distance Minimum distance between corners (pixels), also
+     *        the exclusion radius around tracked features in incremental mode
+     * @param block_size Shi-Tomasi derivative covariation block size (pixels)
+     */
+    void setDetectorParameters(int max_corners, double quality_level,
+                               double min_distance, int block_size);
+
+    /**
+     * @brief Get the current corner detector
+     */
+    int featureDetector() const { return _detector; }
+
+    /**
+     * @brief Configure the Lucas-Kanade window and pyramid depth
+     *
+     * The cached image pyramids are built with the same window size and
+     * level count, so changing them invalidates the cached previous pyramid
+     * and tracking restarts on the next frame.
+     *
+     * @param window_size Search window edge length in pixels
+     * @param max_level Maximum 0-based pyramid level
+     */
+    void setPyramidParameters(int window_size, int max_level);
+
+    /**
+     * @brief Set the termination criteria of the iterative flow search
+     *
+     * @param max_iterations Maximum number of iterations per pyramid level
+     * @param epsilon Stop once the update is smaller than this (pixels)
+     */
+    void setTerminationCriteria(int max_iterations, double epsilon);
+
+    /**
+     * @brief Select how pixel displacements are converted to velocities
+     *
+     * @param mode VelocityConversion::MODE_FAST (vectorized, default) or
+     *        VelocityConversion::MODE_EXACT (bit-identical to std::tan reference)
+     */
+    void setVelocityConversionMode(int mode);
+
+    /**
+     * @brief Enable robust aggregation of the per-feature velocities
+     *
+     * When enabled, every processed frame also fills the ego velocity,
+     * inlier count and residual of the result using a median/MAD inlier
+     * filter over a translation model.
+     *
+     * @param enabled true to compute the aggregate each frame
+     * @param threshold Inlier threshold in robust standard deviations
+     */
+    void setRobustAggregation(bool enabled,
+                              float threshold = RobustVelocityEstimator::DEFAULT_THRESHOLD);
+
+    /**
+     * @brief Reject unreliable tracks before the velocity conversion
+     *
+     * Both tests run inside the fused conversion pass, rejected features are
+     * neither reported nor carried to the next frame. The forward-backward
+     * check tracks every feature back into the previous frame with the
+     * cached pyramids and drops it if it does not return close to where it
+     * started, at the cost of a second tracking pass. The DIS backend
+     * reports no tracking error, only the forward-backward check applies.
+     *
+     * @param max_error Maximum Lucas-Kanade error (mean absolute intensity
+     *        difference in the window, gray levels), 0 disables the test
+     * @param max_fb_error Maximum forward-backward distance (pixels), 0 disables the check
+     */
+    void setOutlierRejection(float max_error, float max_fb_error);
+
+    /**
+     * @brief Remove the camera rotation from the measured flow
+     *
+     * When enabled, every step subtracts the flow induced by the angular
+     * rate last passed to setAngularRate() inside the velocity conversion
+     * (see VelocityConversion), using cached per-pixel bearing tables.
+     *
+     * @param enabled true to compensate the rotation
+     */
+    void setRotationCompensation(bool enabled);
+
+    /**
+     * @brief Update the camera angular rate used for the next frame
+     *
+     * Like _set_delta_t_(), the value is captured when the frame is
+     * submitted, so it is safe to call in every pipeline mode.
+     *
+     * @param angular_rate Rates about X (forward), Y (left) and Z (up) in rad/s
+     */
+    void setAngularRate(const cv::Vec3f &angular_rate);
+
+    /**
+     * @brief Track against a retained keyframe instead of the previous frame
+     *
+     * The frame features were detected on stays the tracking reference, with
+     * its pyramid, and every new frame is tracked from it. Velocities are
+     * still the motion since the previous processed frame. Only when the
+     * mean feature displacement from the keyframe exceeds @p max_displacement,
+     * or fewer than @p min_survival of its features remain, does the current
+     * frame become the new keyframe and features are re-detected according
+     * to the feature procedure. At low speed this removes the re-detection
+     * from most frames and tracking does not accumulate frame-to-frame
+     * drift. Tracking restarts on the next frame.
+     *
+     * @param enabled true to track against keyframes
+     * @param max_displacement Mean displacement that promotes a new keyframe (pixels)
+     * @param min_survival Fraction of the keyframe features that must remain tracked
+     */
+    void setKeyframeMode(bool enabled,
+                         float max_displacement = DEFAULT_KEYFRAME_DISPLACEMENT,
+                         float min_survival = DEFAULT_KEYFRAME_SURVIVAL);
+
+    /**
+     * @brief Skip tracking of frames that barely moved
+     *
+     * Every frame is decimated by EARLY_OUT_DECIMATION and phase correlated
+     * (cv::phaseCorrelate) with the last processed frame. If the global
+     * shift is below @p max_shift with a clear correlation peak, pyramid,
+     * tracking, conversion and detection are skipped: the result is marked
+     * skipped, reports no features and its ego velocity is converted from
+     * the global shift. The next processed frame measures the motion over
+     * all skipped frames, at most EARLY_OUT_MAX_SKIPPED in a row.
+     *
+     * @param max_shift Largest shift skipped (full-resolution pixels), 0 disables the early-out
+     */
+    void setEarlyOut(float max_shift);
+
+    /**
+     * @brief Track the features of horizontal image bands concurrently
+     *
+     * The CPU Lucas-Kanade backend groups the features by the band they
+     * start in and tracks every band on the OpenCV thread pool with its own
+     * call over all pyramid levels (see SparseLKBackend). Outputs are
+     * identical to tracking in one call. When several cameras are already
+     * stepped in parallel, OpenCV runs the nested bands sequentially. Other
+     * backends ignore the setting.
+     *
+     * @param tiles Number of bands, 0 or 1 tracks all features in one call
+     */
+    void setParallelTracking(int tiles);
+
+    /**
+     * @brief Select the execution mode of the frame pipeline
+     *
+     * Outstanding work is completed before switching. Pending deferred
+     * results are discarded and the worker thread is started or stopped as
+     * needed.
+     *
+     * @param mode One of the PIPELINE_* constants
+     */
+    void setPipelineMode(int mode);
+
+    /**
+     * @brief Append the state a warm start needs to a byte buffer
+     *
+     * Queued work is completed first. The snapshot holds the reference
+     * frame, the tracked features, the keyframe features and the time of
+     * frames skipped by the early-out, about one byte per pixel plus eight
+     * per feature. Pyramids are not stored, restoreState() rebuilds them
+     * from the reference frame. The feature budget restarts at full effort.
+     *
+     * @param state Buffer the snapshot is appended to
+     */
+    void saveState(std::vector<uint8_t> &state);
+
+    /**
+     * @brief Continue tracking from a snapshot written by saveState()
+     *
+     * The next frame is tracked against the restored reference instead of
+     * starting over with a detection. In PIPELINE_DEFERRED mode the result
+     * pending when the snapshot was taken is not part of it, the first call
+     * after a restore reports no features.
+     *
+     * @param data Snapshot bytes
+     * @param size Bytes available at @p data
+     * @return Bytes of @p data the snapshot occupied
+     * @throws cv::Exception if the snapshot is malformed, was taken at another
+     *         frame size, holds a keyframe while keyframe mode is disabled,
+     *         more than DEFAULT_MAX_CORNERS features, features outside the
+     *         frame or more than EARLY_OUT_MAX_SKIPPED skipped frames
+     */
+    size_t restoreState(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Restrict the field of view to a region of the sensor
+     *
+     * Frames passed to calculateRealVel() then cover only @p roi of the
+     * sensor, possibly decimated. The field of view is recomputed from the
+     * part of the sensor the region spans, so the angle per pixel follows
+     * the frames actually processed. Tracking restarts on the next frame.
+     *
+     * @param sensor_size Full sensor resolution in pixels
+     * @param roi Region of the sensor covered by the frames (pixels)
+     * @throws cv::Exception if @p sensor_size is not positive or @p roi is
+     *         empty or not inside the sensor
+     */
+    void setRegionOfInterest(cv::Size sensor_size, const cv::Rect &roi);
+
+    /**
+     * @brief Correct the feature locations for lens distortion
+     *
+     * Instead of undistorting whole frames, the velocity conversion maps
+     * the tracked locations to undistorted bearings through a grid built
+     * once per geometry (see LensUndistortion), and the field of view
+     * derived from the focal length and sensor size is no longer used. The
+     * camera matrix refers to the full sensor, the region of interest and
+     * decimation of setRegionOfInterest() are accounted for. Tracking
+     * restarts on the next frame.
+     *
+     * @param camera_matrix Camera matrix of the full sensor (pixels, 0-based
+     *        principal point), a zero focal length removes the lens model
+     * @param dist_coeffs Distortion coefficients in OpenCV order
+     */
+    void setLensDistortion(const cv::Matx33d &camera_matrix, const std::vector<double> &dist_coeffs);
+
+    /**
+     * @brief Use caller-owned storage for the ping-pong frame pair
+     *
+     * The tracker alternates between two grayscale buffers: one holds the
+     * previous frame, the other receives the current one, and they swap
+     * roles after every step instead of being copied. By default both are
+     * allocated on the first frame; this places them in external memory such
+     * as a shared arena. Tracking restarts on the next frame.
+     *
+     * @param first First buffer (CV_8UC1)
+     * @param second Second buffer (CV_8UC1, same size as @p first, not overlapping)
+     */
+    void setFrameBuffers(const cv::Mat &first, const cv::Mat &second);
+
+    /**
+     * @brief Buffer the next calculateRealVel() call reads its frame from
+     *
+     * Writing the grayscale frame into this buffer (e.g. with
+     * ImageIngestion) and passing it to calculateRealVel() skips the copy
+     * into the tracker. The returned buffer changes after every step, so
+     * fetch it again for each frame. In PIPELINE_DEFERRED mode it is the next
+     * ring slot, the worker still copies it once when the step runs.
+     *
+     * @return Current frame buffer, empty until the first frame or setFrameBuffers()
+     */
+    cv::Mat& frameBuffer();
+
+    /**
+     * @brief Get the current pipeline execution mode
+     */
+    int pipelineMode() const { return _pipeline_mode; }
+
+    /**
+     * @brief Access the per-stage latency profiler
+     *
+     * The tracker records pyramid, tracking, conversion, detection and
+     * aggregation times when built with OPTICAL_FLOW_PROFILING. Callers may
+     * record their own stages (ingestion, total) into the same instance.
+     */
+    StageProfiler& profiler() { return _profiler; }
+
+    /**
+     * @brief Access the per-stage latency profiler (read-only)
+     */
+    const StageProfiler& profiler() const { return _profiler; }
+
+    /**
+     * @brief Adapt the per-frame work to a step time target
+     *
+     * Before every frame the step time last recorded in the profiler's
+     * STAGE_TOTAL (by the S-function, the generated code or the benchmark)
+     * is fed to a BudgetController, which scales the corner budget, the
+     * pyramid depth and the Lucas-Kanade iterations between the configured
+     * values and BUDGET_MIN_CORNERS, level 1 and BUDGET_MIN_ITERATIONS.
+     * Budget changes do not restart tracking; a smaller corner budget only
+     * takes effect when features are detected. Each result reports the
+     * budget its frame was processed with. Changing the detector or
+     * pyramid settings restarts the controller at full effort.
+     *
+     * @param target Step time to stay under (seconds), 0 disables the controller
+     */
+    void setLatencyTarget(double target);
 
     /**
      * @brief Update the time step between frames
@@ -75,6 +573,8 @@ public:
     /**
      * @brief Check if features are currently being tracked
      *
+     * Queued detection and deferred steps are completed first.
+     *
      * @return true if features have been extracted and are available, false otherwise
      */
     bool _has_features();
@@ -88,6 +588,8 @@ public:
      * @param img Input image (grayscale or BGR)
      *
      * @note If the image has 3 channels, it will be converted to grayscale
+     * @note The frame is stored in the current buffer of the ping-pong pair,
+     *       without a copy if @p img already is frameBuffer()
      * @note Previous features are cleared when this method is called
      */
     void extractFeatures(const cv::Mat &img);
@@ -105,38 +607,269 @@ public:
      * @return Tuple containing:
      *         - v_est_x: Vector of estimated velocities in X direction (m/s)
      *         - v_est_y: Vector of estimated velocities in Y direction (m/s)
-     *         - new_features: Tracked feature locations in current frame
-     *         - old_features: Feature locations in previous frame
+     *         - new_features: Current frame locations of the features in
+     *           v_est_x / v_est_y, the same length in every pipeline mode
+     *         - old_features: Previous frame locations of the same features
      *         - success: Boolean indicating successful processing
      *
      * @note Returns empty vectors on first call (no previous frame available)
-     * @note Features are re-extracted after each calculation
+     * @note Features are re-extracted or replenished after each calculation
+     *       according to the configured feature procedure
      */
     std::tuple<std::vector<float>, std::vector<float>,
                std::vector<cv::Point2f>, std::vector<cv::Point2f>, bool>
     calculateRealVel(const cv::Mat &img, float height);
 
+    /**
+     * @brief Calculate real-world velocity into a preallocated result
+     *
+     * Allocation-free variant of calculateRealVel(): all scratch memory is
+     * owned by the tracker and reused, and results are written into the
+     * caller-owned structure. At most @c result.capacity features are reported.
+     *
+     * @param img Current grayscale image frame
+     * @param height Height of the camera above the ground in meters
+     * @param result Preallocated result written in place
+     *
+     * @return true if the frame was processed (count is 0 on the first frame)
+     *
+     * @note In PIPELINE_DEFERRED mode the result belongs to the frame passed
+     *       on the previous call, and count is also 0 on the second call
+     * @throws cv::Exception from the tracking step, in deferred mode raised
+     *         by the call that collects the failed frame
+     */
+    bool calculateRealVel(const cv::Mat &img, float height, OpticalFlowResult &result);
+
 private:
+    /**
+     * @brief Frame slot of the deferred pipeline ring
+     */
+    struct FrameSlot {
+        cv::Mat frame;              ///< Private copy of the submitted frame
+        float height = 0.0f;        ///< Height above ground for this frame (meters)
+        float delta_t = 0.0f;       ///< Time step captured at submission (seconds)
+        cv::Vec3f angular_rate;     ///< Angular rate captured at submission, used if compensating
+        uint64_t ticket = 0;        ///< Worker ticket of the processing task
+        OpticalFlowResult result{DEFAULT_MAX_CORNERS}; ///< Result written by the worker
+    };
+
+    /**
+     * @brief Run one complete tracking step
+     *
+     * Shared by all pipeline modes. In PIPELINE_OVERLAP_DETECTION mode the
+     * feature replenishment is queued on the worker instead of run inline.
+     *
+     * @param img Current image frame
+     * @param height Height of the camera above the ground in meters
+     * @param delta_t Time step since the previous frame in seconds
+     * @param angular_rate Camera angular rate over the frame (rad/s)
+     * @param result Preallocated result written in place
+     */
+    bool step(const cv::Mat &img, float height, float delta_t, const cv::Vec3f &angular_rate,
+              OpticalFlowResult &result);
+
+    /**
+     * @brief Queue a frame on the worker and collect the previous result
+     */
+    bool stepDeferred(const cv::Mat &img, float height, OpticalFlowResult &result);
+
+    /**
+     * @brief Store a frame in the current ping-pong buffer, converting it to grayscale
+     *
+     * @param img Grayscale or BGR frame, nothing is copied if it already is the buffer
+     */
+    void storeFrame(const cv::Mat &img);
+
+    /**
+     * @brief Make _last_im the tracking reference and configure the conversion for it
+     */
+    void adoptReference();
+
+    /**
+     * @brief Wait for a feature replenishment queued on the worker, if any
+     */
+    void finishDetection();
+
+    /**
+     * @brief Complete all queued work before changing the tracker state
+     */
+    void drainPipeline();
+
+    /**
+     * @brief Compute the field of view of the used part of the sensor
+     */
+    void updateFieldOfView();
+
+    /**
+     * @brief Detect Shi-Tomasi corners in an image
+     *
+     * With a dense backend the points are instead placed on a regular grid
+     * covering the unmasked area, spaced so at most @p max_corners fit.
+     * FAST and AGAST corners are bucketed with bucketKeypoints().
+     *
+     * @param gray Grayscale image to search
+     * @param corners Output corner locations
+     * @param max_corners Maximum number of corners to return
+     * @param mask Optional detection mask (empty for the whole image)
+     */
+    void detectFeatures(const cv::Mat &gray, std::vector<cv::Point2f> &corners,
+                        int max_corners, const cv::Mat &mask);
+
+    /**
+     * @brief Keep the strongest keypoints per feature grid cell
+     *
+     * @param size Image size the grid is laid over
+     * @param corners Output corner locations
+     * @param max_corners Corner budget, shared equally between the cells
+     */
+    void bucketKeypoints(cv::Size size, std::vector<cv::Point2f> &corners, int max_corners);
+
+    /**
+     * @brief Top up the carried-forward feature set after a tracking step
+     *
+     * Re-detects features according to the configured procedure. In
+     * incremental mode only the grid cells below the feature threshold are
+     * searched, and existing features are masked out.
+     *
+     * @param gray Current grayscale frame
+     */
+    void replenishFeatures(const cv::Mat &gray, int max_corners);
+
+    /**
+     * @brief Decide whether the current frame can be skipped
+     *
+     * Decimates _current_gray into the probe, correlates it with the probe
+     * of the last processed frame and, for a small shift, writes the ego
+     * velocity of the shift to @p result.
+     *
+     * @param interval Time since the last processed frame (seconds)
+     * @param height Height above ground (meters)
+     * @param angular_rate Angular rate over the interval (rad/s)
+     * @param result Result of the skipped frame
+     * @return true if the frame is skipped
+     */
+    bool probeLowMotion(float interval, float height, const cv::Vec3f &angular_rate,
+                        OpticalFlowResult &result);
+
+    /**
+     * @brief Check whether the keyframe is exhausted after a tracking step
+     *
+     * Compacts the keyframe features to the survivors of the step.
+     *
+     * @return true if the current frame must become the new keyframe
+     */
+    bool updateKeyframe();
+
+    /**
+     * @brief Corner budget of the next detection
+     */
+    int cornerBudget() const {
+        return _budget.enabled() ? _budget.budget().max_corners : _max_corners;
+    }
+
+    /**
+     * @brief Restart the latency controller from the configured settings
+     */
+    void resetBudget();
+
+    /**
+     * @brief Feed a new step time measurement to the latency controller
+     */
+    void updateBudget();
+
     int _method;                    ///< Optical flow method identifier
+    int _feature_procedure;         ///< Feature maintenance procedure
     float _delta_t;                 ///< Time step between frames (seconds)
     float _focal_length;            ///< Camera focal length (meters)
     float _cmos_width;              ///< Sensor physical width (meters)
     float _cmos_height;             ///< Sensor physical height (meters)
+    float _sensor_fraction_w;       ///< Fraction of the sensor width covered by the frames
+    float _sensor_fraction_h;       ///< Fraction of the sensor height covered by the frames
+    cv::Size _sensor_size;          ///< Full sensor resolution, empty until a region is set
+    cv::Rect _roi;                  ///< Region of the sensor covered by the frames
+    LensUndistortion _undistortion; ///< Undistortion grid of the feature locations
     float _fov_h;                   ///< Horizontal field of view (radians)
     float _fov_v;                   ///< Vertical field of view (radians)
     int _img_width;                 ///< Image width in pixels
     int _img_height;                ///< Image height in pixels
     int _debug_count;               ///< Debug counter for frame tracking
-    cv::Mat _last_im;               ///< Previous frame for optical flow
+    cv::Mat _last_im;               ///< Previous frame for optical flow (ping-pong buffer)
+    cv::Mat _current_gray;          ///< Current frame (ping-pong buffer, swapped with _last_im)
+    bool _has_reference;            ///< _last_im holds a frame to track from
+    cv::Size _win_size;             ///< Lucas-Kanade search window size
+    int _max_level;                 ///< Requested maximum pyramid level
     std::vector<cv::Point2f> _features; ///< Currently tracked feature points
+    int _grid_cols;                 ///< Grid columns for incremental maintenance
+    int _grid_rows;                 ///< Grid rows for incremental maintenance
+    int _min_features_per_cell;     ///< Re-detection threshold per grid cell
+    int _detector;                  ///< Corner detector identifier
+    int _max_corners;               ///< Corner budget of the detector
+    double _quality_level;          ///< Shi-Tomasi quality level
+    double _min_distance;           ///< Minimum distance between corners (pixels)
+    int _block_size;                ///< Shi-Tomasi block size (pixels)
+    cv::Ptr<cv::FeatureDetector> _keypoint_detector; ///< FAST/AGAST detector (null for Shi-Tomasi)
+    std::vector<cv::KeyPoint> _keypoints; ///< FAST/AGAST detections (scratch)
+    std::vector<int> _bucket_counts; ///< Per-cell corner counts of the bucketing (scratch)
+    std::vector<int> _cell_counts;  ///< Per-cell feature counts (scratch)
+    cv::Mat _detection_mask;        ///< Mask limiting re-detection to sparse cells
+    std::vector<cv::Point2f> _detected; ///< Newly detected features (scratch)
+    std::vector<cv::Point2f> _new_features; ///< LK output locations (scratch)
+    std::vector<cv::Point2f> _surviving_features; ///< Features carried forward (scratch)
+    std::vector<uchar> _status;     ///< LK per-feature status (scratch)
+    std::vector<float> _error;      ///< LK per-feature error (scratch)
+    std::vector<cv::Point2f> _back_features; ///< Forward-backward tracked locations (scratch)
+    VelocityConversion _conversion; ///< Fused pixel-to-metric velocity kernel
+    bool _aggregate;                ///< Compute the robust ego velocity each frame
+    bool _rotation_compensation;    ///< Subtract the rotation-induced flow
+    cv::Vec3f _angular_rate;        ///< Angular rate of the next frame (rad/s)
+    RobustVelocityEstimator _aggregator; ///< Median/MAD ego velocity estimator
+    int _pipeline_mode;             ///< Pipeline execution mode
+    uint64_t _pending_detection;    ///< Worker ticket of the queued detection (0 if none)
+    FrameSlot _ring[PIPELINE_RING_SIZE]; ///< Deferred pipeline frame ring
+    int _ring_next;                 ///< Next ring slot to fill
+    bool _ring_pending;             ///< A submitted frame awaits collection
+    StageProfiler _profiler;        ///< Per-stage latency statistics
+    BudgetController _budget;       ///< Step time driven work budget
+    double _latency_target;         ///< Step time target (seconds), 0 = no controller
+    uint64_t _budget_samples;       ///< Total step samples already fed to the controller
+    bool _keyframe_mode;            ///< Track against a retained keyframe
+    float _keyframe_displacement;   ///< Mean displacement promoting a new keyframe (pixels)
+    float _keyframe_survival;       ///< Surviving fraction promoting a new keyframe
+    bool _keyframe_sync;            ///< _key_features must be taken from _features
+    int _keyframe_size;             ///< Features tracked from the keyframe initially
+    std::vector<cv::Point2f> _key_features; ///< Feature locations in the keyframe
+    std::vector<int> _survivor_index; ///< Input index of every survivor (scratch)
+    float _early_out;               ///< Largest skipped shift (pixels), 0 = disabled
+    float _skipped_dt;              ///< Time covered by the frames skipped since the last processed one
+    int _skipped_frames;            ///< Frames skipped in a row
+    bool _probe_valid;              ///< _probe_ref holds the last processed frame
+    cv::Mat _probe_small;           ///< Decimated current frame (scratch)
+    cv::Mat _probe_curr;            ///< Decimated current frame, CV_32F
+    cv::Mat _probe_ref;             ///< Decimated last processed frame, CV_32F
+    cv::Mat _probe_window;          ///< Hann window of the phase correlation
+    std::vector<cv::Point2f> _probe_survivors; ///< Conversion output of the probe (scratch)
 
     /**
      * @brief Termination criteria for iterative optical flow algorithm
      *
-     * Stops after 8 iterations or when change is less than 0.03 pixels
+     * Stops after DEFAULT_LK_MAX_ITERATIONS iterations or when change is
+     * less than DEFAULT_LK_EPSILON pixels
      */
     cv::TermCriteria _criteria = cv::TermCriteria(
-        (cv::TermCriteria::COUNT) + (cv::TermCriteria::EPS), 8, 0.03);
+        (cv::TermCriteria::COUNT) + (cv::TermCriteria::EPS),
+        DEFAULT_LK_MAX_ITERATIONS, DEFAULT_LK_EPSILON);
+
+    /**
+     * @brief Optical flow backend selected by the method identifier
+     */
+    std::unique_ptr<FlowBackend> _backend;
+
+    /**
+     * @brief Worker thread for the pipelined modes (null when synchronous)
+     *
+     * Declared last so it is joined before the state its tasks use is destroyed.
+     */
+    std::unique_ptr<PipelineWorker> _worker;
 };
 
 #endif // OPTICAL_FLOW_UAV_VELOCITY_HPP
\ No newline at end of file
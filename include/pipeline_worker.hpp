@@ -0,0 +1,94 @@
+/**
+ * @file pipeline_worker.hpp
+ * @brief Background worker used by the pipelined tracker modes
+ *
+ * This file defines the PipelineWorker class, a dedicated thread executing
+ * tracker stages in submission order from a bounded queue.
+ */
+
+#ifndef PIPELINE_WORKER_HPP
+#define PIPELINE_WORKER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class PipelineWorker
+ * @brief In-order background executor with a bounded task queue
+ *
+ * Tasks run one at a time in the order they were submitted, which matches the
+ * frame-to-frame dependencies of the tracker (detection of frame N must
+ * finish before tracking frame N + 1). Each submission returns a ticket that
+ * can be waited on. An exception thrown by a task is captured and rethrown
+ * from the wait() call covering that task, so OpenCV errors still reach the
+ * caller thread.
+ */
+class PipelineWorker {
+public:
+    /**
+     * @brief Maximum number of queued tasks before submit() blocks
+     */
+    static constexpr int QUEUE_CAPACITY = 4;
+
+    /**
+     * @brief Constructor, starts the worker thread
+     */
+    PipelineWorker();
+
+    /**
+     * @brief Destructor, finishes queued tasks and joins the worker thread
+     */
+    ~PipelineWorker();
+
+    PipelineWorker(const PipelineWorker&) = delete;
+    PipelineWorker& operator=(const PipelineWorker&) = delete;
+
+    /**
+     * @brief Queue a task for execution on the worker thread
+     *
+     * Blocks while the queue is full.
+     *
+     * @param task Task to execute
+     * @return Ticket identifying the task for wait()
+     */
+    uint64_t submit(std::function<void()> task);
+
+    /**
+     * @brief Wait until the task with the given ticket has finished
+     *
+     * @param ticket Ticket returned by submit()
+     * @throws Any exception thrown by a task up to and including @p ticket
+     */
+    void wait(uint64_t ticket);
+
+    /**
+     * @brief Wait until every submitted task has finished
+     *
+     * @throws Any exception thrown by a finished task
+     */
+    void waitAll();
+
+private:
+    /**
+     * @brief Worker thread main loop
+     */
+    void run();
+
+    std::mutex _mutex;              ///< Protects the queue and counters
+    std::condition_variable _task_cv; ///< Signals queued tasks or shutdown
+    std::condition_variable _done_cv; ///< Signals completed tasks or free slots
+    std::function<void()> _queue[QUEUE_CAPACITY]; ///< Ring buffer of pending tasks
+    int _head;                      ///< Index of the next task to run
+    int _size;                      ///< Number of queued tasks
+    uint64_t _submitted;            ///< Ticket of the last submitted task
+    uint64_t _completed;            ///< Ticket of the last completed task
+    std::exception_ptr _error;      ///< First uncollected task exception
+    bool _stop;                     ///< Set by the destructor to end the loop
+    std::thread _thread;            ///< Worker thread (started last)
+};
+
+#endif // PIPELINE_WORKER_HPP
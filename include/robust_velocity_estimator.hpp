@@ -0,0 +1,91 @@
+/**
+ * @file robust_velocity_estimator.hpp
+ * @brief Robust aggregation of per-feature velocities into one ego velocity
+ *
+ * This file defines the RobustVelocityEstimator class which reduces the
+ * per-feature velocity field to a single translation estimate with a
+ * median/MAD inlier filter.
+ */
+
+#ifndef ROBUST_VELOCITY_ESTIMATOR_HPP
+#define ROBUST_VELOCITY_ESTIMATOR_HPP
+
+#include <vector>
+#include "optical_flow_result.hpp"
+
+/**
+ * @class RobustVelocityEstimator
+ * @brief Median/MAD inlier filter over a translation model
+ *
+ * The estimate is computed in three steps:
+ * 1. Component-wise median of the feature velocities as initial estimate
+ * 2. Distance of every feature to that estimate, with the median absolute
+ *    deviation (scaled to a standard deviation) as robust spread
+ * 3. Features within @c threshold spreads are inliers; the estimate is
+ *    refined as their mean and the residual is their RMS distance to it
+ *
+ * All scratch memory is allocated at construction, estimate() does not
+ * allocate.
+ */
+class RobustVelocityEstimator {
+public:
+    /**
+     * @brief Default inlier threshold in robust standard deviations
+     */
+    static constexpr float DEFAULT_THRESHOLD = 3.0f;
+
+    /**
+     * @brief Scale factor from MAD to standard deviation for Gaussian noise
+     */
+    static constexpr float MAD_TO_SIGMA = 1.4826f;
+
+    /**
+     * @brief Lower bound on the robust spread (m/s)
+     *
+     * Prevents a zero MAD from rejecting features that differ by rounding only.
+     */
+    static constexpr float MIN_SIGMA = 1e-3f;
+
+    /**
+     * @brief Constructor for RobustVelocityEstimator
+     *
+     * @param capacity Maximum number of features per estimate
+     * @param threshold Inlier threshold in robust standard deviations
+     */
+    explicit RobustVelocityEstimator(int capacity = 1000,
+                                     float threshold = DEFAULT_THRESHOLD);
+
+    /**
+     * @brief Set the inlier threshold
+     *
+     * @param threshold Inlier threshold in robust standard deviations
+     */
+    void setThreshold(float threshold);
+
+    /**
+     * @brief Aggregate the per-feature velocities of a result
+     *
+     * Reads the first @c count velocities of @p result and writes
+     * ego_vel_x, ego_vel_y, inlier_count and residual.
+     *
+     * @param result Tracking result to aggregate in place
+     * @return true if at least one feature was available
+     */
+    bool estimate(OpticalFlowResult &result);
+
+private:
+    /**
+     * @brief Upper median of the first n values of a scratch buffer
+     *
+     * @param values Scratch buffer, reordered in place
+     * @param n Number of values
+     * @return Median value
+     */
+    static float median(std::vector<float> &values, int n);
+
+    float _threshold;               ///< Inlier threshold in robust standard deviations
+    std::vector<float> _scratch;    ///< Reorderable copy for median selection
+    std::vector<float> _distance;   ///< Per-feature distance to the initial estimate
+};
+
+#endif // ROBUST_VELOCITY_ESTIMATOR_HPP
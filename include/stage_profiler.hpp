@@ -0,0 +1,224 @@
+/**
+ * @file stage_profiler.hpp
+ * @brief Per-stage latency instrumentation for the tracking pipeline
+ *
+ * This file defines the StageProfiler class and the scoped timer macro used
+ * to measure ingestion, pyramid construction, tracking, conversion, detection
+ * and aggregation separately.
+ */
+
+#ifndef STAGE_PROFILER_HPP
+#define STAGE_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class StageProfiler
+ * @brief Lock-free per-stage timing history with percentile summaries
+ *
+ * Every stage keeps its most recent HISTORY_SIZE samples in a ring of atomic
+ * slots, plus the latest sample, the maximum and the total count. Recording
+ * never locks or allocates, so samples can come from the Simulink thread and
+ * the pipeline worker at the same time. Percentiles are only computed on
+ * request from a snapshot of the ring.
+ *
+ * Stage timers are placed with OPTICAL_FLOW_PROFILE_SCOPE. Unless
+ * OPTICAL_FLOW_PROFILING is defined the macro expands to nothing, ScopedTimer
+ * is not declared and only STAGE_TOTAL has storage. Samples for the other
+ * stages are then discarded and report zero.
+ */
+class StageProfiler {
+public:
+    /**
+     * @brief Whole S-function step, always recorded
+     */
+    static constexpr int STAGE_TOTAL = 0;
+
+    /**
+     * @brief Simulink to OpenCV frame conversion
+     */
+    static constexpr int STAGE_INGESTION = 1;
+
+    /**
+     * @brief Image pyramid construction
+     */
+    static constexpr int STAGE_PYRAMID = 2;
+
+    /**
+     * @brief Lucas-Kanade tracking
+     */
+    static constexpr int STAGE_TRACKING = 3;
+
+    /**
+     * @brief Pixel to metric velocity conversion
+     */
+    static constexpr int STAGE_CONVERSION = 4;
+
+    /**
+     * @brief Feature detection and replenishment
+     */
+    static constexpr int STAGE_DETECTION = 5;
+
+    /**
+     * @brief Robust ego velocity aggregation
+     */
+    static constexpr int STAGE_AGGREGATION = 6;
+
+    /**
+     * @brief Number of instrumented stages
+     */
+    static constexpr int NUM_STAGES = 7;
+
+    /**
+     * @brief Number of samples kept per stage for the percentiles
+     */
+    static constexpr int HISTORY_SIZE = 1024;
+
+#ifdef OPTICAL_FLOW_PROFILING
+    /**
+     * @brief Number of stages with storage
+     */
+    static constexpr int RECORDED_STAGES = NUM_STAGES;
+#else
+    static constexpr int RECORDED_STAGES = STAGE_TOTAL + 1;
+#endif
+
+    /**
+     * @brief Timing statistics of one stage
+     */
+    struct Summary {
+        uint64_t count;             ///< Total number of samples recorded
+        double p50;                 ///< Median over the retained history (seconds)
+        double p99;                 ///< 99th percentile over the retained history (seconds)
+        double max;                 ///< Maximum over all samples (seconds)
+    };
+
+#ifdef OPTICAL_FLOW_PROFILING
+    /**
+     * @brief RAII timer recording the lifetime of a scope into one stage
+     */
+    class ScopedTimer {
+    public:
+        /**
+         * @brief Start timing
+         *
+         * @param profiler Profiler to record into (nothing is recorded if null)
+         * @param stage Stage index, one of the STAGE_* constants
+         */
+        ScopedTimer(StageProfiler* profiler, int stage)
+            : _profiler(profiler),
+              _stage(stage),
+              _start(std::chrono::steady_clock::now()) {
+        }
+
+        /**
+         * @brief Stop timing and record the elapsed time
+         */
+        ~ScopedTimer() {
+            if (_profiler != nullptr) {
+                _profiler->record(_stage, std::chrono::steady_clock::now() - _start);
+            }
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        StageProfiler* _profiler;   ///< Target profiler
+        int _stage;                 ///< Stage being timed
+        std::chrono::steady_clock::time_point _start; ///< Start of the scope
+    };
+#endif
+
+    /**
+     * @brief Constructor, all statistics start empty
+     */
+    StageProfiler();
+
+    StageProfiler(const StageProfiler&) = delete;
+    StageProfiler& operator=(const StageProfiler&) = delete;
+
+    /**
+     * @brief Record one sample
+     *
+     * Samples for a stage without storage are discarded.
+     *
+     * @param stage Stage index, one of the STAGE_* constants
+     * @param elapsed Measured duration
+     */
+    void record(int stage, std::chrono::steady_clock::duration elapsed);
+
+    /**
+     * @brief Get the most recent sample of a stage
+     *
+     * @param stage Stage index
+     * @return Latest duration in seconds (0 if none recorded)
+     */
+    double last(int stage) const;
+
+    /**
+     * @brief Get the number of samples recorded for a stage
+     *
+     * @param stage Stage index
+     * @return Total sample count (0 for an invalid stage)
+     */
+    uint64_t count(int stage) const;
+
+    /**
+     * @brief Compute the statistics of a stage
+     *
+     * @param stage Stage index
+     * @return Sample count, p50 and p99 of the retained history and maximum
+     */
+    Summary summary(int stage) const;
+
+    /**
+     * @brief Get the display name of a stage
+     */
+    static const char* stageName(int stage);
+
+    /**
+     * @brief Format a one-line-per-stage summary table
+     *
+     * Stages without samples are omitted.
+     *
+     * @param buffer Output character buffer
+     * @param size Size of @p buffer in bytes
+     * @return Number of characters written, excluding the terminator
+     */
+    int format(char* buffer, size_t size) const;
+
+    /**
+     * @brief Discard all recorded samples
+     */
+    void reset();
+
+private:
+    std::atomic<uint64_t> _samples[RECORDED_STAGES][HISTORY_SIZE]; ///< Sample rings (nanoseconds)
+    std::atomic<uint64_t> _count[RECORDED_STAGES]; ///< Samples recorded per stage
+    std::atomic<uint64_t> _last[RECORDED_STAGES];  ///< Latest sample per stage (nanoseconds)
+    std::atomic<uint64_t> _max[RECORDED_STAGES];   ///< Maximum sample per stage (nanoseconds)
+};
+
+#define OPTICAL_FLOW_PROFILE_CONCAT_(a, b) a##b
+#define OPTICAL_FLOW_PROFILE_CONCAT(a, b) OPTICAL_FLOW_PROFILE_CONCAT_(a, b)
+
+/**
+ * @brief Time the enclosing scope into a stage of a profiler
+ *
+ * Expands to nothing unless OPTICAL_FLOW_PROFILING is defined.
+ *
+ * @param profiler Pointer to a StageProfiler (may be null)
+ * @param stage Stage index, one of the StageProfiler::STAGE_* constants
+ */
+#ifdef OPTICAL_FLOW_PROFILING
+#define OPTICAL_FLOW_PROFILE_SCOPE(profiler, stage) \
+    StageProfiler::ScopedTimer OPTICAL_FLOW_PROFILE_CONCAT(_profile_scope_, __LINE__)(profiler, stage)
+#else
+#define OPTICAL_FLOW_PROFILE_SCOPE(profiler, stage) ((void)0)
+#endif
+
+#endif // STAGE_PROFILER_HPP
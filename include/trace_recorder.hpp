@@ -0,0 +1,170 @@
+/**
+ * @file trace_recorder.hpp
+ * @brief Compact binary trace of the per-frame tracking results
+ *
+ * This file defines the TraceRecorder class, which appends one fixed-size
+ * record per camera and frame to a preallocated, memory-mapped ring file so
+ * full traces can be kept without Simulink signal logging.
+ */
+
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "optical_flow_result.hpp"
+
+/**
+ * @class TraceRecorder
+ * @brief Ring of fixed-size result records in a memory-mapped file
+ *
+ * File layout (little-endian, all fields naturally aligned):
+ * - Header, HEADER_BYTES: magic "OFTRACE1", uint32 version, header bytes,
+ *   record bytes, record capacity, features per record and flags, then the
+ *   uint64 number of records written so far.
+ * - capacity() records. Record k of the sequence is stored in slot
+ *   (k - 1) % capacity(), so the file holds the latest capacity() records. A
+ *   record starts with a 48-byte block: uint64 sequence number (1-based,
+ *   written last), double timestamp, uint32 camera, uint32 feature count,
+ *   float ego vx, ego vy and residual, uint32 inlier count, uint32 success
+ *   and 4 padding bytes. Then follow vel_x and vel_y
+ *   (maxFeatures() float16 or float32 values each) and, with FLAG_POSITIONS,
+ *   prev_x, prev_y, curr_x and curr_y (maxFeatures() float32 values each).
+ *   Only the first count entries of each array are valid.
+ *
+ * The whole file is allocated when the recorder is created, appending a
+ * record is a copy into mapped memory. A background thread writes dirty
+ * pages back to the file periodically, so steps never wait for the disk.
+ * read_optical_flow_trace.m and read_optical_flow_trace.py in tools/ read
+ * these files.
+ */
+class TraceRecorder {
+public:
+    /**
+     * @brief Velocities are stored as IEEE 754 half-precision values
+     */
+    static constexpr uint32_t FLAG_HALF_VELOCITIES = 1;
+
+    /**
+     * @brief Records contain the previous and current feature positions
+     */
+    static constexpr uint32_t FLAG_POSITIONS = 2;
+
+    /**
+     * @brief Version of the file layout
+     */
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    /**
+     * @brief Size of the file header in bytes
+     */
+    static constexpr size_t HEADER_BYTES = 64;
+
+    /**
+     * @brief Size of the fixed part of a record in bytes
+     */
+    static constexpr size_t RECORD_HEADER_BYTES = 48;
+
+    /**
+     * @brief Interval between background write-backs (milliseconds)
+     */
+    static constexpr int FLUSH_INTERVAL_MS = 200;
+
+    /**
+     * @brief Create the trace file and start the flush thread
+     *
+     * An existing file is replaced. Throws cv::Exception if the file cannot
+     * be created, sized or mapped.
+     *
+     * @param path File name
+     * @param capacity Number of records kept in the ring
+     * @param max_features Features stored per record, at most the result capacity
+     * @param flags Combination of FLAG_HALF_VELOCITIES and FLAG_POSITIONS
+     */
+    TraceRecorder(const std::string &path, uint32_t capacity, int max_features, uint32_t flags);
+
+    /**
+     * @brief Destructor, writes all records back to the file and closes it
+     */
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /**
+     * @brief Bytes of one record for a configuration
+     *
+     * @param max_features Features stored per record
+     * @param flags Combination of FLAG_HALF_VELOCITIES and FLAG_POSITIONS
+     */
+    static size_t recordBytes(int max_features, uint32_t flags);
+
+    /**
+     * @brief Append the result of one camera and frame
+     *
+     * Called from a single thread. Features beyond maxFeatures() are not
+     * recorded.
+     *
+     * @param timestamp Simulation time of the frame (seconds)
+     * @param camera Camera index
+     * @param result Result of the frame
+     */
+    void append(double timestamp, int camera, const OpticalFlowResult &result);
+
+    /**
+     * @brief Number of records appended since creation
+     */
+    uint64_t written() const { return _written.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Number of records kept in the ring
+     */
+    uint32_t capacity() const { return _capacity; }
+
+    /**
+     * @brief Features stored per record
+     */
+    int maxFeatures() const { return _max_features; }
+
+private:
+    /**
+     * @brief Flush thread main loop
+     */
+    void run();
+
+    /**
+     * @brief Write the records appended since the last call back to the file
+     */
+    void flush();
+
+    /**
+     * @brief Write a byte range of the mapping back to the file
+     */
+    void flushRange(size_t offset, size_t bytes);
+
+    uint32_t _capacity;             ///< Records in the ring
+    int _max_features;              ///< Features stored per record
+    uint32_t _flags;                ///< Record content flags
+    size_t _record_bytes;           ///< Bytes per record
+    size_t _file_bytes;             ///< Size of the file and the mapping
+    unsigned char* _data;           ///< Start of the mapping
+    std::atomic<uint64_t> _written; ///< Records appended, published to the flush thread
+    uint64_t _flushed;              ///< Records already written back (flush thread only)
+#ifdef _WIN32
+    void* _file;                    ///< File handle
+    void* _mapping;                 ///< File mapping handle
+#else
+    int _fd;                        ///< File descriptor
+#endif
+    std::mutex _mutex;              ///< Guards _stop
+    std::condition_variable _stop_cv; ///< Wakes the flush thread for shutdown
+    bool _stop;                     ///< Set by the destructor to end the flush thread
+    std::thread _thread;            ///< Flush thread (started last)
+};
+
+#endif // TRACE_RECORDER_HPP
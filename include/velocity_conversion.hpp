@@ -0,0 +1,207 @@
+/**
+ * @file velocity_conversion.hpp
+ * @brief Batch conversion of tracked feature displacements to metric velocity
+ *
+ * This file defines the VelocityConversion class which turns the output of a
+ * Lucas-Kanade tracking step into real-world velocities in a single fused,
+ * vectorized pass.
+ */
+
+#ifndef VELOCITY_CONVERSION_HPP
+#define VELOCITY_CONVERSION_HPP
+
+#include <opencv2/core.hpp>
+#include <vector>
+#include "optical_flow_result.hpp"
+#include "lens_undistortion.hpp"
+
+/**
+ * @class VelocityConversion
+ * @brief Fused displacement, pixel-to-angle and angle-to-velocity kernel
+ *
+ * For every successfully tracked feature the angular displacement is
+ * theta = d * fov / pixels and the velocity is v = height * tan(theta) / dt.
+ * Per-frame constants (fov / pixels, height / dt) are computed once in
+ * setFrame() so the per-feature work is multiplications only.
+ *
+ * Two modes are available:
+ * - MODE_FAST: vectorized (AVX2, SSE4.1 or NEON) with the [5/4] Pade
+ *   approximant of tan. For |theta| <= pi/4 its relative error is below
+ *   1.4e-8 in exact arithmetic; measured end-to-end velocities stay within
+ *   5e-7 relative of MODE_EXACT (a few float ulps). Per-frame
+ *   displacements are bounded by the LK search range and stay far inside
+ *   this interval.
+ * - MODE_EXACT: scalar, reproduces the original operation order with
+ *   std::tan so outputs are bit-for-bit identical to the reference
+ *   implementation, for regression comparisons.
+ *
+ * When a frame is set with the camera angular rate, the conversion also
+ * removes the rotation-induced flow. Feature locations are then mapped to
+ * pinhole bearings through per-row and per-column lookup tables, built in
+ * configure() only when the geometry changes. The rotation over the frame
+ * is subtracted in bearing space:
+ * theta_x = b_row(curr) - b_row(prev) + wy * dt + wz * dt * b_col(prev) and
+ * theta_y = b_col(prev) - b_col(curr) - wx * dt + wz * dt * b_row(prev),
+ * with rates about X (forward), Y (left) and Z (up). Both modes use this
+ * scalar path then, with the Pade tan, so no trigonometric function is
+ * evaluated per feature. Its geometry differs from the per-pixel angle of
+ * the uncompensated paths, there is no reference output to reproduce.
+ *
+ * With a lens model (setUndistortion()) the same bearing path is used, the
+ * bearings then come from the LensUndistortion grid instead of the pinhole
+ * tables. Tracking still runs on the distorted frames, only the feature
+ * locations are corrected.
+ */
+class VelocityConversion {
+public:
+    /**
+     * @brief Scalar std::tan path, bit-identical to the reference implementation
+     */
+    static constexpr int MODE_EXACT = 0;
+
+    /**
+     * @brief Vectorized path using the Pade tan approximation
+     */
+    static constexpr int MODE_FAST = 1;
+
+    /**
+     * @brief Constructor for VelocityConversion
+     *
+     * @param mode Conversion mode (MODE_FAST or MODE_EXACT)
+     */
+    explicit VelocityConversion(int mode = MODE_FAST);
+
+    /**
+     * @brief Select the conversion mode
+     *
+     * @param mode MODE_FAST or MODE_EXACT
+     */
+    void setMode(int mode);
+
+    /**
+     * @brief Get the current conversion mode
+     */
+    int mode() const { return _mode; }
+
+    /**
+     * @brief Set the camera geometry used for the pixel-to-angle conversion
+     *
+     * @param fov_h Horizontal field of view (radians)
+     * @param fov_v Vertical field of view (radians)
+     * @param img_width Image width in pixels
+     * @param img_height Image height in pixels
+     */
+    void configure(float fov_h, float fov_v, int img_width, int img_height);
+
+    /**
+     * @brief Precompute the per-frame constants
+     *
+     * @param delta_t Time step between the two frames (seconds)
+     * @param height Height of the camera above the ground (meters)
+     */
+    void setFrame(float delta_t, float height);
+
+    /**
+     * @brief Precompute the per-frame constants with rotation compensation
+     *
+     * Every rate, zero included, selects the bearing path, so the outputs
+     * are continuous in the rate.
+     *
+     * @param delta_t Time step between the two frames (seconds)
+     * @param height Height of the camera above the ground (meters)
+     * @param angular_rate Camera angular rate about X (forward), Y (left)
+     *        and Z (up) over the frame (rad/s)
+     */
+    void setFrame(float delta_t, float height, const cv::Vec3f &angular_rate);
+
+    /**
+     * @brief Set the outlier rejection thresholds applied during convert()
+     *
+     * @param max_error Maximum tracking error of a feature (same units as the
+     *        backend error, Lucas-Kanade: mean absolute intensity difference
+     *        in the window), 0 or less disables the test
+     * @param max_fb_error Maximum distance between a feature and its
+     *        forward-backward tracked location (pixels), 0 or less disables it
+     */
+    void setRejection(float max_error, float max_fb_error);
+
+    /**
+     * @brief Take the feature bearings from a lens undistortion grid
+     *
+     * The grid is used once it is built (LensUndistortion::ready()).
+     *
+     * @param undistortion Grid owned by the caller, nullptr for the pinhole model
+     */
+    void setUndistortion(const LensUndistortion* undistortion) { _undistortion = undistortion; }
+
+    /**
+     * @brief Maximum forward-backward error, 0 if the check is disabled
+     */
+    float maxForwardBackwardError() const { return _max_fb_error; }
+
+    /**
+     * @brief Convert one tracking step in a single pass
+     *
+     * Features with a zero status, or failing an enabled rejection test, are
+     * skipped. For the remaining ones the velocity and both locations are
+     * written to @p result (up to its capacity), and features still inside
+     * @p bounds are appended to @p survivors so they can be tracked on the
+     * next frame.
+     *
+     * @param prev Feature locations in the previous frame
+     * @param curr Feature locations in the current frame
+     * @param status LK status per feature (non-zero if tracked)
+     * @param error Tracking error per feature, may be null when the error test is disabled
+     * @param back Forward-backward tracked previous locations, null to skip that test
+     * @param n Number of features
+     * @param bounds Image size used to keep surviving features
+     * @param result Preallocated result, count is set to the number written
+     * @param survivors Output features carried forward (cleared first)
+     * @param survivor_index Optional output, the input index of every
+     *        survivor (cleared first), nullptr if not needed
+     *
+     * @return Number of features written to @p result
+     */
+    int convert(const cv::Point2f* prev, const cv::Point2f* curr,
+                const uchar* status, const float* error, const cv::Point2f* back,
+                int n, cv::Size bounds,
+                OpticalFlowResult &result,
+                std::vector<cv::Point2f> &survivors,
+                std::vector<int>* survivor_index = nullptr) const;
+
+    /**
+     * @brief Scalar [5/4] Pade approximation of tan used by MODE_FAST
+     *
+     * @param x Angle in radians, accurate for |x| <= pi/4
+     * @return Approximation of tan(x)
+     */
+    static float fastTan(float x) {
+        const float x2 = x * x;
+        return x * (945.0f + x2 * (-105.0f + x2)) /
+               (945.0f + x2 * (-420.0f + 15.0f * x2));
+    }
+
+private:
+    int _mode;                      ///< Conversion mode
+    float _fov_h;                   ///< Horizontal field of view (radians)
+    float _fov_v;                   ///< Vertical field of view (radians)
+    float _img_width;               ///< Image width in pixels
+    float _img_height;              ///< Image height in pixels
+    float _delta_t;                 ///< Time step of the current frame (seconds)
+    float _height;                  ///< Height above ground of the current frame (meters)
+    float _rad_per_px_x;            ///< fov_v / img_height, angle per pixel along X
+    float _rad_per_px_y;            ///< fov_h / img_width, angle per pixel along Y
+    float _height_over_dt;          ///< height / delta_t for the current frame
+    float _max_error;               ///< Tracking error threshold (0 = disabled)
+    float _max_fb_error;            ///< Forward-backward distance threshold (0 = disabled)
+    float _max_fb_error_sq;         ///< Squared forward-backward distance threshold
+    bool _compensate;               ///< Remove the rotation of the current frame
+    float _rot_x;                   ///< Rotation about X over the current frame (radians)
+    float _rot_y;                   ///< Rotation about Y over the current frame (radians)
+    float _rot_z;                   ///< Rotation about Z over the current frame (radians)
+    std::vector<float> _row_bearing; ///< Bearing of each row, positive backward (radians)
+    std::vector<float> _col_bearing; ///< Bearing of each column, positive left (radians)
+    const LensUndistortion* _undistortion; ///< Lens undistortion grid, null for the pinhole model
+};
+
+#endif // VELOCITY_CONVERSION_HPP
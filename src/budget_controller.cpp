@@ -0,0 +1,67 @@
+/**
+ * @file budget_controller.cpp
+ * @brief Implementation of the tracking effort controller
+ *
+ * This file implements the effort update and the mapping from effort to
+ * tracker settings of BudgetController.
+ */
+
+#include "budget_controller.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief Interpolate an integer setting between floor and ceiling
+ */
+int interpolate(int floor, int ceiling, double effort) {
+    return floor + static_cast<int>(std::lround(effort * (ceiling - floor)));
+}
+
+} // namespace
+
+BudgetController::BudgetController()
+    : _target(0.0),
+      _effort(1.0),
+      _ceiling{0, 0, 0},
+      _floor{0, 0, 0},
+      _budget{0, 0, 0} {
+}
+
+void BudgetController::configure(double target, const Budget &ceiling, const Budget &floor) {
+    _target = std::max(0.0, target);
+    _ceiling = ceiling;
+    _floor.max_corners = std::min(floor.max_corners, ceiling.max_corners);
+    _floor.max_level = std::min(floor.max_level, ceiling.max_level);
+    _floor.max_iterations = std::min(floor.max_iterations, ceiling.max_iterations);
+    _effort = 1.0;
+    _budget = _ceiling;
+}
+
+bool BudgetController::update(double step_time) {
+    if (!enabled() || !(step_time > 0.0)) {
+        return false;
+    }
+
+    // Back off in proportion to an overrun, recover slowly once there is headroom
+    if (step_time > _target) {
+        _effort *= DECREASE_MARGIN * _target / step_time;
+    } else if (step_time < HEADROOM * _target) {
+        _effort += RECOVERY_STEP;
+    } else {
+        return false;
+    }
+    _effort = std::min(std::max(_effort, 0.0), 1.0);
+    return applyEffort();
+}
+
+bool BudgetController::applyEffort() {
+    const Budget previous = _budget;
+    _budget.max_corners = interpolate(_floor.max_corners, _ceiling.max_corners, _effort);
+    _budget.max_level = interpolate(_floor.max_level, _ceiling.max_level, _effort);
+    _budget.max_iterations = interpolate(_floor.max_iterations, _ceiling.max_iterations, _effort);
+    return _budget.max_corners != previous.max_corners ||
+           _budget.max_level != previous.max_level ||
+           _budget.max_iterations != previous.max_iterations;
+}
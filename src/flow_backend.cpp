@@ -0,0 +1,373 @@
+/**
+ * @file flow_backend.cpp
+ * @brief Implementation of the optical flow backends
+ *
+ * This file implements the CPU sparse Lucas-Kanade, DIS dense and CUDA
+ * sparse Lucas-Kanade backends.
+ */
+
+#include "flow_backend.hpp"
+#include "optical_flow_velocity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Displace a point by a dense flow field with bilinear interpolation
+ *
+ * @param flow Flow field, CV_32FC2
+ * @param p Point location
+ * @param q Output displaced location (p when the point is outside the field)
+ *
+ * @return 1 if both locations are inside the field and the flow is finite
+ */
+uchar displace(const cv::Mat &flow, const cv::Point2f &p, cv::Point2f &q) {
+    const float max_x = static_cast<float>(flow.cols - 1);
+    const float max_y = static_cast<float>(flow.rows - 1);
+    if (!(p.x >= 0.0f && p.y >= 0.0f && p.x <= max_x && p.y <= max_y)) {
+        q = p;
+        return 0;
+    }
+
+    const int x0 = std::min(static_cast<int>(p.x), std::max(0, flow.cols - 2));
+    const int y0 = std::min(static_cast<int>(p.y), std::max(0, flow.rows - 2));
+    const int x1 = std::min(x0 + 1, flow.cols - 1);
+    const int y1 = std::min(y0 + 1, flow.rows - 1);
+    const float ax = p.x - static_cast<float>(x0);
+    const float ay = p.y - static_cast<float>(y0);
+    const cv::Point2f *r0 = flow.ptr<cv::Point2f>(y0);
+    const cv::Point2f *r1 = flow.ptr<cv::Point2f>(y1);
+    const cv::Point2f top = r0[x0] * (1.0f - ax) + r0[x1] * ax;
+    const cv::Point2f bottom = r1[x0] * (1.0f - ax) + r1[x1] * ax;
+    const cv::Point2f d = top * (1.0f - ay) + bottom * ay;
+
+    q = p + d;
+    return (std::isfinite(d.x) && std::isfinite(d.y) &&
+            q.x >= 0.0f && q.y >= 0.0f && q.x <= max_x && q.y <= max_y) ? 1 : 0;
+}
+
+} // namespace
+
+SparseLKBackend::SparseLKBackend()
+    : _win_size(OpticalFlowTracking::DEFAULT_LK_WINDOW_SIZE,
+                OpticalFlowTracking::DEFAULT_LK_WINDOW_SIZE),
+      _max_level(OpticalFlowTracking::DEFAULT_LK_MAX_LEVEL),
+      _level_budget(OpticalFlowTracking::DEFAULT_LK_MAX_LEVEL),
+      _prev_levels(0),
+      _curr_levels(0),
+      _criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS,
+                OpticalFlowTracking::DEFAULT_LK_MAX_ITERATIONS,
+                OpticalFlowTracking::DEFAULT_LK_EPSILON),
+      _budget_criteria(_criteria),
+      _prev_pyramid(),
+      _curr_pyramid(),
+      _back_status(),
+      _back_error(),
+      _tiles(0),
+      _tile_start(),
+      _tile_fill(),
+      _tile_order(),
+      _tile_points(),
+      _tile_tracked(),
+      _tile_status(),
+      _tile_error() {
+}
+
+void SparseLKBackend::configure(cv::Size win_size, int max_level,
+                                const cv::TermCriteria &criteria) {
+    _win_size = win_size;
+    _max_level = max_level;
+    _level_budget = max_level;
+    _criteria = criteria;
+    _budget_criteria = criteria;
+
+    // Cached pyramids no longer match the window size and depth
+    _prev_pyramid.clear();
+    _prev_levels = 0;
+    _curr_levels = 0;
+}
+
+void SparseLKBackend::setBudget(int max_level, int max_iterations) {
+    _level_budget = std::min(std::max(0, max_level), _max_level);
+    _budget_criteria.maxCount = std::min(std::max(1, max_iterations), _criteria.maxCount);
+}
+
+void SparseLKBackend::setParallelTiles(int tiles) {
+    _tiles = std::max(0, tiles);
+}
+
+void SparseLKBackend::setReference(const cv::Mat &gray) {
+    // Derivatives are kept so LK can reuse them when this becomes the previous pyramid
+    _prev_levels = cv::buildOpticalFlowPyramid(gray, _prev_pyramid, _win_size, _level_budget, true);
+}
+
+void SparseLKBackend::prepare(const cv::Mat &gray) {
+    // Level buffers are reused across frames, steady-state calls do not reallocate
+    _curr_levels = cv::buildOpticalFlowPyramid(gray, _curr_pyramid, _win_size, _level_budget, true);
+}
+
+void SparseLKBackend::track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+                            std::vector<uchar> &status, std::vector<float> &error) {
+    trackPoints(_prev_pyramid, _curr_pyramid, prev, next, status, error);
+}
+
+void SparseLKBackend::trackBack(const std::vector<cv::Point2f> &next,
+                                std::vector<cv::Point2f> &back, std::vector<uchar> &status) {
+    // Both cached pyramids carry derivatives, so the reverse pass builds nothing
+    trackPoints(_curr_pyramid, _prev_pyramid, next, back, _back_status, _back_error);
+    for (size_t i = 0; i < status.size(); ++i) {
+        status[i] = status[i] && _back_status[i];
+    }
+}
+
+void SparseLKBackend::advance() {
+    _prev_pyramid.swap(_curr_pyramid);
+    std::swap(_prev_levels, _curr_levels);
+}
+
+void SparseLKBackend::trackPoints(const std::vector<cv::Mat> &from, const std::vector<cv::Mat> &to,
+                                  const std::vector<cv::Point2f> &points,
+                                  std::vector<cv::Point2f> &tracked, std::vector<uchar> &status,
+                                  std::vector<float> &error) {
+    const int n = static_cast<int>(points.size());
+    const int levels = std::min(_prev_levels, _curr_levels);
+    const int tiles = std::min(_tiles, n / MIN_TILE_POINTS);
+    if (tiles <= 1 || from.empty()) {
+        // Pyramids are passed directly so OpenCV does not rebuild them internally
+        cv::calcOpticalFlowPyrLK(from, to, points, tracked, status, error, _win_size, levels,
+                                 _budget_criteria);
+        return;
+    }
+
+    // Counting sort by band, stable so the order within a band is the input order
+    const int rows = from[0].rows;
+    auto bandOf = [rows, tiles](const cv::Point2f &p) {
+        const int band = static_cast<int>(p.y * tiles / rows);
+        return std::min(std::max(band, 0), tiles - 1);
+    };
+    _tile_start.assign(tiles + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        _tile_start[bandOf(points[i]) + 1]++;
+    }
+    for (int t = 0; t < tiles; ++t) {
+        _tile_start[t + 1] += _tile_start[t];
+    }
+    _tile_order.resize(n);
+    _tile_points.resize(n);
+    _tile_tracked.resize(n);
+    _tile_status.resize(n);
+    _tile_error.resize(n);
+    _tile_fill.assign(_tile_start.begin(), _tile_start.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        const int k = _tile_fill[bandOf(points[i])]++;
+        _tile_order[k] = i;
+        _tile_points[k] = points[i];
+    }
+
+    // One LK call per band, its points are a contiguous slice of the band order
+    const cv::Size win_size = _win_size;
+    const cv::TermCriteria criteria = _budget_criteria;
+    auto body = [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; ++t) {
+            const int start = _tile_start[t];
+            const int count = _tile_start[t + 1] - start;
+            if (count == 0) {
+                continue;
+            }
+            // Headers over the scratch slices, OpenCV writes the outputs in place
+            cv::Mat band_points(count, 1, CV_32FC2, &_tile_points[start]);
+            cv::Mat band_tracked(count, 1, CV_32FC2, &_tile_tracked[start]);
+            cv::Mat band_status(count, 1, CV_8UC1, &_tile_status[start]);
+            cv::Mat band_error(count, 1, CV_32FC1, &_tile_error[start]);
+            cv::calcOpticalFlowPyrLK(from, to, band_points, band_tracked, band_status,
+                                     band_error, win_size, levels, criteria);
+        }
+    };
+    cv::parallel_for_(cv::Range(0, tiles), body, tiles);
+
+    // Scatter back to the input order, the merge does not depend on the thread schedule
+    tracked.resize(n);
+    status.resize(n);
+    error.resize(n);
+    for (int k = 0; k < n; ++k) {
+        const int i = _tile_order[k];
+        tracked[i] = _tile_tracked[k];
+        status[i] = _tile_status[k];
+        error[i] = _tile_error[k];
+    }
+}
+
+DenseDISBackend::DenseDISBackend()
+    : _dis(cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_FAST)),
+      _prev(),
+      _curr(),
+      _flow(),
+      _back_flow() {
+}
+
+void DenseDISBackend::configure(cv::Size win_size, int max_level,
+                                const cv::TermCriteria &criteria) {
+    // DIS uses its own patch size and scale schedule from the preset
+    (void)win_size;
+    (void)max_level;
+    (void)criteria;
+    _prev.release();
+}
+
+void DenseDISBackend::setReference(const cv::Mat &gray) {
+    _prev = gray;
+}
+
+void DenseDISBackend::prepare(const cv::Mat &gray) {
+    _curr = gray;
+}
+
+void DenseDISBackend::track(const std::vector<cv::Point2f> &prev, std::vector<cv::Point2f> &next,
+                            std::vector<uchar> &status, std::vector<float> &error) {
+    const size_t n = prev.size();
+    next.resize(n);
+    status.resize(n);
+    error.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    _dis->calc(_prev, _curr, _flow);
+    for (size_t i = 0; i < n; ++i) {
+        status[i] = displace(_flow, prev[i], next[i]);
+        error[i] = 0.0f;
+    }
+}
+
+void DenseDISBackend::trackBack(const std::vector<cv::Point2f> &next,
+                                std::vector<cv::Point2f> &back, std::vector<uchar> &status) {
+    const size_t n = next.size();
+    back.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    // The dense field only holds the forward motion, the reverse needs its own
+    _dis->calc(_curr, _prev, _back_flow);
+    for (size_t i = 0; i < n; ++i) {
+        if (!displace(_back_flow, next[i], back[i])) {
+            status[i] = 0;
+        }
+    }
+}
+
+void DenseDISBackend::advance() {
+    std::swap(_prev, _curr);
+}
+
+#ifdef HAVE_OPENCV_CUDAOPTFLOW
+CudaSparseLKBackend::CudaSparseLKBackend()
+    : _lk(cv::cuda::SparsePyrLKOpticalFlow::create()),
+      _max_level(3),
+      _max_iterations(30),
+      _stream(),
+      _frame_staging(cv::cuda::HostMem::PAGE_LOCKED),
+      _points_staging(cv::cuda::HostMem::PAGE_LOCKED),
+      _next_staging(cv::cuda::HostMem::PAGE_LOCKED),
+      _status_staging(cv::cuda::HostMem::PAGE_LOCKED),
+      _error_staging(cv::cuda::HostMem::PAGE_LOCKED),
+      _back_staging(cv::cuda::HostMem::PAGE_LOCKED) {
+}
+
+void CudaSparseLKBackend::configure(cv::Size win_size, int max_level,
+                                    const cv::TermCriteria &criteria) {
+    _lk->setWinSize(win_size);
+    _lk->setMaxLevel(max_level);
+    _lk->setNumIters(criteria.maxCount);
+    _max_level = max_level;
+    _max_iterations = criteria.maxCount;
+    _prev_frame.release();
+}
+
+void CudaSparseLKBackend::setBudget(int max_level, int max_iterations) {
+    // Pyramids are built inside every calc(), the settings apply immediately
+    _lk->setMaxLevel(std::min(std::max(0, max_level), _max_level));
+    _lk->setNumIters(std::min(std::max(1, max_iterations), _max_iterations));
+}
+
+void CudaSparseLKBackend::upload(const cv::Mat &gray, cv::cuda::GpuMat &frame) {
+    // The staging buffer is reused, its previous upload completed in track()
+    _frame_staging.create(gray.rows, gray.cols, CV_8UC1);
+    cv::Mat staged = _frame_staging.createMatHeader();
+    gray.copyTo(staged);
+    frame.upload(_frame_staging, _stream);
+}
+
+void CudaSparseLKBackend::setReference(const cv::Mat &gray) {
+    upload(gray, _prev_frame);
+    _stream.waitForCompletion();
+}
+
+void CudaSparseLKBackend::prepare(const cv::Mat &gray) {
+    upload(gray, _curr_frame);
+}
+
+void CudaSparseLKBackend::track(const std::vector<cv::Point2f> &prev,
+                                std::vector<cv::Point2f> &next,
+                                std::vector<uchar> &status, std::vector<float> &error) {
+    const int n = static_cast<int>(prev.size());
+    next.resize(n);
+    status.resize(n);
+    error.resize(n);
+    if (n == 0) {
+        _stream.waitForCompletion();
+        return;
+    }
+
+    _points_staging.create(1, n, CV_32FC2);
+    std::memcpy(_points_staging.data, prev.data(), n * sizeof(cv::Point2f));
+    _prev_points.upload(_points_staging, _stream);
+
+    _lk->calc(_prev_frame, _curr_frame, _prev_points, _next_points, _status, _error, _stream);
+
+    _next_staging.create(1, n, CV_32FC2);
+    _status_staging.create(1, n, CV_8UC1);
+    _error_staging.create(1, n, CV_32FC1);
+    _next_points.download(_next_staging, _stream);
+    _status.download(_status_staging, _stream);
+    _error.download(_error_staging, _stream);
+    _stream.waitForCompletion();
+
+    std::memcpy(next.data(), _next_staging.data, n * sizeof(cv::Point2f));
+    std::memcpy(status.data(), _status_staging.data, n * sizeof(uchar));
+    std::memcpy(error.data(), _error_staging.data, n * sizeof(float));
+}
+
+void CudaSparseLKBackend::trackBack(const std::vector<cv::Point2f> &next,
+                                    std::vector<cv::Point2f> &back,
+                                    std::vector<uchar> &status) {
+    const int n = static_cast<int>(next.size());
+    back.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    // The forward output is still on the device, only the results come back
+    _lk->calc(_curr_frame, _prev_frame, _next_points, _back_points, _back_status,
+              cv::noArray(), _stream);
+
+    _back_staging.create(1, n, CV_32FC2);
+    _status_staging.create(1, n, CV_8UC1);
+    _back_points.download(_back_staging, _stream);
+    _back_status.download(_status_staging, _stream);
+    _stream.waitForCompletion();
+
+    std::memcpy(back.data(), _back_staging.data, n * sizeof(cv::Point2f));
+    const uchar* back_status = _status_staging.data;
+    for (int i = 0; i < n; ++i) {
+        status[i] = status[i] && back_status[i];
+    }
+}
+
+void CudaSparseLKBackend::advance() {
+    _prev_frame.swap(_curr_frame);
+}
+#endif
@@ -0,0 +1,128 @@
+/**
+ * @file frame_prefetcher.cpp
+ * @brief Implementation of the background frame reader
+ *
+ * This file implements the FramePrefetcher class methods.
+ */
+
+#include "frame_prefetcher.hpp"
+#include <utility>
+
+FramePrefetcher::FramePrefetcher(std::unique_ptr<FrameSource> source,
+                                 const ImageIngestion &ingestion)
+    : _source(std::move(source)),
+      _ingestion(ingestion),
+      _live(_source->isLive()),
+      _slots(),
+      _ready(),
+      _ready_head(0),
+      _ready_count(0),
+      _free(),
+      _free_count(0),
+      _dropped(0),
+      _error(),
+      _finished(false),
+      _stop(false),
+      _thread() {
+    for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+        _slots[slot].create(ingestion.outputSize(), CV_8UC1);
+        _free[_free_count++] = slot;
+    }
+    _thread = std::thread(&FramePrefetcher::run, this);
+}
+
+FramePrefetcher::~FramePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _slot_cv.notify_all();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+bool FramePrefetcher::pop(cv::Mat &dst) {
+    int slot = -1;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _frame_cv.wait(lock, [this] { return _ready_count > 0 || _finished; });
+        if (_ready_count == 0) {
+            return false;
+        }
+        slot = _ready[_ready_head];
+        _ready_head = (_ready_head + 1) % NUM_SLOTS;
+        _ready_count--;
+    }
+
+    // The slot is neither queued nor free, the worker leaves it alone
+    _slots[slot].copyTo(dst);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free[_free_count++] = slot;
+    }
+    _slot_cv.notify_one();
+    return true;
+}
+
+uint64_t FramePrefetcher::dropped() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _dropped;
+}
+
+void FramePrefetcher::run() {
+    cv::Mat frame;
+    for (;;) {
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            // The spare slot is for the frame being copied out, not for reading further ahead
+            _slot_cv.wait(lock, [this] {
+                return _stop || (_free_count > 0 && _ready_count < QUEUE_CAPACITY) ||
+                       (_live && _ready_count > 0);
+            });
+            if (_stop) {
+                return;
+            }
+            if (_free_count > 0 && _ready_count < QUEUE_CAPACITY) {
+                slot = _free[--_free_count];
+            } else {
+                // Live source and nobody consuming: recycle the stalest frame
+                slot = _ready[_ready_head];
+                _ready_head = (_ready_head + 1) % NUM_SLOTS;
+                _ready_count--;
+                _dropped++;
+            }
+        }
+
+        // Decoding, I/O and ingestion run without the lock
+        bool ok = false;
+        std::string error;
+        try {
+            ok = _source->read(frame);
+            if (ok) {
+                _ingestion.ingest(frame, _slots[slot]);
+            }
+        } catch (const std::exception &e) {
+            ok = false;
+            error = e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!ok) {
+                _free[_free_count++] = slot;
+                _error = error;
+                _finished = true;
+            } else {
+                _ready[(_ready_head + _ready_count) % NUM_SLOTS] = slot;
+                _ready_count++;
+            }
+        }
+        _frame_cv.notify_one();
+        if (!ok) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,247 @@
+/**
+ * @file frame_source.cpp
+ * @brief Implementation of the frame sources
+ *
+ * This file implements the FrameSource factory, the cv::VideoCapture source
+ * and the memory-mapped raw frame file source.
+ */
+
+#include "frame_source.hpp"
+#include <opencv2/imgproc.hpp>
+#include <cctype>
+#include <cstdlib>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Check whether a string is a non-negative decimal number
+ */
+bool isIndex(const std::string &text) {
+    if (text.empty()) {
+        return false;
+    }
+    for (const char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether a specification starts with a scheme prefix
+ */
+bool hasPrefix(const std::string &spec, const char* prefix, std::string &rest) {
+    const std::string head(prefix);
+    if (spec.compare(0, head.size(), head) != 0) {
+        return false;
+    }
+    rest = spec.substr(head.size());
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<FrameSource> FrameSource::open(const std::string &spec, cv::Size frame_size) {
+    std::string target;
+    if (hasPrefix(spec, "raw:", target)) {
+        return std::unique_ptr<FrameSource>(new RawFileSource(target, frame_size));
+    }
+    if (hasPrefix(spec, "v4l2:", target)) {
+        if (isIndex(target)) {
+            return std::unique_ptr<FrameSource>(new VideoCaptureSource(
+                std::atoi(target.c_str()), cv::CAP_V4L2, frame_size));
+        }
+        return std::unique_ptr<FrameSource>(new VideoCaptureSource(
+            target, cv::CAP_V4L2, frame_size));
+    }
+    if (isIndex(spec)) {
+        return std::unique_ptr<FrameSource>(new VideoCaptureSource(
+            std::atoi(spec.c_str()), cv::CAP_ANY, frame_size));
+    }
+    return std::unique_ptr<FrameSource>(new VideoCaptureSource(spec, cv::CAP_ANY, frame_size));
+}
+
+VideoCaptureSource::VideoCaptureSource(const std::string &path, int api, cv::Size frame_size)
+    : _capture(),
+      _frame_size(frame_size),
+      _live(api == cv::CAP_V4L2),
+      _decoded(),
+      _gray() {
+    if (!_capture.open(path, api)) {
+        CV_Error(cv::Error::StsError, "Could not open the frame source " + path);
+    }
+    if (_live) {
+        _capture.set(cv::CAP_PROP_FRAME_WIDTH, frame_size.width);
+        _capture.set(cv::CAP_PROP_FRAME_HEIGHT, frame_size.height);
+    }
+}
+
+VideoCaptureSource::VideoCaptureSource(int index, int api, cv::Size frame_size)
+    : _capture(),
+      _frame_size(frame_size),
+      _live(true),
+      _decoded(),
+      _gray() {
+    if (!_capture.open(index, api)) {
+        CV_Error(cv::Error::StsError, "Could not open camera " + std::to_string(index));
+    }
+    _capture.set(cv::CAP_PROP_FRAME_WIDTH, frame_size.width);
+    _capture.set(cv::CAP_PROP_FRAME_HEIGHT, frame_size.height);
+
+    // The prefetcher provides the queue, a driver-side queue only adds latency
+    _capture.set(cv::CAP_PROP_BUFFERSIZE, 1);
+}
+
+bool VideoCaptureSource::read(cv::Mat &frame) {
+    if (!_capture.read(_decoded) || _decoded.empty()) {
+        return false;
+    }
+    if (_decoded.cols != _frame_size.width || _decoded.rows != _frame_size.height) {
+        CV_Error(cv::Error::StsBadSize, "Frame source delivers frames of another size than the block's image size");
+    }
+
+    switch (_decoded.channels()) {
+        case 1:
+            frame = _decoded;
+            break;
+        case 3:
+            cv::cvtColor(_decoded, _gray, cv::COLOR_BGR2GRAY);
+            frame = _gray;
+            break;
+        case 4:
+            cv::cvtColor(_decoded, _gray, cv::COLOR_BGRA2GRAY);
+            frame = _gray;
+            break;
+        default:
+            CV_Error(cv::Error::StsUnsupportedFormat, "Unsupported number of channels in the frame source");
+    }
+    if (frame.depth() != CV_8U) {
+        CV_Error(cv::Error::StsUnsupportedFormat, "Frame source must deliver 8-bit frames");
+    }
+    return true;
+}
+
+RawFileSource::RawFileSource(const std::string &path, cv::Size frame_size)
+    : _frame_size(frame_size),
+      _frame_bytes(static_cast<size_t>(frame_size.area())),
+      _frame_count(0),
+      _next(0),
+      _data(nullptr),
+      _mapped_bytes(0),
+#ifdef _WIN32
+      _file(INVALID_HANDLE_VALUE),
+      _mapping(nullptr) {
+#else
+      _fd(-1) {
+#endif
+    CV_Assert(_frame_bytes > 0);
+
+#ifdef _WIN32
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER file_size;
+    if (_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file, &file_size)) {
+        if (_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(_file);
+        }
+        CV_Error(cv::Error::StsError, "Could not open the raw frame file " + path);
+    }
+    _frame_count = static_cast<size_t>(file_size.QuadPart) / _frame_bytes;
+#else
+    _fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (_fd < 0 || fstat(_fd, &info) != 0) {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+        CV_Error(cv::Error::StsError, "Could not open the raw frame file " + path);
+    }
+    _frame_count = static_cast<size_t>(info.st_size) / _frame_bytes;
+#endif
+
+    _mapped_bytes = _frame_count * _frame_bytes;
+    if (_mapped_bytes == 0) {
+        return;
+    }
+
+#ifdef _WIN32
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping != nullptr) {
+        _data = static_cast<uchar*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, _mapped_bytes));
+    }
+    if (_data == nullptr) {
+        if (_mapping != nullptr) {
+            CloseHandle(_mapping);
+        }
+        CloseHandle(_file);
+        CV_Error(cv::Error::StsError, "Could not map the raw frame file " + path);
+    }
+#else
+    void* data = mmap(nullptr, _mapped_bytes, PROT_READ, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(_fd);
+        CV_Error(cv::Error::StsError, "Could not map the raw frame file " + path);
+    }
+    _data = static_cast<uchar*>(data);
+
+    // Frames are consumed in order, let the kernel read ahead aggressively
+    madvise(_data, _mapped_bytes, MADV_SEQUENTIAL);
+#endif
+}
+
+RawFileSource::~RawFileSource() {
+#ifdef _WIN32
+    if (_data != nullptr) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping != nullptr) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+#else
+    if (_data != nullptr) {
+        munmap(_data, _mapped_bytes);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+#endif
+}
+
+bool RawFileSource::read(cv::Mat &frame) {
+    if (_next >= _frame_count) {
+        return false;
+    }
+    uchar* data = _data + _next * _frame_bytes;
+    frame = cv::Mat(_frame_size, CV_8UC1, data);
+    _next++;
+
+#ifndef _WIN32
+    // Start paging in the following frame while this one is processed
+    if (_next < _frame_count) {
+        const long page = sysconf(_SC_PAGESIZE);
+        const size_t offset = _next * _frame_bytes;
+        const size_t aligned = offset / page * page;
+        madvise(_data + aligned, offset - aligned + _frame_bytes, MADV_WILLNEED);
+    }
+#endif
+    return true;
+}
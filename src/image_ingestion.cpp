@@ -0,0 +1,344 @@
+/**
+ * @file image_ingestion.cpp
+ * @brief Implementation of the Simulink to OpenCV image conversion stage
+ *
+ * This file implements the tiled column-major to row-major transpose and the
+ * vectorized scale/clamp/narrow kernels used by ImageIngestion.
+ */
+
+#include "image_ingestion.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Scale, clamp and truncate a contiguous run of doubles to 8 bits
+ *
+ * Matches static_cast<uchar>(clamp(src[i] * scale, 0.0, 255.0)) exactly,
+ * including truncation toward zero, so all code paths are bit-identical.
+ */
+void convertRun(const double* src, uchar* dst, int n, double scale) {
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256d vscale = _mm256_set1_pd(scale);
+    const __m256d vmin = _mm256_setzero_pd();
+    const __m256d vmax = _mm256_set1_pd(255.0);
+    for (; i + 16 <= n; i += 16) {
+        __m128i q0 = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(src + i), vscale), vmin), vmax));
+        __m128i q1 = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(src + i + 4), vscale), vmin), vmax));
+        __m128i q2 = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(src + i + 8), vscale), vmin), vmax));
+        __m128i q3 = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(
+            _mm256_mul_pd(_mm256_loadu_pd(src + i + 12), vscale), vmin), vmax));
+        __m128i w0 = _mm_packus_epi32(q0, q1);
+        __m128i w1 = _mm_packus_epi32(q2, q3);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(w0, w1));
+    }
+#elif defined(__SSE4_1__)
+    const __m128d vscale = _mm_set1_pd(scale);
+    const __m128d vmin = _mm_setzero_pd();
+    const __m128d vmax = _mm_set1_pd(255.0);
+    for (; i + 8 <= n; i += 8) {
+        __m128i q0 = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(
+            _mm_mul_pd(_mm_loadu_pd(src + i), vscale), vmin), vmax));
+        __m128i q1 = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(
+            _mm_mul_pd(_mm_loadu_pd(src + i + 2), vscale), vmin), vmax));
+        __m128i q2 = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(
+            _mm_mul_pd(_mm_loadu_pd(src + i + 4), vscale), vmin), vmax));
+        __m128i q3 = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(
+            _mm_mul_pd(_mm_loadu_pd(src + i + 6), vscale), vmin), vmax));
+        __m128i w = _mm_packus_epi32(_mm_unpacklo_epi64(q0, q1), _mm_unpacklo_epi64(q2, q3));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(w, w));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float64x2_t vscale = vdupq_n_f64(scale);
+    const float64x2_t vmin = vdupq_n_f64(0.0);
+    const float64x2_t vmax = vdupq_n_f64(255.0);
+    for (; i + 8 <= n; i += 8) {
+        uint32x2_t q0 = vmovn_u64(vcvtq_u64_f64(vminq_f64(vmaxq_f64(
+            vmulq_f64(vld1q_f64(src + i), vscale), vmin), vmax)));
+        uint32x2_t q1 = vmovn_u64(vcvtq_u64_f64(vminq_f64(vmaxq_f64(
+            vmulq_f64(vld1q_f64(src + i + 2), vscale), vmin), vmax)));
+        uint32x2_t q2 = vmovn_u64(vcvtq_u64_f64(vminq_f64(vmaxq_f64(
+            vmulq_f64(vld1q_f64(src + i + 4), vscale), vmin), vmax)));
+        uint32x2_t q3 = vmovn_u64(vcvtq_u64_f64(vminq_f64(vmaxq_f64(
+            vmulq_f64(vld1q_f64(src + i + 6), vscale), vmin), vmax)));
+        uint16x8_t w = vcombine_u16(vmovn_u32(vcombine_u32(q0, q1)),
+                                    vmovn_u32(vcombine_u32(q2, q3)));
+        vst1_u8(dst + i, vmovn_u16(w));
+    }
+#endif
+
+    // Scalar tail (and full fallback when no SIMD extension is available)
+    for (; i < n; ++i) {
+        const double v = src[i] * scale;
+        dst[i] = static_cast<uchar>((v < 0.0) ? 0.0 : (v > 255.0) ? 255.0 : v);
+    }
+}
+
+/**
+ * @brief Scale, clamp and truncate a contiguous run of floats to 8 bits
+ */
+void convertRun(const float* src, uchar* dst, int n, float scale) {
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vmin = _mm256_setzero_ps();
+    const __m256 vmax = _mm256_set1_ps(255.0f);
+    for (; i + 16 <= n; i += 16) {
+        __m256i q0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(src + i), vscale), vmin), vmax));
+        __m256i q1 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), vscale), vmin), vmax));
+        // 256-bit packs operate per 128-bit lane, restore element order
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(q0, q1), 0xD8);
+        __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                     _mm256_extracti128_si256(w, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), b);
+    }
+#elif defined(__SSE4_1__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmin = _mm_setzero_ps();
+    const __m128 vmax = _mm_set1_ps(255.0f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i q0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(src + i), vscale), vmin), vmax));
+        __m128i q1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(src + i + 4), vscale), vmin), vmax));
+        __m128i q2 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(src + i + 8), vscale), vmin), vmax));
+        __m128i q3 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+            _mm_mul_ps(_mm_loadu_ps(src + i + 12), vscale), vmin), vmax));
+        __m128i b = _mm_packus_epi16(_mm_packus_epi32(q0, q1), _mm_packus_epi32(q2, q3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), b);
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vmin = vdupq_n_f32(0.0f);
+    const float32x4_t vmax = vdupq_n_f32(255.0f);
+    for (; i + 8 <= n; i += 8) {
+        uint32x4_t q0 = vcvtq_u32_f32(vminq_f32(vmaxq_f32(
+            vmulq_f32(vld1q_f32(src + i), vscale), vmin), vmax));
+        uint32x4_t q1 = vcvtq_u32_f32(vminq_f32(vmaxq_f32(
+            vmulq_f32(vld1q_f32(src + i + 4), vscale), vmin), vmax));
+        vst1_u8(dst + i, vmovn_u16(vcombine_u16(vmovn_u32(q0), vmovn_u32(q1))));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const float v = src[i] * scale;
+        dst[i] = static_cast<uchar>((v < 0.0f) ? 0.0f : (v > 255.0f) ? 255.0f : v);
+    }
+}
+
+/**
+ * @brief Transpose a converted tile into the destination rows
+ *
+ * @param tile Tile stored column by column with a stride of TILE_SIZE
+ * @param tr Number of valid tile rows
+ * @param tc Number of valid tile columns
+ * @param r0 First destination row
+ * @param c0 First destination column
+ * @param dst Destination image
+ */
+void storeTile(const uchar* tile, int tr, int tc, int r0, int c0, cv::Mat& dst) {
+    constexpr int T_SIZE = ImageIngestion::TILE_SIZE;
+    for (int i = 0; i < tr; ++i) {
+        uchar* row = dst.ptr<uchar>(r0 + i) + c0;
+        for (int j = 0; j < tc; ++j) {
+            row[j] = tile[j * T_SIZE + i];
+        }
+    }
+}
+
+/**
+ * @brief Tiled column-major to row-major conversion
+ *
+ * Each source column segment of a tile is converted with the vectorized
+ * kernel into a small stack buffer, which is then transposed into the
+ * destination rows while it is still in L1.
+ *
+ * @param src First pixel of the converted region
+ * @param stride Distance between source columns (source image height)
+ */
+template <typename T, typename S>
+void ingestTiled(const T* src, size_t stride, int height, int width, S scale, cv::Mat& dst) {
+    constexpr int T_SIZE = ImageIngestion::TILE_SIZE;
+    uchar tile[T_SIZE * T_SIZE];
+
+    for (int c0 = 0; c0 < width; c0 += T_SIZE) {
+        const int tc = std::min(T_SIZE, width - c0);
+        for (int r0 = 0; r0 < height; r0 += T_SIZE) {
+            const int tr = std::min(T_SIZE, height - r0);
+
+            // Convert the contiguous column segments of this tile
+            for (int j = 0; j < tc; ++j) {
+                convertRun(src + static_cast<size_t>(c0 + j) * stride + r0,
+                           tile + j * T_SIZE, tr, scale);
+            }
+
+            storeTile(tile, tr, tc, r0, c0, dst);
+        }
+    }
+}
+
+/**
+ * @brief Tiled conversion with area-averaging decimation
+ *
+ * Every output pixel is the mean of a decimation x decimation source block.
+ * The blocks of one output column are summed down the contiguous source
+ * columns, then scaled, clamped and truncated as in convertRun before the
+ * tile is transposed into the destination rows.
+ *
+ * @param src First pixel of the converted region
+ * @param stride Distance between source columns (source image height)
+ * @param size Output size
+ * @param decimation Edge length of the averaged source blocks
+ * @param scale Factor mapping source values to 0-255
+ */
+template <typename T, typename S>
+void ingestDecimated(const T* src, size_t stride, cv::Size size, int decimation,
+                     S scale, cv::Mat& dst) {
+    constexpr int T_SIZE = ImageIngestion::TILE_SIZE;
+    uchar tile[T_SIZE * T_SIZE];
+    S sums[T_SIZE];
+    const S norm = scale / static_cast<S>(decimation * decimation);
+
+    for (int c0 = 0; c0 < size.width; c0 += T_SIZE) {
+        const int tc = std::min(T_SIZE, size.width - c0);
+        for (int r0 = 0; r0 < size.height; r0 += T_SIZE) {
+            const int tr = std::min(T_SIZE, size.height - r0);
+
+            for (int j = 0; j < tc; ++j) {
+                std::fill(sums, sums + tr, static_cast<S>(0));
+
+                // Accumulate the source columns of this output column
+                for (int k = 0; k < decimation; ++k) {
+                    const T* col = src + static_cast<size_t>((c0 + j) * decimation + k) * stride +
+                                   static_cast<size_t>(r0) * decimation;
+                    for (int i = 0; i < tr; ++i) {
+                        const T* block = col + i * decimation;
+                        S acc = 0;
+                        for (int m = 0; m < decimation; ++m) {
+                            acc += static_cast<S>(block[m]);
+                        }
+                        sums[i] += acc;
+                    }
+                }
+
+                for (int i = 0; i < tr; ++i) {
+                    const S v = sums[i] * norm;
+                    tile[j * T_SIZE + i] = static_cast<uchar>((v < 0) ? 0 : (v > 255) ? 255 : v);
+                }
+            }
+
+            storeTile(tile, tr, tc, r0, c0, dst);
+        }
+    }
+}
+
+} // namespace
+
+ImageIngestion::ImageIngestion(int height, int width)
+    : ImageIngestion(height, width, cv::Rect(0, 0, width, height), 1) {
+}
+
+ImageIngestion::ImageIngestion(int height, int width, const cv::Rect& roi, int decimation)
+    : _height(height),
+      _width(width),
+      _roi(roi),
+      _decimation(decimation),
+      _output_size() {
+    CV_Assert(decimation >= 1);
+    CV_Assert(roi.x >= 0 && roi.y >= 0 && roi.width > 0 && roi.height > 0 &&
+              roi.x + roi.width <= width && roi.y + roi.height <= height);
+
+    _output_size = cv::Size(roi.width / decimation, roi.height / decimation);
+    CV_Assert(_output_size.width > 0 && _output_size.height > 0);
+}
+
+void ImageIngestion::ingest(const double* src, cv::Mat& dst) const {
+    dst.create(_output_size, CV_8UC1);
+    const double* origin = src + static_cast<size_t>(_roi.x) * _height + _roi.y;
+    if (_decimation == 1) {
+        ingestTiled(origin, _height, _output_size.height, _output_size.width, 255.0, dst);
+    } else {
+        ingestDecimated(origin, _height, _output_size, _decimation, 255.0, dst);
+    }
+}
+
+void ImageIngestion::ingest(const float* src, cv::Mat& dst) const {
+    dst.create(_output_size, CV_8UC1);
+    const float* origin = src + static_cast<size_t>(_roi.x) * _height + _roi.y;
+    if (_decimation == 1) {
+        ingestTiled(origin, _height, _output_size.height, _output_size.width, 255.0f, dst);
+    } else {
+        ingestDecimated(origin, _height, _output_size, _decimation, 255.0f, dst);
+    }
+}
+
+void ImageIngestion::ingest(const uint8_t* src, cv::Mat& dst) const {
+    constexpr int T_SIZE = TILE_SIZE;
+    dst.create(_output_size, CV_8UC1);
+    const uint8_t* origin = src + static_cast<size_t>(_roi.x) * _height + _roi.y;
+
+    // Average in float, the block sums of 8-bit pixels are exact
+    if (_decimation != 1) {
+        ingestDecimated(origin, _height, _output_size, _decimation, 1.0f, dst);
+        return;
+    }
+
+    // No value conversion needed, transpose directly tile by tile
+    for (int c0 = 0; c0 < _output_size.width; c0 += T_SIZE) {
+        const int tc = std::min(T_SIZE, _output_size.width - c0);
+        for (int r0 = 0; r0 < _output_size.height; r0 += T_SIZE) {
+            const int tr = std::min(T_SIZE, _output_size.height - r0);
+            const uint8_t* col = origin + static_cast<size_t>(c0) * _height + r0;
+            for (int i = 0; i < tr; ++i) {
+                uchar* row = dst.ptr<uchar>(r0 + i) + c0;
+                for (int j = 0; j < tc; ++j) {
+                    row[j] = col[static_cast<size_t>(j) * _height + i];
+                }
+            }
+        }
+    }
+}
+
+void ImageIngestion::ingest(const cv::Mat& src, cv::Mat& dst) const {
+    CV_Assert(src.type() == CV_8UC1 && src.rows == _height && src.cols == _width);
+    dst.create(_output_size, CV_8UC1);
+
+    if (_decimation == 1) {
+        src(_roi).copyTo(dst);
+        return;
+    }
+
+    // Same float block average as the column-major path, only the summation order differs
+    const float norm = 1.0f / static_cast<float>(_decimation * _decimation);
+    for (int r = 0; r < _output_size.height; ++r) {
+        uchar* row = dst.ptr<uchar>(r);
+        for (int c = 0; c < _output_size.width; ++c) {
+            float sum = 0.0f;
+            for (int k = 0; k < _decimation; ++k) {
+                const uchar* block = src.ptr<uchar>(_roi.y + r * _decimation + k) +
+                                     _roi.x + c * _decimation;
+                for (int m = 0; m < _decimation; ++m) {
+                    sum += static_cast<float>(block[m]);
+                }
+            }
+            const float v = sum * norm;
+            row[c] = static_cast<uchar>((v > 255.0f) ? 255.0f : v);
+        }
+    }
+}
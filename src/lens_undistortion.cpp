@@ -0,0 +1,88 @@
+/**
+ * @file lens_undistortion.cpp
+ * @brief Implementation of the feature undistortion grid
+ *
+ * This file implements the grid construction of LensUndistortion, the
+ * lookup itself is inline in the header.
+ */
+
+#include "lens_undistortion.hpp"
+#include <opencv2/calib3d.hpp>
+
+LensUndistortion::LensUndistortion()
+    : _enabled(false),
+      _dirty(false),
+      _camera_matrix(),
+      _dist_coeffs(),
+      _sensor_size(),
+      _roi(),
+      _frame_size(),
+      _cols(0),
+      _rows(0),
+      _inv_step(1.0f / GRID_STEP),
+      _grid() {
+}
+
+void LensUndistortion::setModel(const cv::Matx33d &camera_matrix,
+                                const std::vector<double> &dist_coeffs) {
+    _camera_matrix = camera_matrix;
+    _dist_coeffs = dist_coeffs;
+    _enabled = true;
+    _dirty = true;
+    _grid.clear();
+}
+
+void LensUndistortion::clear() {
+    _enabled = false;
+    _dirty = false;
+    _grid.clear();
+    _grid.shrink_to_fit();
+}
+
+void LensUndistortion::configure(cv::Size sensor_size, const cv::Rect &roi, cv::Size frame_size) {
+    if (!_enabled || frame_size.width <= 0 || frame_size.height <= 0) {
+        return;
+    }
+    // Called on every re-detection, the grid only changes with the model or the geometry
+    if (!_dirty && !_grid.empty() && sensor_size == _sensor_size && roi == _roi &&
+        frame_size == _frame_size) {
+        return;
+    }
+    _sensor_size = sensor_size;
+    _roi = roi;
+    _frame_size = frame_size;
+    _dirty = false;
+
+    // Nodes cover the frame and one step past its far border
+    _cols = (frame_size.width + GRID_STEP - 1) / GRID_STEP + 1;
+    _rows = (frame_size.height + GRID_STEP - 1) / GRID_STEP + 1;
+
+    // Node centers in sensor pixels, frame pixels may be decimated
+    const double scale_x = static_cast<double>(roi.width) / frame_size.width;
+    const double scale_y = static_cast<double>(roi.height) / frame_size.height;
+    std::vector<cv::Point2f> nodes;
+    nodes.reserve(static_cast<size_t>(_cols) * _rows);
+    for (int r = 0; r < _rows; ++r) {
+        for (int c = 0; c < _cols; ++c) {
+            nodes.emplace_back(
+                static_cast<float>(roi.x + (c * GRID_STEP + 0.5) * scale_x - 0.5),
+                static_cast<float>(roi.y + (r * GRID_STEP + 0.5) * scale_y - 0.5));
+        }
+    }
+
+    // Normalized undistorted coordinates, iterated to convergence for wide-angle lenses
+    std::vector<cv::Point2f> undistorted;
+#if CV_VERSION_MAJOR >= 4
+    cv::undistortPoints(nodes, undistorted, _camera_matrix, _dist_coeffs, cv::noArray(),
+                        cv::noArray(),
+                        cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 50, 1e-9));
+#else
+    cv::undistortPoints(nodes, undistorted, _camera_matrix, _dist_coeffs);
+#endif
+
+    _grid.resize(2 * undistorted.size());
+    for (size_t i = 0; i < undistorted.size(); ++i) {
+        _grid[2 * i] = std::atan(undistorted[i].x);
+        _grid[2 * i + 1] = std::atan(undistorted[i].y);
+    }
+}
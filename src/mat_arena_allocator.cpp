@@ -0,0 +1,276 @@
+/**
+ * @file mat_arena_allocator.cpp
+ * @brief Implementation of the pooled cv::Mat allocator
+ *
+ * This file implements the MatArenaAllocator class methods.
+ */
+
+#include "mat_arena_allocator.hpp"
+#include <cstring>
+#include <new>
+
+MatArenaAllocator& MatArenaAllocator::instance() {
+    static MatArenaAllocator allocator;
+    return allocator;
+}
+
+MatArenaAllocator::MatArenaAllocator()
+    : _mutex(),
+      _free(),
+      _chunks(nullptr),
+      _cursor(nullptr),
+      _end(nullptr),
+      _capacity(0),
+      _live(0),
+      _system_allocations(0),
+      _generation(1),
+      _reserved(0),
+      _users(0),
+      _previous(nullptr) {
+}
+
+MatArenaAllocator::~MatArenaAllocator() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_users > 0) {
+        cv::Mat::setDefaultAllocator(_previous);
+    }
+
+    // Mats still referencing the arena at unload would dangle, keep it then
+    if (_live.load() == 0) {
+        releaseMemory();
+    }
+}
+
+MatArenaAllocator::ThreadCache& MatArenaAllocator::threadCache() {
+    // Zero generation never matches, the first use synchronizes the cache
+    static thread_local ThreadCache cache = {};
+    return cache;
+}
+
+int MatArenaAllocator::sizeClass(size_t bytes) {
+    int size_class = 0;
+    while (size_class < NUM_SIZE_CLASSES - 1 && (MIN_BLOCK_BYTES << size_class) < bytes) {
+        size_class++;
+    }
+    CV_Assert((MIN_BLOCK_BYTES << size_class) >= bytes);
+    return size_class;
+}
+
+void MatArenaAllocator::acquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _reserved += bytes;
+    if (_capacity < _reserved) {
+        grow(_reserved - _capacity);
+    }
+
+    if (_users++ == 0) {
+        _previous = cv::Mat::getDefaultAllocator();
+        cv::Mat::setDefaultAllocator(this);
+    }
+}
+
+void MatArenaAllocator::release() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_users == 0 || --_users > 0) {
+        return;
+    }
+
+    cv::Mat::setDefaultAllocator(_previous);
+    _previous = nullptr;
+    _reserved = 0;
+    if (_live.load() == 0) {
+        releaseMemory();
+    }
+}
+
+size_t MatArenaAllocator::capacity() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+uchar* MatArenaAllocator::obtain(size_t bytes) const {
+    // Linked through their own first bytes, recording them never allocates
+    uchar* memory = static_cast<uchar*>(cv::fastMalloc(CHUNK_HEADER_BYTES + bytes));
+    Chunk* chunk = reinterpret_cast<Chunk*>(memory);
+    chunk->next = _chunks;
+    _chunks = chunk;
+    _capacity += bytes;
+    return memory + CHUNK_HEADER_BYTES;
+}
+
+void MatArenaAllocator::grow(size_t bytes) {
+    // Whole blocks are carved, so chunks stay a multiple of the alignment
+    bytes = (bytes + BLOCK_HEADER_BYTES - 1) / BLOCK_HEADER_BYTES * BLOCK_HEADER_BYTES;
+    uchar* chunk = obtain(bytes);
+
+    // Touch every page now, so the first frames do not fault them in
+    std::memset(chunk, 0, bytes);
+
+    // Carving continues in the new chunk, the tail of the previous one stays unused
+    _cursor = chunk;
+    _end = chunk + bytes;
+}
+
+void MatArenaAllocator::releaseMemory() {
+    while (_chunks != nullptr) {
+        Chunk* next = _chunks->next;
+        cv::fastFree(_chunks);
+        _chunks = next;
+    }
+    for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+        _free[i] = nullptr;
+    }
+    _cursor = nullptr;
+    _end = nullptr;
+    _capacity = 0;
+
+    // Blocks still cached by any thread pointed into the memory just freed
+    _generation.fetch_add(1, std::memory_order_release);
+}
+
+void MatArenaAllocator::syncCache(ThreadCache& cache) const {
+    const uint64_t generation = _generation.load(std::memory_order_relaxed);
+    if (cache.generation != generation) {
+        cache = ThreadCache();
+        cache.generation = generation;
+    }
+}
+
+MatArenaAllocator::Block* MatArenaAllocator::takeShared(int size_class) const {
+    const size_t block_bytes = BLOCK_HEADER_BYTES + (MIN_BLOCK_BYTES << size_class);
+    Block* block = _free[size_class];
+    if (block != nullptr) {
+        _free[size_class] = block->next;
+    } else if (static_cast<size_t>(_end - _cursor) >= block_bytes) {
+        block = reinterpret_cast<Block*>(_cursor);
+        _cursor += block_bytes;
+    } else {
+        // Arena exhausted for this class, the block joins the pool once released
+        block = reinterpret_cast<Block*>(obtain(block_bytes));
+        _system_allocations++;
+    }
+    return block;
+}
+
+void* MatArenaAllocator::take(size_t bytes) const {
+    const int size_class = sizeClass(bytes);
+    Block* block = nullptr;
+    if (size_class < NUM_CACHED_CLASSES) {
+        ThreadCache& cache = threadCache();
+        if (cache.generation == _generation.load(std::memory_order_acquire) &&
+            cache.free[size_class] != nullptr) {
+            block = cache.free[size_class];
+            cache.free[size_class] = block->next;
+            cache.count[size_class]--;
+        } else {
+            // Refill half the cache, a thread that only allocates takes the lock less often
+            std::lock_guard<std::mutex> lock(_mutex);
+            syncCache(cache);
+            block = takeShared(size_class);
+            while (cache.count[size_class] < cacheLimit(size_class) / 2 &&
+                   _free[size_class] != nullptr) {
+                Block* spare = _free[size_class];
+                _free[size_class] = spare->next;
+                spare->next = cache.free[size_class];
+                cache.free[size_class] = spare;
+                cache.count[size_class]++;
+            }
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(_mutex);
+        block = takeShared(size_class);
+    }
+
+    block->size_class = size_class;
+    block->next = nullptr;
+    _live.fetch_add(1, std::memory_order_relaxed);
+    return reinterpret_cast<uchar*>(block) + BLOCK_HEADER_BYTES;
+}
+
+void MatArenaAllocator::give(void* payload) const {
+    Block* block = reinterpret_cast<Block*>(static_cast<uchar*>(payload) - BLOCK_HEADER_BYTES);
+    const int size_class = block->size_class;
+    _live.fetch_sub(1, std::memory_order_relaxed);
+    if (size_class < NUM_CACHED_CLASSES) {
+        ThreadCache& cache = threadCache();
+        if (cache.generation == _generation.load(std::memory_order_acquire) &&
+            cache.count[size_class] < cacheLimit(size_class)) {
+            block->next = cache.free[size_class];
+            cache.free[size_class] = block;
+            cache.count[size_class]++;
+            return;
+        }
+
+        // Full cache, hand half of it back so other threads find the blocks
+        std::lock_guard<std::mutex> lock(_mutex);
+        syncCache(cache);
+        while (cache.count[size_class] > cacheLimit(size_class) / 2) {
+            Block* spare = cache.free[size_class];
+            cache.free[size_class] = spare->next;
+            cache.count[size_class]--;
+            spare->next = _free[size_class];
+            _free[size_class] = spare;
+        }
+        block->next = cache.free[size_class];
+        cache.free[size_class] = block;
+        cache.count[size_class]++;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    block->next = _free[size_class];
+    _free[size_class] = block;
+}
+
+cv::UMatData* MatArenaAllocator::allocate(int dims, const int* sizes, int type, void* data,
+                                          size_t* step, cv::AccessFlag flags,
+                                          cv::UMatUsageFlags usage_flags) const {
+    (void)flags;
+    (void)usage_flags;
+
+    // Same step and size computation as the OpenCV standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step != nullptr) {
+            if (data != nullptr && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    uchar* buffer = (data != nullptr) ? static_cast<uchar*>(data)
+                                      : static_cast<uchar*>(take(total));
+
+    // The bookkeeping record comes from the pool too
+    cv::UMatData* u = new (take(sizeof(cv::UMatData))) cv::UMatData(this);
+    u->data = u->origdata = buffer;
+    u->size = total;
+    if (data != nullptr) {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool MatArenaAllocator::allocate(cv::UMatData* data, cv::AccessFlag access_flags,
+                                 cv::UMatUsageFlags usage_flags) const {
+    (void)access_flags;
+    (void)usage_flags;
+    return data != nullptr;
+}
+
+void MatArenaAllocator::deallocate(cv::UMatData* data) const {
+    if (data == nullptr) {
+        return;
+    }
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+        give(data->origdata);
+    }
+    data->~UMatData();
+    give(data);
+}
@@ -0,0 +1,303 @@
+/**
+ * @file optical_flow_codegen.cpp
+ * @brief Implementation of the C interface used by generated code
+ *
+ * This file implements the functions declared in optical_flow_codegen.h.
+ */
+
+#include "optical_flow_codegen.h"
+#include "block_tracker.hpp"
+#include "image_ingestion.hpp"
+#include "mat_arena_allocator.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+/**
+ * @brief Width of the robust ego velocity output
+ */
+constexpr int EGO_VELOCITY_WIDTH = 4;
+
+/**
+ * @brief Width of the per-stage timing output
+ */
+constexpr int STAGE_TIMING_WIDTH = StageProfiler::NUM_STAGES;
+
+/**
+ * @brief Width of the feature budget output
+ */
+constexpr int FEATURE_BUDGET_WIDTH = 3;
+
+/**
+ * @brief Trackers and ingestion stage of one block
+ */
+struct CodegenBlock {
+    ImageIngestion ingestion;       ///< Simulink to OpenCV conversion
+    TrackerBatch batch;             ///< Per-camera trackers, frames and results
+    float height_above_ground;      ///< Camera height above ground (meters)
+    bool rate_input;                ///< Angular rate passed to every step
+    bool single_features;           ///< Velocities written as float
+
+    CodegenBlock(const OpticalFlowCodegenConfig& config, const cv::Rect& roi,
+                 const std::vector<CameraIntrinsics>& cameras, cv::Size frame_size)
+        : ingestion(config.height, config.width, roi, config.decimation),
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+          batch(config.method, 1.0f, cameras[0], config.feature_procedure),
+#else
+          batch(config.method, 1.0f, cameras, frame_size.height, frame_size.width,
+                MAX_OUTPUT_FEATURES, config.feature_procedure),
+#endif
+          height_above_ground(static_cast<float>(config.height_above_ground)),
+          rate_input(config.rate_input != 0),
+          single_features(config.feature_single != 0) {
+        (void)frame_size;
+    }
+};
+
+/**
+ * @brief Layout of the caller-provided storage
+ */
+struct CodegenStorage {
+    CodegenBlock* block;            ///< Constructed block in `buffer`, null before init
+    bool arena_acquired;            ///< Mat arena acquired by init
+    char error[256];                ///< Last error message
+    alignas(CodegenBlock) unsigned char buffer[sizeof(CodegenBlock)]; ///< Block storage
+};
+
+/**
+ * @brief Aligned storage view of the caller's byte buffer
+ */
+CodegenStorage* storageOf(void* storage) {
+    const uintptr_t alignment = alignof(CodegenStorage);
+    const uintptr_t address = (reinterpret_cast<uintptr_t>(storage) + alignment - 1) &
+                              ~(alignment - 1);
+    return reinterpret_cast<CodegenStorage*>(address);
+}
+
+/**
+ * @brief Store an error message in the storage
+ */
+void setError(CodegenStorage& state, const char* message) {
+    std::snprintf(state.error, sizeof(state.error), "%s", message);
+}
+
+/**
+ * @brief Convert every camera plane of a column-major image
+ */
+template <typename T>
+void ingestAll(CodegenBlock& block, const T* image) {
+    const size_t plane_size =
+        static_cast<size_t>(block.ingestion.height()) * block.ingestion.width();
+    for (int camera = 0; camera < block.batch.size(); ++camera) {
+        OPTICAL_FLOW_PROFILE_SCOPE(&block.batch.tracker(camera).profiler(),
+                                   StageProfiler::STAGE_INGESTION);
+        block.ingestion.ingest(image + plane_size * camera, block.batch.frame(camera));
+    }
+}
+
+} // namespace
+
+size_t optical_flow_codegen_storage_size(void) {
+    // Room to align the storage inside an unaligned DWork vector
+    return sizeof(CodegenStorage) + alignof(CodegenStorage) - 1;
+}
+
+int optical_flow_codegen_init(void* storage, size_t storage_bytes,
+                              const OpticalFlowCodegenConfig* config) {
+    // Smaller than CodegenStorage, the aligned header may not fit and nothing can be reported
+    if (storage_bytes < sizeof(CodegenStorage)) {
+        return -1;
+    }
+    CodegenStorage& state = *storageOf(storage);
+    state.block = nullptr;
+    state.arena_acquired = false;
+    state.error[0] = '\0';
+    if (storage_bytes < optical_flow_codegen_storage_size()) {
+        setError(state, "Storage size mismatch, S-function and generated code built with "
+                        "different options.");
+        return -1;
+    }
+
+    const cv::Rect roi(config->roi[0], config->roi[1], config->roi[2], config->roi[3]);
+    if (config->num_cameras < 1 || config->decimation < 1 || roi.x < 0 || roi.y < 0 ||
+        roi.width < config->decimation || roi.height < config->decimation ||
+        roi.x + roi.width > config->width || roi.y + roi.height > config->height) {
+        setError(state, "Invalid image geometry.");
+        return -1;
+    }
+    const cv::Size sensor_size(config->width, config->height);
+    const cv::Size frame_size(roi.width / config->decimation, roi.height / config->decimation);
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+    if (config->num_cameras != 1 || frame_size.height != TrackerBatch::HEIGHT ||
+        frame_size.width != TrackerBatch::WIDTH) {
+        setError(state, "Processed frame size and single camera must match FIXED_FRAME_SIZE.");
+        return -1;
+    }
+#endif
+
+    std::vector<CameraIntrinsics> cameras(config->num_cameras);
+    for (int camera = 0; camera < config->num_cameras; ++camera) {
+        cameras[camera].focal_length = static_cast<float>(config->focal_length[camera]);
+        cameras[camera].cmos_width = static_cast<float>(config->cmos_width[camera]);
+        cameras[camera].cmos_height = static_cast<float>(config->cmos_height[camera]);
+    }
+
+    // Same arena sizing as mdlStart, every cv::Mat from here on is served from it
+    MatArenaAllocator::instance().acquire(
+        config->num_cameras * MatArenaAllocator::frameBudget(frame_size));
+    state.arena_acquired = true;
+
+    try {
+        CodegenBlock* block = new (state.buffer) CodegenBlock(*config, roi, cameras, frame_size);
+        state.block = block;
+        TrackerBatch& batch = block->batch;
+#if !(defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH))
+        batch.setPyramidParameters(config->lk_window_size, config->lk_max_level);
+#endif
+        batch.setFeatureDetector(config->detector, config->detector_threshold);
+        batch.setDetectorParameters(config->max_corners, config->quality_level,
+                                    config->min_distance, config->block_size);
+        batch.setVelocityConversionMode(config->conversion_mode);
+        batch.setRobustAggregation(true, static_cast<float>(config->inlier_threshold));
+        batch.setOutlierRejection(static_cast<float>(config->max_track_error),
+                                  static_cast<float>(config->max_fb_error));
+        batch.setLatencyTarget(config->latency_target);
+        batch.setRotationCompensation(config->rate_input != 0);
+        if (config->keyframe_displacement > 0.0) {
+            batch.setKeyframeMode(true, static_cast<float>(config->keyframe_displacement));
+        }
+        batch.setEarlyOut(static_cast<float>(config->early_out));
+        batch.setParallelTracking(config->tracking_tiles);
+        batch.setPipelineMode(config->pipeline_mode);
+        batch.setRegionOfInterest(sensor_size,
+                                  cv::Rect(roi.x, roi.y, frame_size.width * config->decimation,
+                                           frame_size.height * config->decimation));
+        for (int camera = 0; config->lens_intrinsics != nullptr && camera < config->num_cameras;
+             ++camera) {
+            const double* k = config->lens_intrinsics + 4 * camera;
+            const double* d = config->lens_distortion + config->num_distortion * camera;
+            batch.setLensDistortion(camera,
+                                    cv::Matx33d(k[0], 0.0, k[2], 0.0, k[1], k[3], 0.0, 0.0, 1.0),
+                                    std::vector<double>(d, d + config->num_distortion));
+        }
+    } catch (const std::exception& e) {
+        setError(state, e.what());
+        optical_flow_codegen_terminate(storage);
+        return -1;
+    }
+    return 0;
+}
+
+int optical_flow_codegen_step(void* storage, const void* image, int image_type, double delta_t,
+                              const double* height, const double* angular_rate,
+                              void* velocities, int* feature_columns,
+                              double* stage_timing, double* num_features,
+                              double* ego_velocity, double* heap_allocations,
+                              double* feature_budget) {
+    CodegenStorage& state = *storageOf(storage);
+    if (state.block == nullptr) {
+        return -1;
+    }
+    CodegenBlock& block = *state.block;
+    TrackerBatch& batch = block.batch;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const uint64_t allocations_before = MatArenaAllocator::instance().systemAllocations();
+
+    batch._set_delta_t_(delta_t);
+    if (block.rate_input && angular_rate != nullptr) {
+        batch.setAngularRate(cv::Vec3f(static_cast<float>(angular_rate[0]),
+                                       static_cast<float>(angular_rate[1]),
+                                       static_cast<float>(angular_rate[2])));
+    }
+    const float height_above_ground = (height != nullptr && *height > 0.0)
+                                          ? static_cast<float>(*height)
+                                          : block.height_above_ground;
+    switch (image_type) {
+        case OPTICAL_FLOW_CODEGEN_IMAGE_UINT8:
+            ingestAll(block, static_cast<const uint8_t*>(image));
+            break;
+        case OPTICAL_FLOW_CODEGEN_IMAGE_SINGLE:
+            ingestAll(block, static_cast<const float*>(image));
+            break;
+        default:
+            ingestAll(block, static_cast<const double*>(image));
+            break;
+    }
+
+    // Failed cameras report no features, the last message is kept for the caller
+    const int num_cameras = batch.size();
+    if (!batch.calculateRealVel(height_above_ground)) {
+        for (int camera = 0; camera < num_cameras; ++camera) {
+            if (!batch.error(camera).empty()) {
+                setError(state, batch.error(camera).c_str());
+            }
+        }
+    }
+
+    if (velocities != nullptr) {
+        // One page per camera, only as wide as the most features tracked for a variable-size port
+        int columns = MAX_OUTPUT_FEATURES;
+        if (feature_columns != nullptr) {
+            columns = featureColumns(batch);
+            *feature_columns = columns;
+        }
+        if (block.single_features) {
+            writeFeatureVelocities(batch, columns, static_cast<float*>(velocities));
+        } else {
+            writeFeatureVelocities(batch, columns, static_cast<double*>(velocities));
+        }
+    }
+
+    for (int camera = 0; camera < num_cameras; ++camera) {
+        const OpticalFlowResult& result = batch.result(camera);
+        const int valid_features = std::min(result.count, MAX_OUTPUT_FEATURES);
+
+        double* ego = ego_velocity + camera * EGO_VELOCITY_WIDTH;
+        ego[0] = result.ego_vel_x;
+        ego[1] = result.ego_vel_y;
+        ego[2] = static_cast<double>(result.inlier_count);
+        ego[3] = result.residual;
+        num_features[camera] = static_cast<double>(valid_features);
+
+        double* budget = feature_budget + camera * FEATURE_BUDGET_WIDTH;
+        budget[0] = static_cast<double>(result.budget_corners);
+        budget[1] = static_cast<double>(result.budget_levels);
+        budget[2] = static_cast<double>(result.budget_iterations);
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    for (int camera = 0; camera < num_cameras; ++camera) {
+        StageProfiler& profiler = batch.tracker(camera).profiler();
+        profiler.record(StageProfiler::STAGE_TOTAL, elapsed);
+        double* timing = stage_timing + camera * STAGE_TIMING_WIDTH;
+        for (int stage = 0; stage < STAGE_TIMING_WIDTH; ++stage) {
+            timing[stage] = profiler.last(stage);
+        }
+    }
+
+    heap_allocations[0] = static_cast<double>(
+        MatArenaAllocator::instance().systemAllocations() - allocations_before);
+    return 0;
+}
+
+const char* optical_flow_codegen_error(void* storage) {
+    return storageOf(storage)->error;
+}
+
+void optical_flow_codegen_terminate(void* storage) {
+    CodegenStorage& state = *storageOf(storage);
+    if (state.block != nullptr) {
+        state.block->~CodegenBlock();
+        state.block = nullptr;
+    }
+    if (state.arena_acquired) {
+        MatArenaAllocator::instance().release();
+        state.arena_acquired = false;
+    }
+}
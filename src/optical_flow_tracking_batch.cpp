@@ -0,0 +1,179 @@
+/**
+ * @file optical_flow_tracking_batch.cpp
+ * @brief Implementation of batched multi-camera velocity estimation
+ *
+ * This file implements the OpticalFlowTrackingBatch class methods.
+ */
+
+#include "optical_flow_tracking_batch.hpp"
+#include <opencv2/core/utility.hpp>
+
+OpticalFlowTrackingBatch::OpticalFlowTrackingBatch(int method, float delta_t,
+                                                   const std::vector<CameraIntrinsics> &cameras,
+                                                   int frame_height, int frame_width,
+                                                   int result_capacity,
+                                                   int feature_procedure)
+    : _trackers(),
+      _arena(2 * static_cast<int>(cameras.size()) * frame_height, frame_width, CV_8UC1,
+             cv::Scalar(0)),
+      _results(cameras.size(), OpticalFlowResult(result_capacity)),
+      _errors(cameras.size()) {
+
+    _trackers.reserve(cameras.size());
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        const CameraIntrinsics &c = cameras[i];
+        _trackers.emplace_back(new OpticalFlowTracking(method, delta_t, c.focal_length,
+                                                       c.cmos_width, c.cmos_height,
+                                                       feature_procedure));
+
+        // Each tracker swaps between its own two planes of the shared arena
+        const int row = 2 * static_cast<int>(i) * frame_height;
+        _trackers.back()->setFrameBuffers(_arena.rowRange(row, row + frame_height),
+                                          _arena.rowRange(row + frame_height,
+                                                          row + 2 * frame_height));
+    }
+}
+
+void OpticalFlowTrackingBatch::setPyramidParameters(int window_size, int max_level) {
+    for (auto &tracker : _trackers) {
+        tracker->setPyramidParameters(window_size, max_level);
+    }
+}
+
+void OpticalFlowTrackingBatch::setFeatureDetector(int detector, int threshold) {
+    for (auto &tracker : _trackers) {
+        tracker->setFeatureDetector(detector, threshold);
+    }
+}
+
+void OpticalFlowTrackingBatch::setDetectorParameters(int max_corners, double quality_level,
+                                                     double min_distance, int block_size) {
+    for (auto &tracker : _trackers) {
+        tracker->setDetectorParameters(max_corners, quality_level, min_distance, block_size);
+    }
+}
+
+void OpticalFlowTrackingBatch::setVelocityConversionMode(int mode) {
+    for (auto &tracker : _trackers) {
+        tracker->setVelocityConversionMode(mode);
+    }
+}
+
+void OpticalFlowTrackingBatch::setRobustAggregation(bool enabled, float threshold) {
+    for (auto &tracker : _trackers) {
+        tracker->setRobustAggregation(enabled, threshold);
+    }
+}
+
+void OpticalFlowTrackingBatch::setOutlierRejection(float max_error, float max_fb_error) {
+    for (auto &tracker : _trackers) {
+        tracker->setOutlierRejection(max_error, max_fb_error);
+    }
+}
+
+void OpticalFlowTrackingBatch::setRotationCompensation(bool enabled) {
+    for (auto &tracker : _trackers) {
+        tracker->setRotationCompensation(enabled);
+    }
+}
+
+void OpticalFlowTrackingBatch::setAngularRate(const cv::Vec3f &angular_rate) {
+    for (auto &tracker : _trackers) {
+        tracker->setAngularRate(angular_rate);
+    }
+}
+
+void OpticalFlowTrackingBatch::setLatencyTarget(double target) {
+    for (auto &tracker : _trackers) {
+        tracker->setLatencyTarget(target);
+    }
+}
+
+void OpticalFlowTrackingBatch::setKeyframeMode(bool enabled, float max_displacement) {
+    for (auto &tracker : _trackers) {
+        tracker->setKeyframeMode(enabled, max_displacement);
+    }
+}
+
+void OpticalFlowTrackingBatch::setEarlyOut(float max_shift) {
+    for (auto &tracker : _trackers) {
+        tracker->setEarlyOut(max_shift);
+    }
+}
+
+void OpticalFlowTrackingBatch::setParallelTracking(int tiles) {
+    for (auto &tracker : _trackers) {
+        tracker->setParallelTracking(tiles);
+    }
+}
+
+void OpticalFlowTrackingBatch::setPipelineMode(int mode) {
+    for (auto &tracker : _trackers) {
+        tracker->setPipelineMode(mode);
+    }
+}
+
+void OpticalFlowTrackingBatch::saveState(std::vector<uint8_t> &state) {
+    for (auto &tracker : _trackers) {
+        tracker->saveState(state);
+    }
+}
+
+void OpticalFlowTrackingBatch::restoreState(const uint8_t *data, size_t size) {
+    size_t offset = 0;
+    for (auto &tracker : _trackers) {
+        offset += tracker->restoreState(data + offset, size - offset);
+    }
+    if (offset != size) {
+        CV_Error(cv::Error::StsBadSize, "Tracker state holds another number of cameras");
+    }
+}
+
+void OpticalFlowTrackingBatch::setLensDistortion(int camera, const cv::Matx33d &camera_matrix,
+                                                 const std::vector<double> &dist_coeffs) {
+    _trackers[camera]->setLensDistortion(camera_matrix, dist_coeffs);
+}
+
+void OpticalFlowTrackingBatch::setRegionOfInterest(cv::Size sensor_size, const cv::Rect &roi) {
+    for (auto &tracker : _trackers) {
+        tracker->setRegionOfInterest(sensor_size, roi);
+    }
+}
+
+void OpticalFlowTrackingBatch::_set_delta_t_(double delta_t_) {
+    for (auto &tracker : _trackers) {
+        tracker->_set_delta_t_(delta_t_);
+    }
+}
+
+bool OpticalFlowTrackingBatch::calculateRealVel(float height) {
+    const int n = size();
+
+    // Cameras are independent, one task per camera on the OpenCV thread pool
+    auto step = [this, height](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            _errors[i].clear();
+            try {
+                // Header copy, the tracker swaps the buffer behind frameBuffer()
+                const cv::Mat frame = _trackers[i]->frameBuffer();
+                _trackers[i]->calculateRealVel(frame, height, _results[i]);
+            } catch (const cv::Exception &e) {
+                _results[i].reset();
+                _errors[i] = e.what();
+            }
+        }
+    };
+
+    if (n == 1) {
+        step(cv::Range(0, 1));
+    } else {
+        cv::parallel_for_(cv::Range(0, n), step, n);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (!_errors[i].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -10,31 +10,222 @@
 #include <opencv2/video.hpp>
 #include <opencv2/video/tracking.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <tuple>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Tag leading every tracker snapshot, changed with the layout
+ */
+constexpr uint32_t STATE_MAGIC = 0x3153464f; // "OFS1"
+
+/**
+ * @brief Append a trivially copyable value to a snapshot
+ */
+template <typename T>
+void putState(std::vector<uint8_t> &state, const T &value) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    state.insert(state.end(), bytes, bytes + sizeof(T));
+}
+
+/**
+ * @brief Append a point count and the points to a snapshot
+ */
+void putPoints(std::vector<uint8_t> &state, const std::vector<cv::Point2f> &points) {
+    putState(state, static_cast<uint32_t>(points.size()));
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(points.data());
+    state.insert(state.end(), bytes, bytes + points.size() * sizeof(cv::Point2f));
+}
+
+/**
+ * @brief Bounds-checked sequential reader of a snapshot
+ */
+class StateReader {
+public:
+    StateReader(const uint8_t *data, size_t size) : _data(data), _size(size), _offset(0) {}
+
+    /**
+     * @brief Consume raw bytes
+     */
+    const uint8_t *take(size_t bytes) {
+        if (bytes > _size - _offset) {
+            CV_Error(cv::Error::StsParseError, "Tracker state is truncated");
+        }
+        const uint8_t *data = _data + _offset;
+        _offset += bytes;
+        return data;
+    }
+
+    /**
+     * @brief Consume a value written by putState()
+     */
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief Consume points written by putPoints()
+     */
+    void getPoints(std::vector<cv::Point2f> &points) {
+        const uint32_t count = get<uint32_t>();
+        if (count > (_size - _offset) / sizeof(cv::Point2f)) {
+            CV_Error(cv::Error::StsParseError, "Tracker state is truncated");
+        }
+        points.resize(count);
+        std::memcpy(points.data(), take(count * sizeof(cv::Point2f)),
+                    count * sizeof(cv::Point2f));
+    }
+
+    /**
+     * @brief Bytes consumed so far
+     */
+    size_t offset() const { return _offset; }
+
+private:
+    const uint8_t *_data;           ///< Snapshot bytes
+    size_t _size;                   ///< Bytes available
+    size_t _offset;                 ///< Bytes consumed
+};
+
+} // namespace
 
 OpticalFlowTracking::OpticalFlowTracking(int method, float delta_t,
                                          float camera_focal_length,
-                                         float cmos_width, float cmos_height)
+                                         float cmos_width, float cmos_height,
+                                         int feature_procedure)
     : _method(method),
+      _feature_procedure(feature_procedure),
       _delta_t(delta_t),
       _focal_length(camera_focal_length),
       _cmos_width(cmos_width),
       _cmos_height(cmos_height),
+      _sensor_fraction_w(1.0f),
+      _sensor_fraction_h(1.0f),
+      _sensor_size(),
+      _roi(),
+      _undistortion(),
       _fov_h(0.0f),
       _fov_v(0.0f),
       _img_width(0),
       _img_height(0),
       _debug_count(0),
       _last_im(),
-      _features() {
+      _current_gray(),
+      _has_reference(false),
+      _win_size(DEFAULT_LK_WINDOW_SIZE, DEFAULT_LK_WINDOW_SIZE),
+      _max_level(DEFAULT_LK_MAX_LEVEL),
+      _features(),
+      _grid_cols(DEFAULT_FEATURE_GRID_COLS),
+      _grid_rows(DEFAULT_FEATURE_GRID_ROWS),
+      _min_features_per_cell(DEFAULT_MIN_FEATURES_PER_CELL),
+      _detector(FEATURE_EXTRACTION_OPENCV_SIMPLE),
+      _max_corners(DEFAULT_MAX_CORNERS),
+      _quality_level(DEFAULT_QUALITY_LEVEL),
+      _min_distance(DEFAULT_MIN_DISTANCE),
+      _block_size(DEFAULT_BLOCK_SIZE),
+      _keypoint_detector(),
+      _keypoints(),
+      _bucket_counts(),
+      _cell_counts(),
+      _detection_mask(),
+      _detected(),
+      _new_features(),
+      _surviving_features(),
+      _status(),
+      _error(),
+      _back_features(),
+      _conversion(VelocityConversion::MODE_FAST),
+      _aggregate(false),
+      _rotation_compensation(false),
+      _angular_rate(0.0f, 0.0f, 0.0f),
+      _aggregator(DEFAULT_MAX_CORNERS),
+      _pipeline_mode(PIPELINE_SYNCHRONOUS),
+      _pending_detection(0),
+      _ring(),
+      _ring_next(0),
+      _ring_pending(false),
+      _profiler(),
+      _budget(),
+      _latency_target(0.0),
+      _budget_samples(0),
+      _keyframe_mode(false),
+      _keyframe_displacement(DEFAULT_KEYFRAME_DISPLACEMENT),
+      _keyframe_survival(DEFAULT_KEYFRAME_SURVIVAL),
+      _keyframe_sync(true),
+      _keyframe_size(0),
+      _key_features(),
+      _survivor_index(),
+      _early_out(0.0f),
+      _skipped_dt(0.0f),
+      _skipped_frames(0),
+      _probe_valid(false),
+      _probe_small(),
+      _probe_curr(),
+      _probe_ref(),
+      _probe_window(),
+      _probe_survivors(),
+      _backend(),
+      _worker() {
+
+    // Select the backend, the method identifiers match the public constants
+    switch (method) {
+        case OPTICAL_FLOW_LUCAS_KANADE:
+            _backend.reset(new SparseLKBackend());
+            break;
+        case OPTICAL_FLOW_DIS_DENSE:
+            _backend.reset(new DenseDISBackend());
+            break;
+#ifdef HAVE_OPENCV_CUDAOPTFLOW
+        case OPTICAL_FLOW_LUCAS_KANADE_CUDA:
+            if (isMethodAvailable(method)) {
+                _backend.reset(new CudaSparseLKBackend());
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+    if (!_backend) {
+        CV_Error(cv::Error::StsBadArg, "Optical flow method is not available in this build");
+    }
+    _backend->configure(_win_size, _max_level, _criteria);
+    resetBudget();
 
     // Calculate horizontal and vertical field of view from camera sensor dimensions
-    // FOV = 2 * arctan(sensor_size / (2 * focal_length))
-    // This allows converting pixel velocities to angular velocities
-    _fov_h = 2.0f * std::atan(_cmos_width / (2.0f * _focal_length));
-    _fov_v = 2.0f * std::atan(_cmos_height / (2.0f * _focal_length));
+    updateFieldOfView();
+
+    // Reserve all per-frame scratch buffers up front so tracking never reallocates
+    _features.reserve(DEFAULT_MAX_CORNERS);
+    _detected.reserve(DEFAULT_MAX_CORNERS);
+    _new_features.reserve(DEFAULT_MAX_CORNERS);
+    _surviving_features.reserve(DEFAULT_MAX_CORNERS);
+    _status.reserve(DEFAULT_MAX_CORNERS);
+    _error.reserve(DEFAULT_MAX_CORNERS);
+    _key_features.reserve(DEFAULT_MAX_CORNERS);
+    _survivor_index.reserve(DEFAULT_MAX_CORNERS);
+    _probe_survivors.reserve(1);
+}
+
+bool OpticalFlowTracking::isMethodAvailable(int method) {
+    switch (method) {
+        case OPTICAL_FLOW_LUCAS_KANADE:
+        case OPTICAL_FLOW_DIS_DENSE:
+            return true;
+#ifdef HAVE_OPENCV_CUDAOPTFLOW
+        case OPTICAL_FLOW_LUCAS_KANADE_CUDA:
+            return cv::cuda::getCudaEnabledDeviceCount() > 0;
+#endif
+        default:
+            return false;
+    }
 }
 
 void OpticalFlowTracking::_set_delta_t_(double delta_t_) {
@@ -43,101 +234,804 @@ void OpticalFlowTracking::_set_delta_t_(double delta_t_) {
     _delta_t = static_cast<float>(delta_t_);
 }
 
+void OpticalFlowTracking::setFeatureGrid(int cols, int rows, int min_features_per_cell) {
+    drainPipeline();
+
+    // Guard against degenerate grids, a single cell covers the whole image
+    _grid_cols = std::max(1, cols);
+    _grid_rows = std::max(1, rows);
+    _min_features_per_cell = std::max(0, min_features_per_cell);
+}
+
+void OpticalFlowTracking::setFeatureDetector(int detector, int threshold) {
+    drainPipeline();
+    _detector = detector;
+
+    // Shi-Tomasi runs through goodFeaturesToTrack, the others through a Feature2D instance
+    switch (detector) {
+        case FEATURE_EXTRACTION_FAST_GRID:
+            _keypoint_detector = cv::FastFeatureDetector::create(threshold, true);
+            break;
+        case FEATURE_EXTRACTION_AGAST_GRID:
+            _keypoint_detector = cv::AgastFeatureDetector::create(threshold, true);
+            break;
+        default:
+            _detector = FEATURE_EXTRACTION_OPENCV_SIMPLE;
+            _keypoint_detector.reset();
+            break;
+    }
+}
+
+void OpticalFlowTracking::setDetectorParameters(int max_corners, double quality_level,
+                                                double min_distance, int block_size) {
+    drainPipeline();
+
+    // The budget cannot exceed the capacity reserved for the per-frame buffers
+    _max_corners = std::min(std::max(1, max_corners), static_cast<int>(DEFAULT_MAX_CORNERS));
+    _quality_level = (quality_level > 0.0) ? quality_level : DEFAULT_QUALITY_LEVEL;
+    _min_distance = std::max(0.0, min_distance);
+    _block_size = std::max(1, block_size);
+    resetBudget();
+}
+
+void OpticalFlowTracking::setPyramidParameters(int window_size, int max_level) {
+    drainPipeline();
+    _win_size = cv::Size(std::max(3, window_size), std::max(3, window_size));
+    _max_level = std::max(0, max_level);
+
+    // Cached pyramids no longer match, restart tracking on the next frame
+    _backend->configure(_win_size, _max_level, _criteria);
+    _has_reference = false;
+    resetBudget();
+}
+
+void OpticalFlowTracking::setTerminationCriteria(int max_iterations, double epsilon) {
+    drainPipeline();
+    _criteria = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS,
+                                 std::max(1, max_iterations), std::max(0.0, epsilon));
+    _backend->configure(_win_size, _max_level, _criteria);
+    _has_reference = false;
+    resetBudget();
+}
+
+void OpticalFlowTracking::setLatencyTarget(double target) {
+    drainPipeline();
+    _latency_target = std::max(0.0, target);
+    resetBudget();
+}
+
+void OpticalFlowTracking::resetBudget() {
+    const BudgetController::Budget ceiling = {_max_corners, _max_level, _criteria.maxCount};
+    const BudgetController::Budget floor = {BUDGET_MIN_CORNERS, 1, BUDGET_MIN_ITERATIONS};
+    _budget.configure(_latency_target, ceiling, floor);
+    _backend->setBudget(ceiling.max_level, ceiling.max_iterations);
+
+    // Only steps measured from now on are fed to the controller
+    _budget_samples = _profiler.count(StageProfiler::STAGE_TOTAL);
+}
+
+void OpticalFlowTracking::updateBudget() {
+    const uint64_t samples = _profiler.count(StageProfiler::STAGE_TOTAL);
+    if (samples == _budget_samples) {
+        return;
+    }
+    _budget_samples = samples;
+    if (_budget.update(_profiler.last(StageProfiler::STAGE_TOTAL))) {
+        const BudgetController::Budget &budget = _budget.budget();
+        _backend->setBudget(budget.max_level, budget.max_iterations);
+    }
+}
+
+void OpticalFlowTracking::setVelocityConversionMode(int mode) {
+    drainPipeline();
+    _conversion.setMode(mode);
+}
+
+void OpticalFlowTracking::setRobustAggregation(bool enabled, float threshold) {
+    drainPipeline();
+    _aggregate = enabled;
+    _aggregator.setThreshold(threshold);
+}
+
+void OpticalFlowTracking::setOutlierRejection(float max_error, float max_fb_error) {
+    drainPipeline();
+    _conversion.setRejection(max_error, max_fb_error);
+}
+
+void OpticalFlowTracking::setRotationCompensation(bool enabled) {
+    drainPipeline();
+    _rotation_compensation = enabled;
+}
+
+void OpticalFlowTracking::setAngularRate(const cv::Vec3f &angular_rate) {
+    _angular_rate = angular_rate;
+}
+
+void OpticalFlowTracking::setKeyframeMode(bool enabled, float max_displacement,
+                                          float min_survival) {
+    drainPipeline();
+    _keyframe_mode = enabled;
+    _keyframe_displacement = std::max(0.0f, max_displacement);
+    _keyframe_survival = std::min(std::max(min_survival, 0.0f), 1.0f);
+
+    // The reference of the carried features changes, restart tracking on the next frame
+    _has_reference = false;
+}
+
+void OpticalFlowTracking::setEarlyOut(float max_shift) {
+    drainPipeline();
+    _early_out = std::max(0.0f, max_shift);
+    _probe_valid = false;
+}
+
+void OpticalFlowTracking::setParallelTracking(int tiles) {
+    drainPipeline();
+    _backend->setParallelTiles(tiles);
+}
+
+void OpticalFlowTracking::saveState(std::vector<uint8_t> &state) {
+    // A queued detection or deferred frame still changes the state
+    drainPipeline();
+
+    putState(state, STATE_MAGIC);
+    putState(state, static_cast<uint8_t>(_has_reference ? 1 : 0));
+    if (!_has_reference) {
+        return;
+    }
+
+    // The reference frame row by row, the buffers may be views of larger storage
+    putState(state, static_cast<int32_t>(_last_im.rows));
+    putState(state, static_cast<int32_t>(_last_im.cols));
+    for (int y = 0; y < _last_im.rows; ++y) {
+        const uchar *row = _last_im.ptr<uchar>(y);
+        state.insert(state.end(), row, row + _last_im.cols);
+    }
+    putPoints(state, _features);
+
+    // While a keyframe is held, _features follow _key_features one to one
+    putState(state, static_cast<uint8_t>(_keyframe_sync ? 1 : 0));
+    putState(state, static_cast<int32_t>(_keyframe_size));
+    if (_keyframe_sync) {
+        putState(state, static_cast<uint32_t>(0));
+    } else {
+        putPoints(state, _key_features);
+    }
+    putState(state, _skipped_dt);
+    putState(state, static_cast<int32_t>(_skipped_frames));
+}
+
+size_t OpticalFlowTracking::restoreState(const uint8_t *data, size_t size) {
+    drainPipeline();
+
+    // A result pending from before the snapshot belongs to another run
+    _ring_pending = false;
+
+    StateReader reader(data, size);
+    if (reader.get<uint32_t>() != STATE_MAGIC) {
+        CV_Error(cv::Error::StsParseError, "Tracker state has an unknown format");
+    }
+    if (reader.get<uint8_t>() == 0) {
+        _has_reference = false;
+        return reader.offset();
+    }
+
+    const int rows = reader.get<int32_t>();
+    const int cols = reader.get<int32_t>();
+    if (rows <= 0 || cols <= 0 ||
+        (!_current_gray.empty() && (rows != _current_gray.rows || cols != _current_gray.cols))) {
+        CV_Error(cv::Error::StsBadSize, "Tracker state was saved at another frame size");
+    }
+    const uint8_t *pixels = reader.take(static_cast<size_t>(rows) * cols);
+    std::vector<cv::Point2f> features;
+    reader.getPoints(features);
+    const bool keyframe_sync = reader.get<uint8_t>() != 0;
+    const int keyframe_size = reader.get<int32_t>();
+    std::vector<cv::Point2f> key_features;
+    reader.getPoints(key_features);
+    const float skipped_dt = reader.get<float>();
+    const int skipped_frames = reader.get<int32_t>();
+    if (!keyframe_sync && (!_keyframe_mode || key_features.size() != features.size())) {
+        CV_Error(cv::Error::StsBadArg, "Tracker state holds a keyframe, keyframe mode must be enabled");
+    }
+
+    // The per-frame buffers are reserved for DEFAULT_MAX_CORNERS features
+    const size_t capacity = static_cast<size_t>(DEFAULT_MAX_CORNERS);
+    if (features.size() > capacity || key_features.size() > capacity ||
+        keyframe_size < 0 || keyframe_size > DEFAULT_MAX_CORNERS) {
+        CV_Error(cv::Error::StsOutOfRange, "Tracker state holds more features than the tracker");
+    }
+    if (skipped_frames < 0 || skipped_frames > EARLY_OUT_MAX_SKIPPED || !(skipped_dt >= 0.0f)) {
+        CV_Error(cv::Error::StsOutOfRange, "Tracker state holds an invalid early-out interval");
+    }
+    auto inside = [rows, cols](const cv::Point2f &p) {
+        return p.x >= 0.0f && p.y >= 0.0f && p.x < static_cast<float>(cols) &&
+               p.y < static_cast<float>(rows);
+    };
+    if (!std::all_of(features.begin(), features.end(), inside) ||
+        !std::all_of(key_features.begin(), key_features.end(), inside)) {
+        CV_Error(cv::Error::StsOutOfRange, "Tracker state holds features outside the frame");
+    }
+
+    // Copied into the existing buffers, which may be fixed-size storage or reserved vectors
+    cv::Mat(rows, cols, CV_8UC1, const_cast<uint8_t *>(pixels)).copyTo(_last_im);
+    _features.assign(features.begin(), features.end());
+    _key_features.assign(key_features.begin(), key_features.end());
+
+    // Pyramids and conversion geometry as after a detection on the reference
+    adoptReference();
+    _keyframe_sync = keyframe_sync;
+    _keyframe_size = keyframe_size;
+    _skipped_dt = skipped_dt;
+    _skipped_frames = skipped_frames;
+    return reader.offset();
+}
+
+void OpticalFlowTracking::setPipelineMode(int mode) {
+    drainPipeline();
+    _ring_pending = false;
+    _pipeline_mode = mode;
+
+    // Only the pipelined modes need a worker thread
+    if (_pipeline_mode == PIPELINE_SYNCHRONOUS) {
+        _worker.reset();
+    } else if (!_worker) {
+        _worker.reset(new PipelineWorker());
+    }
+}
+
+void OpticalFlowTracking::setRegionOfInterest(cv::Size sensor_size, const cv::Rect &roi) {
+    CV_Assert(sensor_size.width > 0 && sensor_size.height > 0);
+    CV_Assert(roi.area() > 0 && (roi & cv::Rect(cv::Point(), sensor_size)) == roi);
+    drainPipeline();
+    _sensor_fraction_w = static_cast<float>(roi.width) / static_cast<float>(sensor_size.width);
+    _sensor_fraction_h = static_cast<float>(roi.height) / static_cast<float>(sensor_size.height);
+    _sensor_size = sensor_size;
+    _roi = roi;
+    updateFieldOfView();
+
+    // The pixel geometry changed, restart tracking on the next frame
+    _has_reference = false;
+    _features.clear();
+}
+
+void OpticalFlowTracking::setLensDistortion(const cv::Matx33d &camera_matrix,
+                                            const std::vector<double> &dist_coeffs) {
+    drainPipeline();
+    if (camera_matrix(0, 0) > 0.0 && camera_matrix(1, 1) > 0.0) {
+        _undistortion.setModel(camera_matrix, dist_coeffs);
+    } else {
+        _undistortion.clear();
+    }
+
+    // Bearings change for every pixel, restart tracking on the next frame
+    _has_reference = false;
+    _features.clear();
+}
+
+void OpticalFlowTracking::setFrameBuffers(const cv::Mat &first, const cv::Mat &second) {
+    CV_Assert(first.type() == CV_8UC1 && second.type() == CV_8UC1 &&
+              first.size() == second.size() && first.data != second.data);
+    drainPipeline();
+    _last_im = first;
+    _current_gray = second;
+
+    // Neither buffer holds a frame yet
+    _has_reference = false;
+}
+
+cv::Mat& OpticalFlowTracking::frameBuffer() {
+    // The worker may still read the current buffer, deferred frames go to the next slot
+    if (_pipeline_mode == PIPELINE_DEFERRED) {
+        return _ring[_ring_next].frame;
+    }
+    return _current_gray;
+}
+
+void OpticalFlowTracking::storeFrame(const cv::Mat &img) {
+    // Frames ingested in place are already where the tracker needs them
+    if (img.channels() == 3) {
+        cv::cvtColor(img, _current_gray, cv::COLOR_BGR2GRAY);
+    } else if (img.data != _current_gray.data) {
+        img.copyTo(_current_gray);
+    }
+}
+
+void OpticalFlowTracking::updateFieldOfView() {
+    // FOV = 2 * arctan(sensor_size / (2 * focal_length))
+    // Only the part of the sensor covered by the processed frames counts
+    // This allows converting pixel velocities to angular velocities
+    const float used_width = _cmos_width * _sensor_fraction_w;
+    const float used_height = _cmos_height * _sensor_fraction_h;
+    _fov_h = 2.0f * std::atan(used_width / (2.0f * _focal_length));
+    _fov_v = 2.0f * std::atan(used_height / (2.0f * _focal_length));
+}
+
 bool OpticalFlowTracking::_has_features() {
+    // A queued detection or a deferred step on the worker may still change the features
+    drainPipeline();
+
     // Check if there are any tracked features available
     return !_features.empty();
 }
 
 void OpticalFlowTracking::extractFeatures(const cv::Mat &img) {
-    cv::Mat gray;
-
     // Convert to grayscale if necessary (optical flow works on single-channel images)
-    if (img.channels() == 3) {
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = img.clone();
-    }
+    storeFrame(img);
 
-    // Clear previous features and detect new ones using Shi-Tomasi corner detection
-    // Parameters: max 1000 features, quality level 0.1, min distance 8 pixels, block size 2
+    // Clear previous features and detect new ones over the whole image
     _features.clear();
-    cv::goodFeaturesToTrack(gray, _features, 1000, 0.1, 8.0, cv::Mat(), 2);
+    {
+        OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_DETECTION);
+        detectFeatures(_current_gray, _features, cornerBudget(), cv::Mat());
+    }
 
-    // If no features found, exit early
-    if (!_has_features()) {
+    // If no features found, exit early (may run on the worker, which cannot drain itself)
+    if (_features.empty()) {
         return;
     }
 
-    // Store the current frame for next iteration's optical flow calculation
-    _last_im = gray;
-    _img_width = gray.cols;
-    _img_height = gray.rows;
+    // The current buffer becomes the previous frame, the backend uses it as reference
+    std::swap(_last_im, _current_gray);
+    adoptReference();
+}
+
+void OpticalFlowTracking::adoptReference() {
+    _has_reference = true;
+    _keyframe_sync = true;
+    _skipped_dt = 0.0f;
+    _skipped_frames = 0;
+    _probe_valid = false;
+    _backend->setReference(_last_im);
+    _img_width = _last_im.cols;
+    _img_height = _last_im.rows;
+    _conversion.configure(_fov_h, _fov_v, _img_width, _img_height);
+
+    // Without a region the frames cover the whole sensor
+    if (_undistortion.enabled()) {
+        const cv::Size frame_size(_img_width, _img_height);
+        if (_sensor_size.area() > 0) {
+            _undistortion.configure(_sensor_size, _roi, frame_size);
+        } else {
+            _undistortion.configure(frame_size, cv::Rect(0, 0, _img_width, _img_height), frame_size);
+        }
+    }
+    _conversion.setUndistortion(_undistortion.enabled() ? &_undistortion : nullptr);
 }
 
 std::tuple<std::vector<float>, std::vector<float>,
            std::vector<cv::Point2f>, std::vector<cv::Point2f>, bool>
 OpticalFlowTracking::calculateRealVel(const cv::Mat &img, float height) {
+    OpticalFlowResult result(DEFAULT_MAX_CORNERS);
+    const bool success = calculateRealVel(img, height, result);
+
+    // Repackage the preallocated result into the legacy tuple of vectors, one entry per feature
+    std::vector<float> v_est_x(result.vel_x.begin(), result.vel_x.begin() + result.count);
+    std::vector<float> v_est_y(result.vel_y.begin(), result.vel_y.begin() + result.count);
+    std::vector<cv::Point2f> new_features;
+    std::vector<cv::Point2f> old_features;
+    new_features.reserve(result.count);
+    old_features.reserve(result.count);
+    for (int i = 0; i < result.count; ++i) {
+        new_features.emplace_back(result.curr_x[i], result.curr_y[i]);
+        old_features.emplace_back(result.prev_x[i], result.prev_y[i]);
+    }
+    return {v_est_x, v_est_y, new_features, old_features, success};
+}
+
+bool OpticalFlowTracking::calculateRealVel(const cv::Mat &img, float height,
+                                           OpticalFlowResult &result) {
+    if (_pipeline_mode == PIPELINE_DEFERRED) {
+        return stepDeferred(img, height, result);
+    }
+    return step(img, height, _delta_t, _angular_rate, result);
+}
+
+bool OpticalFlowTracking::step(const cv::Mat &img, float height, float delta_t,
+                               const cv::Vec3f &angular_rate, OpticalFlowResult &result) {
+    result.reset();
+    result.success = true;
+
+    // Adapt this frame's work to the step time measured by the caller
+    if (_budget.enabled()) {
+        updateBudget();
+    }
+    const BudgetController::Budget &budget = _budget.budget();
+    result.budget_corners = cornerBudget();
+    result.budget_levels = budget.max_level;
+    result.budget_iterations = budget.max_iterations;
 
     // On first call, no previous frame exists - initialize and return empty
-    if (_last_im.empty()) {
+    if (!_has_reference) {
+        finishDetection();
+        _new_features.clear();
         extractFeatures(img);
-        return {{}, {}, {}, {}, true};
+        return true;
     }
 
     // Convert current image to grayscale for optical flow processing
-    cv::Mat current_gray;
+    // The ping-pong buffer is reused, so this does not allocate after the first frame
+    storeFrame(img);
+
+    _debug_count++;
+
+    // Frames that barely moved are not tracked, the next processed frame covers them
+    const float interval = _skipped_dt + delta_t;
+    if (_early_out > 0.0f) {
+        if (probeLowMotion(interval, height, angular_rate, result)) {
+            _skipped_dt = interval;
+            _skipped_frames++;
+            return true;
+        }
+    }
+
+    // Build the current pyramid (or upload the frame) once, the previous one is
+    // cached by the backend from the last step
+    {
+        OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_PYRAMID);
+        _backend->prepare(_current_gray);
+    }
+
+    // The feature set of the previous frame may still be replenished in the background
+    finishDetection();
+
+    // A new keyframe tracks from the features detected on it
+    if (_keyframe_mode && _keyframe_sync) {
+        _key_features.assign(_features.begin(), _features.end());
+        _keyframe_size = static_cast<int>(_key_features.size());
+        _keyframe_sync = false;
+    }
+
+    // Track features from the reference frame to the current frame with the selected
+    // backend: the previous frame, or the keyframe, whose locations follow _features
+    const std::vector<cv::Point2f> &origin = _keyframe_mode ? _key_features : _features;
+    const bool fb_check = _conversion.maxForwardBackwardError() > 0.0f;
+    {
+        OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_TRACKING);
+        _backend->track(origin, _new_features, _status, _error);
+
+        // Reverse pass for the forward-backward check, evaluated in the conversion
+        if (fb_check) {
+            _backend->trackBack(_new_features, _back_features, _status);
+        }
+    }
+
+    // The reverse pass returns to the keyframe, not to the previous locations the
+    // conversion compares with, so that check is applied to the status here
+    if (_keyframe_mode && fb_check) {
+        const float max_sq = _conversion.maxForwardBackwardError() *
+                             _conversion.maxForwardBackwardError();
+        for (size_t i = 0; i < _status.size(); ++i) {
+            const cv::Point2f d = _back_features[i] - _key_features[i];
+            if (!(d.x * d.x + d.y * d.y <= max_sq)) {
+                _status[i] = 0;
+            }
+        }
+    }
+
+    // Single fused pass: displacement, pixel-to-angle and angle-to-velocity
+    // conversion, plus collection of the features carried to the next frame
+    int count = 0;
+    {
+        OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_CONVERSION);
+        if (_rotation_compensation) {
+            _conversion.setFrame(interval, height, angular_rate);
+        } else {
+            _conversion.setFrame(interval, height);
+        }
+        count = _conversion.convert(_features.data(), _new_features.data(),
+                                    _status.data(), _error.data(),
+                                    (fb_check && !_keyframe_mode) ? _back_features.data() : nullptr,
+                                    static_cast<int>(_new_features.size()),
+                                    _current_gray.size(), result,
+                                    _surviving_features,
+                                    _keyframe_mode ? &_survivor_index : nullptr);
+    }
+    _features.swap(_surviving_features);
+    _skipped_dt = 0.0f;
+    _skipped_frames = 0;
+    if (_early_out > 0.0f) {
+        std::swap(_probe_ref, _probe_curr);
+        _probe_valid = true;
+    }
+
+    // While a keyframe holds, it stays the backend's previous frame and nothing is re-detected
+    if (!_keyframe_mode || updateKeyframe()) {
+        result.keyframe = _keyframe_mode;
+        _keyframe_sync = true;
+
+        // Current frame becomes the previous one, buffers are recycled rather than copied
+        std::swap(_last_im, _current_gray);
+        _backend->advance();
+
+        // Carry tracked features forward or re-extract for the next iteration,
+        // off the critical path when the detection overlap is enabled
+        if (_pipeline_mode == PIPELINE_OVERLAP_DETECTION) {
+            // The budget is passed by value, the controller may change it during detection
+            const int max_corners = cornerBudget();
+            _pending_detection = _worker->submit(
+                [this, max_corners] { replenishFeatures(_last_im, max_corners); });
+        } else {
+            replenishFeatures(_last_im, cornerBudget());
+        }
+    }
+
+    result.count = count;
+
+    // Reduce the per-feature field to a single robust ego velocity
+    if (_aggregate) {
+        OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_AGGREGATION);
+        _aggregator.estimate(result);
+    }
+    return true;
+}
+
+bool OpticalFlowTracking::stepDeferred(const cv::Mat &img, float height,
+                                       OpticalFlowResult &result) {
+    // Copy the frame into a private slot, the caller reuses its buffer next step
+    // (frames ingested through frameBuffer() already are in the slot)
+    FrameSlot &slot = _ring[_ring_next];
     if (img.channels() == 3) {
-        cv::cvtColor(img, current_gray, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(img, slot.frame, cv::COLOR_BGR2GRAY);
+    } else if (img.data != slot.frame.data) {
+        img.copyTo(slot.frame);
+    }
+    slot.height = height;
+    slot.delta_t = _delta_t;
+    slot.angular_rate = _angular_rate;
+
+    FrameSlot *submitted = &slot;
+    slot.ticket = _worker->submit([this, submitted] {
+        step(submitted->frame, submitted->height, submitted->delta_t, submitted->angular_rate,
+             submitted->result);
+    });
+
+    const int previous = (_ring_next + PIPELINE_RING_SIZE - 1) % PIPELINE_RING_SIZE;
+    _ring_next = (_ring_next + 1) % PIPELINE_RING_SIZE;
+
+    // Nothing to report until the pipeline is primed
+    result.reset();
+    result.success = true;
+    if (!_ring_pending) {
+        _ring_pending = true;
+        return true;
+    }
+
+    // Collect the frame submitted on the previous call while this one is processed
+    const FrameSlot &done = _ring[previous];
+    _worker->wait(done.ticket);
+
+    const OpticalFlowResult &src = done.result;
+    const int count = std::min(src.count, result.capacity);
+    std::copy(src.vel_x.begin(), src.vel_x.begin() + count, result.vel_x.begin());
+    std::copy(src.vel_y.begin(), src.vel_y.begin() + count, result.vel_y.begin());
+    std::copy(src.prev_x.begin(), src.prev_x.begin() + count, result.prev_x.begin());
+    std::copy(src.prev_y.begin(), src.prev_y.begin() + count, result.prev_y.begin());
+    std::copy(src.curr_x.begin(), src.curr_x.begin() + count, result.curr_x.begin());
+    std::copy(src.curr_y.begin(), src.curr_y.begin() + count, result.curr_y.begin());
+    result.count = count;
+    result.success = src.success;
+    result.skipped = src.skipped;
+    result.keyframe = src.keyframe;
+    result.ego_vel_x = src.ego_vel_x;
+    result.ego_vel_y = src.ego_vel_y;
+    result.inlier_count = src.inlier_count;
+    result.residual = src.residual;
+    result.budget_corners = src.budget_corners;
+    result.budget_levels = src.budget_levels;
+    result.budget_iterations = src.budget_iterations;
+    return result.success;
+}
+
+bool OpticalFlowTracking::probeLowMotion(float interval, float height,
+                                         const cv::Vec3f &angular_rate,
+                                         OpticalFlowResult &result) {
+    // Area averaging keeps the subpixel shift of the decimated frames meaningful
+    const cv::Size probe_size(std::max(1, _current_gray.cols / EARLY_OUT_DECIMATION),
+                              std::max(1, _current_gray.rows / EARLY_OUT_DECIMATION));
+    cv::resize(_current_gray, _probe_small, probe_size, 0.0, 0.0, cv::INTER_AREA);
+    _probe_small.convertTo(_probe_curr, CV_32F);
+    if (_probe_window.size() != probe_size) {
+        cv::createHanningWindow(_probe_window, probe_size, CV_32F);
+        _probe_valid = false;
+    }
+    if (!_probe_valid || _skipped_frames >= EARLY_OUT_MAX_SKIPPED) {
+        return false;
+    }
+
+    // Shift of the current frame relative to the last processed one, in full-resolution pixels
+    double response = 0.0;
+    const cv::Point2d probe_shift = cv::phaseCorrelate(_probe_ref, _probe_curr, _probe_window,
+                                                       &response);
+    const cv::Point2f shift(static_cast<float>(probe_shift.x * _current_gray.cols / probe_size.width),
+                            static_cast<float>(probe_shift.y * _current_gray.rows / probe_size.height));
+    if (!(response >= EARLY_OUT_MIN_RESPONSE) ||
+        !(shift.x * shift.x + shift.y * shift.y < _early_out * _early_out)) {
+        return false;
+    }
+
+    // The shift of the image center gives the ego velocity over the skipped interval
+    const cv::Point2f center(0.5f * _current_gray.cols, 0.5f * _current_gray.rows);
+    const cv::Point2f shifted = center + shift;
+    const uchar status = 1;
+    const float error = 0.0f;
+    if (_rotation_compensation) {
+        _conversion.setFrame(interval, height, angular_rate);
     } else {
-        current_gray = img.clone();
+        _conversion.setFrame(interval, height);
     }
+    _conversion.convert(&center, &shifted, &status, &error, nullptr, 1, _current_gray.size(),
+                        result, _probe_survivors);
+    result.ego_vel_x = result.vel_x[0];
+    result.ego_vel_y = result.vel_y[0];
+    result.count = 0;
+    result.skipped = true;
+    return true;
+}
 
-    _debug_count++;
+bool OpticalFlowTracking::updateKeyframe() {
+    // Keyframe locations of the survivors, the indices are increasing so this compacts in place
+    const int n = static_cast<int>(_survivor_index.size());
+    for (int k = 0; k < n; ++k) {
+        _key_features[k] = _key_features[_survivor_index[k]];
+    }
+    _key_features.resize(n);
+    if (n == 0 || n < _keyframe_survival * _keyframe_size) {
+        return true;
+    }
 
-    // Track features from previous frame to current frame using Lucas-Kanade method
-    // Pyramidal implementation with window size 16x16, max pyramid level 2
-    std::vector<uchar> status;
-    std::vector<float> error;
-    std::vector<cv::Point2f> new_features;
+    // Mean displacement from the keyframe, LK accuracy drops as it grows
+    float displacement = 0.0f;
+    for (int k = 0; k < n; ++k) {
+        const cv::Point2f d = _features[k] - _key_features[k];
+        displacement += std::sqrt(d.x * d.x + d.y * d.y);
+    }
+    return displacement > _keyframe_displacement * static_cast<float>(n);
+}
 
-    cv::calcOpticalFlowPyrLK(_last_im, current_gray, _features, new_features,
-                            status, error, cv::Size(16, 16), 2, _criteria);
+void OpticalFlowTracking::finishDetection() {
+    if (_pending_detection != 0) {
+        const uint64_t ticket = _pending_detection;
+        _pending_detection = 0;
+        _worker->wait(ticket);
+    }
+}
 
-    // Calculate pixel velocities for successfully tracked features
-    std::vector<float> vels_x, vels_y;
-    std::vector<cv::Point2f> old_features;
+void OpticalFlowTracking::drainPipeline() {
+    _pending_detection = 0;
+    if (_worker) {
+        _worker->waitAll();
+    }
+}
+
+void OpticalFlowTracking::detectFeatures(const cv::Mat &gray,
+                                         std::vector<cv::Point2f> &corners,
+                                         int max_corners, const cv::Mat &mask) {
+    // Dense flow is valid everywhere, sample it on a grid instead of detecting corners
+    if (_backend->isDense()) {
+        corners.clear();
+        if (max_corners <= 0) {
+            return;
+        }
+        const double area = static_cast<double>(gray.rows) * gray.cols;
+        const int spacing = std::max(1, static_cast<int>(std::ceil(std::sqrt(area / max_corners))));
+        for (int y = spacing / 2; y < gray.rows; y += spacing) {
+            const uchar* allowed = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+            for (int x = spacing / 2; x < gray.cols; x += spacing) {
+                if (allowed != nullptr && allowed[x] == 0) {
+                    continue;
+                }
+                corners.emplace_back(static_cast<float>(x), static_cast<float>(y));
+                if (static_cast<int>(corners.size()) == max_corners) {
+                    return;
+                }
+            }
+        }
+        return;
+    }
+
+    // FAST/AGAST: cheap segment test over the whole image, then bucketing
+    if (_keypoint_detector) {
+        _keypoints.clear();
+        _keypoint_detector->detect(gray, _keypoints, mask);
+        bucketKeypoints(gray.size(), corners, max_corners);
+        return;
+    }
+
+    // Shi-Tomasi corner detection
+    // Defaults: quality level 0.1, min distance 8 pixels, block size 2
+    cv::goodFeaturesToTrack(gray, corners, max_corners, _quality_level, _min_distance,
+                            mask, _block_size);
+}
+
+void OpticalFlowTracking::bucketKeypoints(cv::Size size, std::vector<cv::Point2f> &corners,
+                                          int max_corners) {
+    corners.clear();
+    if (_keypoints.empty() || max_corners <= 0) {
+        return;
+    }
+
+    // Every cell may keep an equal share of the budget, strongest responses first
+    const int cells = _grid_cols * _grid_rows;
+    const int per_cell = std::max(1, (max_corners + cells - 1) / cells);
+    const int cell_w = (size.width + _grid_cols - 1) / _grid_cols;
+    const int cell_h = (size.height + _grid_rows - 1) / _grid_rows;
+    std::sort(_keypoints.begin(), _keypoints.end(),
+              [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; });
+
+    _bucket_counts.assign(static_cast<size_t>(cells), 0);
+    for (const cv::KeyPoint &kp : _keypoints) {
+        const int cx = std::min(static_cast<int>(kp.pt.x) / cell_w, _grid_cols - 1);
+        const int cy = std::min(static_cast<int>(kp.pt.y) / cell_h, _grid_rows - 1);
+        int &count = _bucket_counts[cy * _grid_cols + cx];
+        if (count >= per_cell) {
+            continue;
+        }
+        count++;
+        corners.push_back(kp.pt);
+        if (static_cast<int>(corners.size()) == max_corners) {
+            return;
+        }
+    }
+}
+
+void OpticalFlowTracking::replenishFeatures(const cv::Mat &gray, int max_corners) {
+    OPTICAL_FLOW_PROFILE_SCOPE(&_profiler, StageProfiler::STAGE_DETECTION);
 
-    for (size_t i = 0; i < new_features.size(); ++i) {
-        if (status[i]) {
-            // Compute pixel displacement
-            float dx = new_features[i].x - _features[i].x;
-            float dy = new_features[i].y - _features[i].y;
-
-            // Convert to pixel velocities
-            // Note: dy maps to X (forward) and -dx maps to Y (left) for UAV coordinate system
-            vels_x.push_back(dy / _delta_t);
-            vels_y.push_back(-dx / _delta_t);
-            old_features.push_back(_features[i]);
+    // Dynamic mode: discard tracked features and detect a fresh set every frame
+    // Once mode: keep tracking the initial set until it is completely lost
+    if (_feature_procedure != FEATURE_EXTRACTION_PROCEDURE_INCREMENTAL) {
+        if (_feature_procedure == FEATURE_EXTRACTION_PROCEDURE_DYNAMIC || _features.empty()) {
+            _features.clear();
+            detectFeatures(gray, _features, max_corners, cv::Mat());
         }
+        return;
     }
 
-    // Extract fresh features for next iteration and update stored frame
-    _features.clear();
-    cv::goodFeaturesToTrack(current_gray, _features, 1000, 0.1, 8.0, cv::Mat(), 2);
-    _last_im = current_gray;
+    const int free_slots = max_corners - static_cast<int>(_features.size());
+    if (free_slots <= 0) {
+        return;
+    }
 
-    // Convert pixel velocities to real-world velocities using camera height and FOV
-    std::vector<float> v_est_x, v_est_y;
-    for (size_t i = 0; i < vels_x.size(); ++i) {
-        // Convert pixel velocity to angular velocity using field of view
-        float angular_vel_x = vels_x[i] * _fov_v / static_cast<float>(_img_height);
-        float angular_vel_y = vels_y[i] * _fov_h / static_cast<float>(_img_width);
+    // Count carried-forward features per grid cell
+    const int cell_w = (gray.cols + _grid_cols - 1) / _grid_cols;
+    const int cell_h = (gray.rows + _grid_rows - 1) / _grid_rows;
+    _cell_counts.assign(static_cast<size_t>(_grid_cols) * _grid_rows, 0);
+    for (const cv::Point2f &p : _features) {
+        const int cx = std::min(static_cast<int>(p.x) / cell_w, _grid_cols - 1);
+        const int cy = std::min(static_cast<int>(p.y) / cell_h, _grid_rows - 1);
+        _cell_counts[cy * _grid_cols + cx]++;
+    }
+
+    // Open the mask only over cells that fell below the threshold
+    _detection_mask.create(gray.rows, gray.cols, CV_8UC1);
+    _detection_mask.setTo(cv::Scalar(0));
+    bool any_sparse = false;
+    for (int cy = 0; cy < _grid_rows; ++cy) {
+        for (int cx = 0; cx < _grid_cols; ++cx) {
+            if (_cell_counts[cy * _grid_cols + cx] >= _min_features_per_cell) {
+                continue;
+            }
+            const cv::Rect cell = cv::Rect(cx * cell_w, cy * cell_h, cell_w, cell_h) &
+                                  cv::Rect(0, 0, gray.cols, gray.rows);
+            if (cell.area() > 0) {
+                _detection_mask(cell).setTo(cv::Scalar(255));
+                any_sparse = true;
+            }
+        }
+    }
+
+    // Every cell is still well populated, no detection needed this frame
+    if (!any_sparse) {
+        return;
+    }
 
-        // Convert angular velocity to linear velocity: v = h * tan(θ) / Δt
-        // where θ is the angular displacement and h is the height above ground
-        v_est_x.push_back(height * std::tan(angular_vel_x * _delta_t) / _delta_t);
-        v_est_y.push_back(height * std::tan(angular_vel_y * _delta_t) / _delta_t);
+    // Keep new corners away from the features already being tracked
+    for (const cv::Point2f &p : _features) {
+        cv::circle(_detection_mask, cv::Point(static_cast<int>(p.x), static_cast<int>(p.y)),
+                   static_cast<int>(_min_distance), cv::Scalar(0), -1);
     }
 
-    return {v_est_x, v_est_y, new_features, old_features, true};
+    _detected.clear();
+    detectFeatures(gray, _detected, free_slots, _detection_mask);
+    _features.insert(_features.end(), _detected.begin(), _detected.end());
 }
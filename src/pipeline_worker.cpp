@@ -0,0 +1,101 @@
+/**
+ * @file pipeline_worker.cpp
+ * @brief Implementation of the in-order background worker
+ *
+ * This file implements the PipelineWorker class methods.
+ */
+
+#include "pipeline_worker.hpp"
+#include <utility>
+
+PipelineWorker::PipelineWorker()
+    : _head(0),
+      _size(0),
+      _submitted(0),
+      _completed(0),
+      _error(),
+      _stop(false),
+      _thread(&PipelineWorker::run, this) {
+}
+
+PipelineWorker::~PipelineWorker() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _task_cv.notify_all();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+uint64_t PipelineWorker::submit(std::function<void()> task) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Bounded queue: block the producer instead of growing without limit
+    _done_cv.wait(lock, [this] { return _size < QUEUE_CAPACITY; });
+
+    _queue[(_head + _size) % QUEUE_CAPACITY] = std::move(task);
+    _size++;
+    const uint64_t ticket = ++_submitted;
+    lock.unlock();
+
+    _task_cv.notify_one();
+    return ticket;
+}
+
+void PipelineWorker::wait(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cv.wait(lock, [this, ticket] { return _completed >= ticket; });
+
+    // Hand a task failure over to the caller exactly once
+    if (_error) {
+        std::exception_ptr error = _error;
+        _error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void PipelineWorker::waitAll() {
+    uint64_t ticket = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ticket = _submitted;
+    }
+    wait(ticket);
+}
+
+void PipelineWorker::run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _task_cv.wait(lock, [this] { return _stop || _size > 0; });
+
+            // Drain remaining work before shutting down
+            if (_size == 0) {
+                return;
+            }
+            task = std::move(_queue[_head]);
+            _queue[_head] = nullptr;
+            _head = (_head + 1) % QUEUE_CAPACITY;
+            _size--;
+        }
+
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (error && !_error) {
+                _error = error;
+            }
+            _completed++;
+        }
+        _done_cv.notify_all();
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file robust_velocity_estimator.cpp
+ * @brief Implementation of the median/MAD ego velocity estimator
+ *
+ * This file implements the RobustVelocityEstimator class methods.
+ */
+
+#include "robust_velocity_estimator.hpp"
+#include <algorithm>
+#include <cmath>
+
+RobustVelocityEstimator::RobustVelocityEstimator(int capacity, float threshold)
+    : _threshold(threshold),
+      _scratch(capacity),
+      _distance(capacity) {
+}
+
+void RobustVelocityEstimator::setThreshold(float threshold) {
+    _threshold = std::max(0.0f, threshold);
+}
+
+float RobustVelocityEstimator::median(std::vector<float> &values, int n) {
+    // Linear-time selection, the buffer order is not needed afterwards
+    std::nth_element(values.begin(), values.begin() + n / 2, values.begin() + n);
+    return values[n / 2];
+}
+
+bool RobustVelocityEstimator::estimate(OpticalFlowResult &result) {
+    const int n = std::min(result.count, static_cast<int>(_scratch.size()));
+
+    result.ego_vel_x = 0.0f;
+    result.ego_vel_y = 0.0f;
+    result.inlier_count = 0;
+    result.residual = 0.0f;
+
+    if (n <= 0) {
+        return false;
+    }
+
+    const float* vx = result.vel_x.data();
+    const float* vy = result.vel_y.data();
+
+    // Initial translation estimate: component-wise median
+    std::copy(vx, vx + n, _scratch.begin());
+    const float med_x = median(_scratch, n);
+    std::copy(vy, vy + n, _scratch.begin());
+    const float med_y = median(_scratch, n);
+
+    // Robust spread: median distance to the initial estimate
+    for (int i = 0; i < n; ++i) {
+        const float ex = vx[i] - med_x;
+        const float ey = vy[i] - med_y;
+        _distance[i] = std::sqrt(ex * ex + ey * ey);
+    }
+    std::copy(_distance.begin(), _distance.begin() + n, _scratch.begin());
+    const float min_sigma = MIN_SIGMA;
+    const float sigma = std::max(MAD_TO_SIGMA * median(_scratch, n), min_sigma);
+    const float limit = _threshold * sigma;
+
+    // Refine the estimate as the mean of the inliers
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+    int inliers = 0;
+    for (int i = 0; i < n; ++i) {
+        if (_distance[i] <= limit) {
+            sum_x += vx[i];
+            sum_y += vy[i];
+            inliers++;
+        }
+    }
+
+    // A zero threshold may reject every feature, fall back to the median
+    if (inliers == 0) {
+        result.ego_vel_x = med_x;
+        result.ego_vel_y = med_y;
+        return true;
+    }
+
+    const float mean_x = static_cast<float>(sum_x / inliers);
+    const float mean_y = static_cast<float>(sum_y / inliers);
+
+    // RMS deviation of the inliers from the refined estimate
+    double sum_sq = 0.0;
+    for (int i = 0; i < n; ++i) {
+        if (_distance[i] <= limit) {
+            const float ex = vx[i] - mean_x;
+            const float ey = vy[i] - mean_y;
+            sum_sq += ex * ex + ey * ey;
+        }
+    }
+
+    result.ego_vel_x = mean_x;
+    result.ego_vel_y = mean_y;
+    result.inlier_count = inliers;
+    result.residual = static_cast<float>(std::sqrt(sum_sq / inliers));
+    return true;
+}
@@ -4,23 +4,118 @@
  *
  * This S-Function integrates the OpticalFlowTracking class with Simulink,
  * enabling real-time velocity estimation from camera images within Simulink models.
+ * A single block can process N cameras at once through OpticalFlowTrackingBatch,
+ * which steps the per-camera trackers in parallel.
  *
  * @section inputs Inputs
- * - Port 0: Image matrix (height x width, normalized 0-1)
+ * - Port 0: Image matrix (height x width, or height x width x N for N cameras;
+ *           double/single normalized 0-1, or uint8 0-255)
  * - Port 1: Delta time (scalar, seconds between frames)
+ * - Port 2: Height above ground (scalar, meters), only present when enabled
+ *           by P(32). Replaces P(31) while positive
+ * - Port 3: Camera angular rate ([wx; wy; wz] in rad/s about X forward,
+ *           Y left and Z up, shared by all cameras), only present when
+ *           enabled by P(33). The rotation-induced flow is removed before
+ *           the velocities are scaled
+ *
+ * With an internal frame source (P(25)) the image port is removed and the
+ * other inputs move up by one. Without the height port the angular rate
+ * takes its place.
  *
  * @section outputs Outputs
- * - Port 0: Velocity estimates (2 x 1000 matrix, [vx; vy] for each feature)
- * - Port 1: Calculation time (scalar, seconds)
- * - Port 2: Number of valid samples (scalar)
+ * - Port 0: Velocity estimates (2 x 1000 matrix, [vx; vy] for each feature,
+ *           2 x 1000 x N for N cameras), only present when the per-feature
+ *           output (P(10)) is enabled. As a variable-size signal (P(40)) it
+ *           is 2 x M (x N) with M the largest valid feature count, in single
+ *           precision with P(41)
+ * - Port 1: Per-stage timing (7 x N, seconds: total, ingestion, pyramid,
+ *           tracking, conversion, detection, aggregation). Only the total is
+ *           measured unless built with OPTICAL_FLOW_PROFILING
+ * - Port 2: Number of valid samples (N x 1)
+ * - Port 3: Robust ego velocity ([vx; vy; inlier count; residual], 4 x N)
+ * - Port 4: Heap allocations made by OpenCV during the step (scalar, 0 in
+ *           steady state)
+ * - Port 5: Feature budget the step was processed with ([corners; pyramid
+ *           levels; iterations], 3 x N), lowered from the configured values
+ *           while the latency target (P(36)) is exceeded
+ *
+ * When the per-feature output is disabled the remaining ports move up by one.
+ * With a single camera the ports keep their vector shapes.
  *
  * @section parameters Parameters
- * - P(0): Camera focal length (meters)
- * - P(1): CMOS sensor height (meters)
- * - P(2): CMOS sensor width (meters)
+ * - P(0): Camera focal length (meters, scalar or one value per camera)
+ * - P(1): CMOS sensor height (meters, scalar or one value per camera)
+ * - P(2): CMOS sensor width (meters, scalar or one value per camera)
  * - P(3): Unique instance ID (for multi-instance support)
  * - P(4): Image height (pixels)
  * - P(5): Image width (pixels)
+ *
+ * Optional parameters (defaults are used when omitted):
+ * - P(6): Feature procedure (1 = re-detect every frame, 2 = detect once,
+ *         3 = incremental grid maintenance; default 1)
+ * - P(7): Lucas-Kanade window size (pixels, default 16)
+ * - P(8): Lucas-Kanade maximum pyramid level (default 2)
+ * - P(9): Velocity conversion (0 = exact std::tan, 1 = vectorized fast tan; default 1)
+ * - P(10): Per-feature velocity output port (1 = enabled, 0 = removed; default 1)
+ * - P(11): Ego velocity inlier threshold (robust standard deviations, default 3)
+ * - P(12): Pipeline mode (0 = synchronous, 1 = overlap feature detection on a
+ *          worker thread, 2 = process on a worker thread with one frame of
+ *          added latency; default 0)
+ * - P(13): Number of cameras N stacked along the third image dimension (default 1)
+ * - P(14): Region of interest [row, column, height, width] (1-based pixels;
+ *          empty or zeros for the full frame)
+ * - P(15): Decimation factor applied to the region with area averaging
+ *          (integer, default 1)
+ * - P(16): Optical flow method (100 = Lucas-Kanade on the CPU, 101 = DIS dense
+ *          flow sampled on a grid, 102 = Lucas-Kanade on a CUDA device; default 100)
+ * - P(17): Corner detector (1000 = Shi-Tomasi, 1001 = FAST with grid bucketing,
+ *          1002 = AGAST with grid bucketing; default 1000)
+ * - P(18): Maximum number of corners (1 to 1000, default 1000)
+ * - P(19): Shi-Tomasi quality level (default 0.1)
+ * - P(20): Minimum distance between corners (pixels, default 8)
+ * - P(21): Shi-Tomasi block size (pixels, default 2)
+ * - P(22): FAST/AGAST intensity threshold (gray levels, default 20)
+ * - P(23): Maximum Lucas-Kanade tracking error of a feature (mean absolute
+ *          gray-level difference; 0 = no limit, default 0)
+ * - P(24): Maximum forward-backward tracking error of a feature (pixels;
+ *          0 = no forward-backward check, default 0)
+ * - P(25): Frame source (0 = image input port, 1 = read frames inside the
+ *          block from the sources in P(26); default 0)
+ * - P(26): Frame source per camera, separated by ';' (character vector):
+ *          "raw:<file>" memory-mapped raw 8-bit frames, "v4l2:<device>" V4L2
+ *          device, a camera index, or a video file name or URL
+ * - P(27): Trace file (character vector; empty = no trace, default empty),
+ *          see TraceRecorder for the format
+ * - P(28): Number of records kept in the trace ring (default 10000)
+ * - P(29): Trace velocity precision (16 = half, 32 = single; default 16)
+ * - P(30): Record the feature positions in the trace (1 = yes, default 0)
+ * - P(31): Camera height above ground (meters, default 1)
+ * - P(32): Height above ground input port (1 = present, default 0)
+ * - P(33): Angular rate input port (1 = present, default 0)
+ * - P(34): Lens intrinsics [fx; fy; cx; cy] in image pixels with a 1-based
+ *          principal point, as in MATLAB cameraIntrinsics (one column per
+ *          camera or shared; empty = no lens model, default)
+ * - P(35): Lens distortion coefficients in OpenCV order [k1 k2 p1 p2 k3 ...]
+ *          (4, 5, 8, 12 or 14 values; one column per camera or shared;
+ *          default none). Tracked features, not frames, are undistorted
+ * - P(36): Step time target (seconds; 0 = fixed budget, default 0). Corners,
+ *          pyramid levels and iterations are reduced while the measured
+ *          total step time exceeds it and restored once there is headroom
+ * - P(37): Keyframe displacement (pixels; 0 = track frame to frame, default
+ *          0). Features are tracked from a retained keyframe and only
+ *          re-detected once their mean displacement exceeds this value or
+ *          too many are lost
+ * - P(38): Low-motion early-out shift (pixels; 0 = disabled, default 0).
+ *          Frames phase correlated to move less than this are not tracked
+ * - P(39): Parallel tracking bands (0 = one Lucas-Kanade call, default 0).
+ *          Features are tracked in this many horizontal image bands on the
+ *          OpenCV thread pool, with identical outputs
+ * - P(40): Per-feature port size (0 = fixed 2 x 1000, 1 = variable size
+ *          with the valid features only; default 0)
+ * - P(41): Per-feature port data type (0 = double, 1 = single; default 0)
+ *
+ * P(7)-P(9), P(11), P(17)-P(24), P(31) and P(36) are tunable while the simulation
+ * runs, all other parameters are fixed once it starts.
  */
 
 #define S_FUNCTION_NAME s_function
@@ -30,34 +125,654 @@
 
 #include "simstruc.h"
 #include "optical_flow_velocity.hpp"
+#include "block_tracker.hpp"
+#include "optical_flow_codegen.h"
+#include "image_ingestion.hpp"
+#include "instance_registry.hpp"
+#include "mat_arena_allocator.hpp"
+#include "frame_prefetcher.hpp"
+#include "trace_recorder.hpp"
 #include <chrono>
-#include <map>
+#include <cstdio>
 #include <memory>
+#include <string>
+#include <vector>
 #include <algorithm>
 
 /**
- * @brief Clamp a value between minimum and maximum bounds
+ * @brief Number of required S-Function parameters (P(0) to P(5))
+ */
+static constexpr int NUM_REQUIRED_PARAMS = 6;
+
+/**
+ * @brief Total number of S-Function parameters including optional ones
+ */
+static constexpr int NUM_PARAMS = 42;
+
+/**
+ * @brief Read an optional scalar S-Function parameter
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param index Parameter index
+ * @param default_value Value returned when the parameter was not supplied
+ * @return Parameter value or default
+ */
+static double getOptionalParam(SimStruct* S, int index, double default_value) {
+    if (ssGetSFcnParamsCount(S) <= index) {
+        return default_value;
+    }
+    return mxGetScalar(ssGetSFcnParam(S, index));
+}
+
+/**
+ * @brief Read a camera parameter given as a scalar or as one value per camera
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param index Parameter index
+ * @param camera Camera index
+ * @return Value for @p camera (the scalar is shared by all cameras)
+ */
+static double getCameraParam(SimStruct* S, int index, int camera) {
+    const mxArray* param = ssGetSFcnParam(S, index);
+    if (mxGetNumberOfElements(param) == 1) {
+        return mxGetScalar(param);
+    }
+    return mxGetPr(param)[camera];
+}
+
+/**
+ * @brief Get the number of cameras processed by the block
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return P(13), at least 1
+ */
+static int getNumCameras(SimStruct* S) {
+    return std::max(1, static_cast<int>(getOptionalParam(S, 13, 1.0)));
+}
+
+/**
+ * @brief Read the region of interest P(14) as a 0-based rectangle
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param height Image height in pixels
+ * @param width Image width in pixels
+ * @param roi Output region, the full frame when P(14) is omitted, empty or zero
+ * @return false if the region is malformed or not inside the image
+ */
+static bool getRegionOfInterest(SimStruct* S, int height, int width, cv::Rect& roi) {
+    roi = cv::Rect(0, 0, width, height);
+    if (ssGetSFcnParamsCount(S) <= 14) {
+        return true;
+    }
+
+    const mxArray* param = ssGetSFcnParam(S, 14);
+    const size_t count = mxGetNumberOfElements(param);
+    if (count == 0) {
+        return true;
+    }
+    if (count != 4) {
+        return false;
+    }
+
+    const double* values = mxGetPr(param);
+    if (values[0] == 0.0 && values[1] == 0.0 && values[2] == 0.0 && values[3] == 0.0) {
+        return true;
+    }
+    roi = cv::Rect(static_cast<int>(values[1]) - 1, static_cast<int>(values[0]) - 1,
+                   static_cast<int>(values[3]), static_cast<int>(values[2]));
+    return roi.x >= 0 && roi.y >= 0 && roi.width > 0 && roi.height > 0 &&
+           roi.x + roi.width <= width && roi.y + roi.height <= height;
+}
+
+/**
+ * @brief Width of the robust ego velocity output port
+ */
+static constexpr int EGO_VELOCITY_WIDTH = 4;
+
+/**
+ * @brief Width of the per-stage timing output port
+ */
+static constexpr int STAGE_TIMING_WIDTH = StageProfiler::NUM_STAGES;
+
+/**
+ * @brief Width of the feature budget output port
+ */
+static constexpr int FEATURE_BUDGET_WIDTH = 3;
+
+/**
+ * @brief Check whether the per-feature velocity output port is present
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return true if P(10) enables the 2 x 1000 per-feature port
+ */
+static bool hasPerFeatureOutput(SimStruct* S) {
+    return getOptionalParam(S, 10, 1.0) != 0.0;
+}
+
+/**
+ * @brief Check whether the per-feature velocity port is a variable-size signal
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return true if P(40) sizes the port by the valid features of the step
+ */
+static bool hasVariableFeatureOutput(SimStruct* S) {
+    return getOptionalParam(S, 40, 0.0) != 0.0;
+}
+
+/**
+ * @brief Check whether the per-feature velocity port is single precision
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return true if P(41) selects single instead of double
+ */
+static bool hasSingleFeatureOutput(SimStruct* S) {
+    return getOptionalParam(S, 41, 0.0) != 0.0;
+}
+
+/**
+ * @brief Check whether frames arrive on the image input port
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return false if P(25) selects the internal frame sources
+ */
+static bool hasImageInput(SimStruct* S) {
+    return getOptionalParam(S, 25, 0.0) == 0.0;
+}
+
+/**
+ * @brief Check whether the height above ground arrives on an input port
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return true if P(32) enables the height input port
+ */
+static bool hasHeightInput(SimStruct* S) {
+    return getOptionalParam(S, 32, 0.0) != 0.0;
+}
+
+/**
+ * @brief Check whether the camera angular rate arrives on an input port
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return true if P(33) enables the angular rate input port
+ */
+static bool hasRateInput(SimStruct* S) {
+    return getOptionalParam(S, 33, 0.0) != 0.0;
+}
+
+/**
+ * @brief Width of the angular rate input port
+ */
+static constexpr int ANGULAR_RATE_WIDTH = 3;
+
+/**
+ * @brief Prefetching readers of the internal frame sources, one per camera
+ */
+using FrameSources = std::vector<std::unique_ptr<FramePrefetcher>>;
+
+/**
+ * @brief Split the frame source specification P(26) into one entry per camera
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param specs Output specifications
+ * @return false if P(26) is missing or not a character vector
+ */
+static bool getFrameSourceSpecs(SimStruct* S, std::vector<std::string>& specs) {
+    specs.clear();
+    if (ssGetSFcnParamsCount(S) <= 26 || !mxIsChar(ssGetSFcnParam(S, 26))) {
+        return false;
+    }
+    char* text = mxArrayToString(ssGetSFcnParam(S, 26));
+    if (text == nullptr) {
+        return false;
+    }
+    const std::string joined(text);
+    mxFree(text);
+
+    size_t begin = 0;
+    for (;;) {
+        const size_t end = joined.find(';', begin);
+        specs.push_back(joined.substr(begin, end - begin));
+        if (end == std::string::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Read the trace file name P(27)
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param path Output file name, empty when no trace is recorded
+ * @return false if P(27) is given but not a character vector
+ */
+static bool getTracePath(SimStruct* S, std::string& path) {
+    path.clear();
+    if (ssGetSFcnParamsCount(S) <= 27 || mxIsEmpty(ssGetSFcnParam(S, 27))) {
+        return true;
+    }
+    if (!mxIsChar(ssGetSFcnParam(S, 27))) {
+        return false;
+    }
+    char* text = mxArrayToString(ssGetSFcnParam(S, 27));
+    if (text == nullptr) {
+        return false;
+    }
+    path = text;
+    mxFree(text);
+    return true;
+}
+
+/**
+ * @brief Read the lens models P(34) and P(35) of all cameras
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param num_cameras Number of cameras
+ * @param matrices Output OpenCV camera matrices, empty without a lens model
+ * @param coefficients Output distortion coefficients per camera
+ * @return false if the parameters are malformed
+ */
+static bool getLensModels(SimStruct* S, int num_cameras, std::vector<cv::Matx33d>& matrices,
+                          std::vector<std::vector<double>>& coefficients) {
+    matrices.clear();
+    coefficients.clear();
+    const int num_params = ssGetSFcnParamsCount(S);
+    const mxArray* intrinsics = (num_params > 34) ? ssGetSFcnParam(S, 34) : nullptr;
+    const mxArray* distortion = (num_params > 35) ? ssGetSFcnParam(S, 35) : nullptr;
+    const size_t num_intrinsics = (intrinsics != nullptr) ? mxGetNumberOfElements(intrinsics) : 0;
+    const size_t num_distortion = (distortion != nullptr) ? mxGetNumberOfElements(distortion) : 0;
+    if (num_intrinsics == 0) {
+        // Coefficients alone do not describe a lens
+        return num_distortion == 0;
+    }
+    if (!mxIsDouble(intrinsics) || mxIsComplex(intrinsics) ||
+        (num_intrinsics != 4 && num_intrinsics != 4 * static_cast<size_t>(num_cameras))) {
+        return false;
+    }
+
+    // A vector is shared by all cameras, a matrix has one column per camera
+    size_t per_camera = 4;
+    bool shared = true;
+    if (num_distortion > 0) {
+        if (!mxIsDouble(distortion) || mxIsComplex(distortion)) {
+            return false;
+        }
+        shared = mxGetM(distortion) == 1 || mxGetN(distortion) == 1;
+        per_camera = shared ? num_distortion : mxGetM(distortion);
+        if (!shared && mxGetN(distortion) != static_cast<size_t>(num_cameras)) {
+            return false;
+        }
+        if (per_camera != 4 && per_camera != 5 && per_camera != 8 && per_camera != 12 &&
+            per_camera != 14) {
+            return false;
+        }
+    }
+
+    const double* k = mxGetPr(intrinsics);
+    for (int camera = 0; camera < num_cameras; ++camera) {
+        const double* values = (num_intrinsics == 4) ? k : k + 4 * camera;
+        if (!(values[0] > 0.0) || !(values[1] > 0.0)) {
+            return false;
+        }
+        // OpenCV places the first pixel center at 0, MATLAB at 1
+        matrices.push_back(cv::Matx33d(values[0], 0.0, values[2] - 1.0,
+                                       0.0, values[1], values[3] - 1.0,
+                                       0.0, 0.0, 1.0));
+        if (num_distortion == 0) {
+            coefficients.push_back(std::vector<double>(per_camera, 0.0));
+        } else {
+            const double* d = mxGetPr(distortion) + (shared ? 0 : per_camera * camera);
+            coefficients.push_back(std::vector<double>(d, d + per_camera));
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Print the per-stage latency summary of every camera and the arena
+ *        usage to the MATLAB console
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param batch Trackers whose profilers are reported
+ */
+static void printProfileSummary(SimStruct* S, const TrackerBatch& batch) {
+    for (int camera = 0; camera < batch.size(); ++camera) {
+        const StageProfiler& profiler = batch.tracker(camera).profiler();
+        if (profiler.summary(StageProfiler::STAGE_TOTAL).count == 0) {
+            continue;
+        }
+        char buffer[1024];
+        profiler.format(buffer, sizeof(buffer));
+        ssPrintf("Optical flow stage timing for %s, camera %d:\n%s",
+                 ssGetPath(S), camera + 1, buffer);
+    }
+
+    const MatArenaAllocator& arena = MatArenaAllocator::instance();
+    ssPrintf("OpenCV arena: %.1f MiB, %llu heap allocations since start-up\n",
+             arena.capacity() / (1024.0 * 1024.0),
+             static_cast<unsigned long long>(arena.systemAllocations()));
+}
+
+/**
+ * @brief Block configuration read from the S-function parameters
+ *
+ * Filled and validated by readBlockConfig() in mdlCheckParameters and
+ * mdlStart. Each block keeps its copy for the whole simulation, so steps read
+ * plain fields instead of evaluating mxArrays. mdlProcessParameters only
+ * refreshes the tunable fields (see isTunableParam()).
+ */
+struct BlockConfig {
+    int instance_id = 0;            ///< P(3) unique instance ID
+    int height = 0;                 ///< P(4) image height (pixels)
+    int width = 0;                  ///< P(5) image width (pixels)
+    int num_cameras = 1;            ///< P(13) number of cameras
+    std::vector<CameraIntrinsics> cameras; ///< P(0)-P(2) per camera
+    int feature_procedure = OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC; ///< P(6)
+    int lk_window_size = OpticalFlowTracking::DEFAULT_LK_WINDOW_SIZE; ///< P(7), tunable
+    int lk_max_level = OpticalFlowTracking::DEFAULT_LK_MAX_LEVEL; ///< P(8), tunable
+    int conversion_mode = VelocityConversion::MODE_FAST; ///< P(9), tunable
+    bool per_feature = true;        ///< P(10) per-feature output port present
+    float inlier_threshold = RobustVelocityEstimator::DEFAULT_THRESHOLD; ///< P(11), tunable
+    int pipeline_mode = OpticalFlowTracking::PIPELINE_SYNCHRONOUS; ///< P(12)
+    cv::Rect roi;                   ///< P(14) as a 0-based rectangle
+    int decimation = 1;             ///< P(15)
+    int method = OpticalFlowTracking::OPTICAL_FLOW_LUCAS_KANADE; ///< P(16)
+    int detector = OpticalFlowTracking::FEATURE_EXTRACTION_OPENCV_SIMPLE; ///< P(17), tunable
+    int max_corners = OpticalFlowTracking::DEFAULT_MAX_CORNERS; ///< P(18), tunable
+    double quality_level = OpticalFlowTracking::DEFAULT_QUALITY_LEVEL; ///< P(19), tunable
+    double min_distance = OpticalFlowTracking::DEFAULT_MIN_DISTANCE; ///< P(20), tunable
+    int block_size = OpticalFlowTracking::DEFAULT_BLOCK_SIZE; ///< P(21), tunable
+    int detector_threshold = OpticalFlowTracking::DEFAULT_FAST_THRESHOLD; ///< P(22), tunable
+    float max_track_error = 0.0f;   ///< P(23), tunable
+    float max_fb_error = 0.0f;      ///< P(24), tunable
+    bool image_input = true;        ///< P(25) frames arrive on input port 0
+    std::vector<std::string> source_specs; ///< P(26) one internal source per camera
+    std::string trace_path;         ///< P(27) trace file, empty when disabled
+    uint32_t trace_capacity = 10000; ///< P(28) records kept in the trace ring
+    int trace_precision = 16;       ///< P(29) trace velocity bits
+    bool trace_positions = false;   ///< P(30) record feature positions
+    float height_above_ground = 1.0f; ///< P(31) camera height (meters), tunable
+    bool height_input = false;      ///< P(32) height above ground input port present
+    bool rate_input = false;        ///< P(33) angular rate input port present
+    std::vector<cv::Matx33d> lens_matrices; ///< P(34) per camera, empty without a lens model
+    std::vector<std::vector<double>> lens_distortion; ///< P(35) per camera
+    double latency_target = 0.0;    ///< P(36) step time target (seconds), tunable
+    float keyframe_displacement = 0.0f; ///< P(37) keyframe promotion displacement, 0 = off
+    float early_out = 0.0f;         ///< P(38) largest skipped shift (pixels), 0 = off
+    int tracking_tiles = 0;         ///< P(39) parallel tracking bands, 0 = one call
+    bool variable_features = false; ///< P(40) per-feature port sized by the valid features
+    bool single_features = false;   ///< P(41) per-feature port in single precision
+};
+
+/**
+ * @brief Check whether a parameter may change while the simulation runs
+ *
+ * Tracker tuning, the height above ground and the latency target can be
+ * changed between steps.
+ * Everything that sizes ports, buffers or threads is fixed at start-up.
+ *
+ * @param index Parameter index
+ * @return true for P(7)-P(9), P(11), P(17)-P(24), P(31) and P(36)
+ */
+static bool isTunableParam(int index) {
+    switch (index) {
+        case 7: case 8: case 9: case 11:
+        case 17: case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+        case 31: case 36:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Read and validate all block parameters
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param config Output configuration
+ * @return nullptr if the parameters are valid, otherwise the error message
+ */
+static const char* readBlockConfig(SimStruct* S, BlockConfig& config) {
+    for (int index = 0; index < NUM_REQUIRED_PARAMS; ++index) {
+        const mxArray* param = ssGetSFcnParam(S, index);
+        if (!mxIsNumeric(param) || mxIsComplex(param) || mxIsEmpty(param)) {
+            return "Required parameters (P1-P6) must be real, non-empty numeric values.";
+        }
+    }
+
+    config.instance_id = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 3)));
+    config.height = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 4)));
+    config.width = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 5)));
+    config.num_cameras = getNumCameras(S);
+    if (config.height < 1 || config.width < 1) {
+        return "Image size (P5, P6) must be positive.";
+    }
+
+    // Only the region of interest is ingested, optionally decimated
+    if (!getRegionOfInterest(S, config.height, config.width, config.roi)) {
+        return "Region of interest (P15) must be [row, column, height, width] inside the image.";
+    }
+    config.decimation = static_cast<int>(getOptionalParam(S, 15, 1.0));
+    if (config.decimation < 1 || config.roi.width / config.decimation < 1 ||
+        config.roi.height / config.decimation < 1) {
+        return "Decimation factor (P16) must be a positive integer no larger than the region of interest.";
+    }
+
+    // Camera parameters are either shared scalars or one value per camera
+    for (int index = 0; index < 3; ++index) {
+        const size_t count = mxGetNumberOfElements(ssGetSFcnParam(S, index));
+        if (count != 1 && count != static_cast<size_t>(config.num_cameras)) {
+            return "Camera parameters (P1-P3) must be scalars or have one value per camera.";
+        }
+    }
+    config.cameras.resize(config.num_cameras);
+    for (int camera = 0; camera < config.num_cameras; ++camera) {
+        config.cameras[camera].focal_length = static_cast<float>(getCameraParam(S, 0, camera));
+        config.cameras[camera].cmos_width = static_cast<float>(getCameraParam(S, 2, camera));
+        config.cameras[camera].cmos_height = static_cast<float>(getCameraParam(S, 1, camera));
+    }
+
+    config.feature_procedure = static_cast<int>(getOptionalParam(
+        S, 6, OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC));
+    if (config.feature_procedure < OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_DYNAMIC ||
+        config.feature_procedure > OpticalFlowTracking::FEATURE_EXTRACTION_PROCEDURE_INCREMENTAL) {
+        return "Feature procedure (P7) must be 1, 2 or 3.";
+    }
+
+    config.lk_window_size = static_cast<int>(getOptionalParam(
+        S, 7, OpticalFlowTracking::DEFAULT_LK_WINDOW_SIZE));
+    config.lk_max_level = static_cast<int>(getOptionalParam(
+        S, 8, OpticalFlowTracking::DEFAULT_LK_MAX_LEVEL));
+    config.conversion_mode = (getOptionalParam(S, 9, VelocityConversion::MODE_FAST) != 0.0)
+        ? VelocityConversion::MODE_FAST : VelocityConversion::MODE_EXACT;
+    config.per_feature = hasPerFeatureOutput(S);
+    config.inlier_threshold = static_cast<float>(getOptionalParam(
+        S, 11, RobustVelocityEstimator::DEFAULT_THRESHOLD));
+
+    config.pipeline_mode = static_cast<int>(getOptionalParam(
+        S, 12, OpticalFlowTracking::PIPELINE_SYNCHRONOUS));
+    if (config.pipeline_mode < OpticalFlowTracking::PIPELINE_SYNCHRONOUS ||
+        config.pipeline_mode > OpticalFlowTracking::PIPELINE_DEFERRED) {
+        return "Pipeline mode (P13) must be 0, 1 or 2.";
+    }
+
+    config.method = static_cast<int>(getOptionalParam(
+        S, 16, OpticalFlowTracking::OPTICAL_FLOW_LUCAS_KANADE));
+    if (!OpticalFlowTracking::isMethodAvailable(config.method)) {
+        return "Optical flow method (P17) must be 100, 101 or 102; 102 requires OpenCV with CUDA and a CUDA device.";
+    }
+
+    config.detector = static_cast<int>(getOptionalParam(
+        S, 17, OpticalFlowTracking::FEATURE_EXTRACTION_OPENCV_SIMPLE));
+    if (config.detector < OpticalFlowTracking::FEATURE_EXTRACTION_OPENCV_SIMPLE ||
+        config.detector > OpticalFlowTracking::FEATURE_EXTRACTION_AGAST_GRID) {
+        return "Corner detector (P18) must be 1000, 1001 or 1002.";
+    }
+    config.max_corners = static_cast<int>(getOptionalParam(
+        S, 18, OpticalFlowTracking::DEFAULT_MAX_CORNERS));
+    if (config.max_corners < 1 || config.max_corners > OpticalFlowTracking::DEFAULT_MAX_CORNERS) {
+        return "Maximum number of corners (P19) must be between 1 and 1000.";
+    }
+    config.quality_level = getOptionalParam(S, 19, OpticalFlowTracking::DEFAULT_QUALITY_LEVEL);
+    config.min_distance = getOptionalParam(S, 20, OpticalFlowTracking::DEFAULT_MIN_DISTANCE);
+    config.block_size = static_cast<int>(getOptionalParam(
+        S, 21, OpticalFlowTracking::DEFAULT_BLOCK_SIZE));
+    config.detector_threshold = static_cast<int>(getOptionalParam(
+        S, 22, OpticalFlowTracking::DEFAULT_FAST_THRESHOLD));
+    config.max_track_error = static_cast<float>(getOptionalParam(S, 23, 0.0));
+    config.max_fb_error = static_cast<float>(getOptionalParam(S, 24, 0.0));
+    if (config.max_track_error < 0.0f || config.max_fb_error < 0.0f) {
+        return "Tracking error limits (P24, P25) must not be negative.";
+    }
+
+    config.image_input = hasImageInput(S);
+    if (!config.image_input && (!getFrameSourceSpecs(S, config.source_specs) ||
+                                static_cast<int>(config.source_specs.size()) != config.num_cameras)) {
+        return "Frame sources (P27) must be a character vector with one ';'-separated source per camera.";
+    }
+
+    if (!getTracePath(S, config.trace_path)) {
+        return "Trace file (P28) must be a character vector.";
+    }
+    const double trace_capacity = getOptionalParam(S, 28, 10000.0);
+    config.trace_precision = static_cast<int>(getOptionalParam(S, 29, 16.0));
+    config.trace_positions = getOptionalParam(S, 30, 0.0) != 0.0;
+    if (trace_capacity < 1.0 || trace_capacity > 4294967295.0 ||
+        (config.trace_precision != 16 && config.trace_precision != 32)) {
+        return "Trace capacity (P29) must be positive and precision (P30) 16 or 32.";
+    }
+    config.trace_capacity = static_cast<uint32_t>(trace_capacity);
+
+    config.height_above_ground = static_cast<float>(getOptionalParam(S, 31, 1.0));
+    if (!(config.height_above_ground > 0.0f)) {
+        return "Height above ground (P32) must be positive.";
+    }
+    config.height_input = hasHeightInput(S);
+    config.rate_input = hasRateInput(S);
+    if (!getLensModels(S, config.num_cameras, config.lens_matrices, config.lens_distortion)) {
+        return "Lens intrinsics (P35) must be [fx; fy; cx; cy] with positive focal lengths and distortion (P36) 4, 5, 8, 12 or 14 coefficients, each shared or one column per camera.";
+    }
+    config.latency_target = getOptionalParam(S, 36, 0.0);
+    if (!(config.latency_target >= 0.0)) {
+        return "Latency target (P37) must not be negative.";
+    }
+    config.keyframe_displacement = static_cast<float>(getOptionalParam(S, 37, 0.0));
+    config.early_out = static_cast<float>(getOptionalParam(S, 38, 0.0));
+    if (!(config.keyframe_displacement >= 0.0f) || !(config.early_out >= 0.0f)) {
+        return "Keyframe displacement (P38) and early-out shift (P39) must not be negative.";
+    }
+    config.tracking_tiles = static_cast<int>(getOptionalParam(S, 39, 0.0));
+    if (config.tracking_tiles < 0) {
+        return "Parallel tracking bands (P40) must not be negative.";
+    }
+    config.variable_features = hasVariableFeatureOutput(S);
+    config.single_features = hasSingleFeatureOutput(S);
+
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+    // The fixed-size tracker only accepts the geometry it was compiled for
+    if (config.num_cameras != 1 ||
+        config.roi.height / config.decimation != TrackerBatch::HEIGHT ||
+        config.roi.width / config.decimation != TrackerBatch::WIDTH) {
+        return "Block was built for a fixed frame size (FIXED_FRAME_SIZE), the processed frame size and single camera must match it.";
+    }
+#endif
+    return nullptr;
+}
+
+/**
+ * @brief Apply the tunable parameters of a configuration to the trackers
+ *
+ * Changing the Lucas-Kanade window or pyramid depth restarts tracking on
+ * the next frame, the other settings take effect on the next step. Every
+ * setter drains the pipeline and several restart the feature budget, so
+ * only the settings whose values changed are applied.
  *
- * @tparam T Numeric type
- * @param value Value to clamp
- * @param minVal Minimum allowed value
- * @param maxVal Maximum allowed value
- * @return Clamped value
+ * @param batch Trackers to configure
+ * @param config Configuration to apply
+ * @param previous Configuration applied before, nullptr at start-up
  */
-template <typename T>
-T clamp(T value, T minVal, T maxVal) {
-    return (value < minVal) ? minVal : (value > maxVal) ? maxVal : value;
+static void applyTunableParameters(TrackerBatch& batch, const BlockConfig& config,
+                                   const BlockConfig* previous) {
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+    // Window and pyramid depth are template arguments of the fixed tracker
+    (void)previous;
+#else
+    if (previous == nullptr || previous->lk_window_size != config.lk_window_size ||
+        previous->lk_max_level != config.lk_max_level) {
+        batch.setPyramidParameters(config.lk_window_size, config.lk_max_level);
+    }
+#endif
+    if (previous == nullptr || previous->detector != config.detector ||
+        previous->detector_threshold != config.detector_threshold) {
+        batch.setFeatureDetector(config.detector, config.detector_threshold);
+    }
+    if (previous == nullptr || previous->max_corners != config.max_corners ||
+        previous->quality_level != config.quality_level ||
+        previous->min_distance != config.min_distance ||
+        previous->block_size != config.block_size) {
+        batch.setDetectorParameters(config.max_corners, config.quality_level,
+                                    config.min_distance, config.block_size);
+    }
+    if (previous == nullptr || previous->conversion_mode != config.conversion_mode) {
+        batch.setVelocityConversionMode(config.conversion_mode);
+    }
+    if (previous == nullptr || previous->inlier_threshold != config.inlier_threshold) {
+        batch.setRobustAggregation(true, config.inlier_threshold);
+    }
+    if (previous == nullptr || previous->max_track_error != config.max_track_error ||
+        previous->max_fb_error != config.max_fb_error) {
+        batch.setOutlierRejection(config.max_track_error, config.max_fb_error);
+    }
+    if (previous == nullptr || previous->latency_target != config.latency_target) {
+        batch.setLatencyTarget(config.latency_target);
+    }
 }
 
 #ifndef USE_PERSISTENT_MEMORY
+/**
+ * @brief Maximum number of blocks in static memory mode (instance IDs 0 to 255)
+ */
+static constexpr int MAX_INSTANCES = 256;
+
+/**
+ * @brief Per-block state in static memory mode
+ */
+struct BlockInstance {
+    FrameSources sources;           ///< Internal frame sources, stopped before the trackers go
+    std::unique_ptr<TraceRecorder> recorder; ///< Result trace, null when disabled
+    std::unique_ptr<TrackerBatch> batch; ///< Per-camera trackers, frames and results
+    std::unique_ptr<ImageIngestion> ingestion;       ///< Simulink to OpenCV conversion
+    BlockConfig config;             ///< Parameters read in mdlStart
+};
+
 /**
  * @brief Static storage for multiple S-Function instances
  *
- * When not using persistent memory, these maps store tracker instances
- * and temporary image buffers indexed by unique instance IDs.
+ * When not using persistent memory, each block claims the slot of its unique
+ * instance ID in mdlStart and caches the slot pointer in its user data, so
+ * mdlOutputs never searches or locks the registry.
+ */
+static InstanceRegistry<BlockInstance, MAX_INSTANCES> instance_registry;
+#endif
+
+#if defined(MATLAB_MEX_FILE)
+#define MDL_CHECK_PARAMETERS
+/**
+ * @brief Validate the block parameters
+ *
+ * Called by mdlInitializeSizes and whenever a parameter changes in the block
+ * dialog, so invalid values are reported before the simulation starts.
+ *
+ * @param S SimStruct pointer containing S-Function state
  */
-static std::map<int, std::shared_ptr<OpticalFlowTracking>> obj_map;
-static std::map<int, std::shared_ptr<cv::Mat>> img_map;
+static void mdlCheckParameters(SimStruct* S) {
+    BlockConfig config;
+    const char* error = readBlockConfig(S, config);
+    if (error != nullptr) {
+        ssSetErrorStatus(S, error);
+    }
+}
 #endif
 
 /**
@@ -69,54 +784,190 @@ static std::map<int, std::shared_ptr<cv::Mat>> img_map;
  * @param S SimStruct pointer containing S-Function state
  */
 static void mdlInitializeSizes(SimStruct* S) {
-    // Verify that exactly 6 parameters are provided to the S-function
-    ssSetNumSFcnParams(S, 6);
+    // Verify that the 6 required parameters, and at most the optional ones, are provided
+    const int num_params = ssGetSFcnParamsCount(S);
+    if (num_params < NUM_REQUIRED_PARAMS || num_params > NUM_PARAMS) {
+        ssSetErrorStatus(S, "S-function expects 6 required parameters followed by optional tuning parameters.");
+        return;
+    }
+    ssSetNumSFcnParams(S, num_params);
     if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
         return;
     }
+#if defined(MATLAB_MEX_FILE)
+    mdlCheckParameters(S);
+    if (ssGetErrorStatus(S) != nullptr) {
+        return;
+    }
+#endif
+
+    // Only tracker tuning and the height above ground can change during simulation
+    for (int index = 0; index < num_params; ++index) {
+        ssSetSFcnParamTunable(S, index, isTunableParam(index));
+    }
 
     // Extract image dimensions and instance ID from parameters
     const int height = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 4)));
     const int width = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 5)));
     const int instance_id = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 3)));
+    const int num_cameras = getNumCameras(S);
 
     // Configure input ports
-    // Port 0: Image matrix (height × width), direct feedthrough required
+    // Port 0: Image matrix (height × width, × N cameras), direct feedthrough required
+    //         Contiguous so it can be ingested in tiles; double, single or uint8
+    //         Absent when the block reads its frames from internal sources
     // Port 1: Delta time scalar, direct feedthrough required
-    if (!ssSetNumInputPorts(S, 2)) {
+    // Port 2: Height above ground scalar, optional
+    // Port 3: Angular rate (wx, wy, wz), optional
+    const bool image_input = hasImageInput(S);
+    const bool height_input = hasHeightInput(S);
+    const bool rate_input = hasRateInput(S);
+    const int delta_port = image_input ? 1 : 0;
+    const int height_port = delta_port + 1;
+    const int rate_port = height_port + (height_input ? 1 : 0);
+    if (!ssSetNumInputPorts(S, rate_port + (rate_input ? 1 : 0))) {
         return;
     }
-    ssSetInputPortMatrixDimensions(S, 0, height, width);
-    ssSetInputPortDirectFeedThrough(S, 0, 1);
+    if (image_input) {
+        if (num_cameras == 1) {
+            ssSetInputPortMatrixDimensions(S, 0, height, width);
+        } else {
+            DECL_AND_INIT_DIMSINFO(image_dims);
+            int_T dims[3] = {height, width, num_cameras};
+            image_dims.numDims = 3;
+            image_dims.dims = dims;
+            image_dims.width = height * width * num_cameras;
+            ssSetInputPortDimensionInfo(S, 0, &image_dims);
+        }
+        ssSetInputPortDataType(S, 0, DYNAMICALLY_TYPED);
+        ssSetInputPortRequiredContiguous(S, 0, 1);
+        ssSetInputPortDirectFeedThrough(S, 0, 1);
+    }
 
-    ssSetInputPortWidth(S, 1, 1);
-    ssSetInputPortDirectFeedThrough(S, 1, 1);
+    ssSetInputPortWidth(S, delta_port, 1);
+    ssSetInputPortDirectFeedThrough(S, delta_port, 1);
+    if (height_input) {
+        ssSetInputPortWidth(S, height_port, 1);
+        ssSetInputPortDirectFeedThrough(S, height_port, 1);
+    }
+    if (rate_input) {
+        ssSetInputPortWidth(S, rate_port, ANGULAR_RATE_WIDTH);
+        ssSetInputPortDirectFeedThrough(S, rate_port, 1);
+    }
 
-    // Configure output ports
-    // Port 0: Velocity estimates (2 × 1000 for vx, vy pairs)
-    // Port 1: Computation time (scalar)
-    // Port 2: Number of valid features (scalar)
-    if (!ssSetNumOutputPorts(S, 3)) {
+    // Configure output ports, one column (or page) per camera
+    // Port 0: Velocity estimates (2 × 1000 for vx, vy pairs), optional, variable size or single
+    // Port 1: Per-stage computation time (total first)
+    // Port 2: Number of valid features
+    // Port 3: Robust ego velocity (vx, vy, inlier count, residual)
+    // Port 4: Heap allocations of the step
+    // Port 5: Feature budget (corners, pyramid levels, iterations)
+    const bool per_feature = hasPerFeatureOutput(S);
+    const int port_base = per_feature ? 1 : 0;
+    if (!ssSetNumOutputPorts(S, port_base + 5)) {
         return;
     }
-    ssSetOutputPortMatrixDimensions(S, 0, 2, 1000);
-    ssSetOutputPortWidth(S, 1, 1);
-    ssSetOutputPortWidth(S, 2, 1);
+    ssSetOutputPortWidth(S, port_base + 3, 1);
+    if (num_cameras == 1) {
+        if (per_feature) {
+            ssSetOutputPortMatrixDimensions(S, 0, 2, MAX_OUTPUT_FEATURES);
+        }
+        ssSetOutputPortWidth(S, port_base + 0, STAGE_TIMING_WIDTH);
+        ssSetOutputPortWidth(S, port_base + 1, 1);
+        ssSetOutputPortWidth(S, port_base + 2, EGO_VELOCITY_WIDTH);
+        ssSetOutputPortWidth(S, port_base + 4, FEATURE_BUDGET_WIDTH);
+    } else {
+        if (per_feature) {
+            DECL_AND_INIT_DIMSINFO(feature_dims);
+            int_T dims[3] = {2, MAX_OUTPUT_FEATURES, num_cameras};
+            feature_dims.numDims = 3;
+            feature_dims.dims = dims;
+            feature_dims.width = 2 * MAX_OUTPUT_FEATURES * num_cameras;
+            ssSetOutputPortDimensionInfo(S, 0, &feature_dims);
+        }
+        ssSetOutputPortMatrixDimensions(S, port_base + 0, STAGE_TIMING_WIDTH, num_cameras);
+        ssSetOutputPortWidth(S, port_base + 1, num_cameras);
+        ssSetOutputPortMatrixDimensions(S, port_base + 2, EGO_VELOCITY_WIDTH, num_cameras);
+        ssSetOutputPortMatrixDimensions(S, port_base + 4, FEATURE_BUDGET_WIDTH, num_cameras);
+    }
+    if (per_feature) {
+        // The dimensions above are the upper bound of a variable-size port
+        if (hasVariableFeatureOutput(S)) {
+            ssSetOutputPortDimensionsMode(S, 0, VARIABLE_DIMS_MODE);
+        }
+        ssSetOutputPortDataType(S, 0, hasSingleFeatureOutput(S) ? SS_SINGLE : SS_DOUBLE);
+    }
 
     ssSetNumSampleTimes(S, 1);
 
+    // Block state of the generated code (s_function.tlc), unused in simulation
+    ssSetNumDWork(S, 1);
+    ssSetDWorkWidth(S, 0, static_cast<int>(optical_flow_codegen_storage_size()));
+    ssSetDWorkDataType(S, 0, SS_UINT8);
+    ssSetDWorkName(S, 0, "Storage");
+
 #ifdef USE_PERSISTENT_MEMORY
-    // Reserve 2 persistent work pointers: one for tracker, one for image buffer
-    ssSetNumPWork(S, 2);
+    // Reserve 5 persistent work pointers: tracker batch, ingestion stage, frame sources,
+    // result trace and block configuration
+    ssSetNumPWork(S, 5);
 #endif
 
-    ssSetOperatingPointCompliance(S, USE_DEFAULT_OPERATING_POINT);
+    // The tracker state lives behind the work pointers, see mdlGetOperatingPoint
+    ssSetOperatingPointCompliance(S, USE_CUSTOM_OPERATING_POINT);
     ssSetRuntimeThreadSafetyCompliance(S, RUNTIME_THREAD_SAFETY_COMPLIANCE_TRUE);
     ssSetOptions(S,
                  SS_OPTION_WORKS_WITH_CODE_REUSE |
                  SS_OPTION_EXCEPTION_FREE_CODE |
                  SS_OPTION_USE_TLC_WITH_ACCELERATOR);
 }
+#if defined(MATLAB_MEX_FILE)
+#define MDL_SET_INPUT_PORT_DATA_TYPE
+/**
+ * @brief Accept the data type propagated to an input port
+ *
+ * The image port accepts double and single (normalized 0-1) as well as uint8
+ * (0-255) frames, so cameras delivering 8-bit data need no conversion block.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param port Input port index
+ * @param dType Proposed data type identifier
+ */
+static void mdlSetInputPortDataType(SimStruct* S, int_T port, DTypeId dType) {
+    if (port == 0 && hasImageInput(S) && dType != SS_DOUBLE && dType != SS_SINGLE && dType != SS_UINT8) {
+        ssSetErrorStatus(S, "Image input must be double, single or uint8.");
+        return;
+    }
+    ssSetInputPortDataType(S, port, dType);
+}
+
+#define MDL_SET_DEFAULT_PORT_DATA_TYPES
+/**
+ * @brief Fall back to double for the image port when no type is propagated
+ *
+ * @param S SimStruct pointer containing S-Function state
+ */
+static void mdlSetDefaultPortDataTypes(SimStruct* S) {
+    if (hasImageInput(S) && ssGetInputPortDataType(S, 0) == DYNAMICALLY_TYPED) {
+        ssSetInputPortDataType(S, 0, SS_DOUBLE);
+    }
+}
+#endif
+
+#define MDL_SET_WORK_WIDTHS
+/**
+ * @brief Declare how the variable-size velocity port is sized
+ *
+ * The current dimensions are set by mdlOutputs from the tracked features,
+ * not derived from the input dimensions.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ */
+static void mdlSetWorkWidths(SimStruct* S) {
+    if (hasPerFeatureOutput(S) && hasVariableFeatureOutput(S)) {
+        ssSetSignalSizesComputeType(S, SS_VARIABLE_SIZE_FROM_INPUT_VALUE_AND_SIZE);
+    }
+}
+
 /**
  * @brief Initialize sample times for the S-Function
  *
@@ -133,181 +984,621 @@ static void mdlInitializeSampleTimes(SimStruct* S) {
 }
 
 /**
- * @brief Initialize the optical flow tracker
+ * @brief Initialize the optical flow trackers
  *
- * Called once at the start of simulation to create and configure
- * the OpticalFlowTracking instance with camera parameters.
+ * Called once at the start of simulation to create and configure one
+ * OpticalFlowTracking instance per camera with its camera parameters, and
+ * to open the internal frame sources when P(25) selects them.
  *
  * @param S SimStruct pointer containing S-Function state
  */
 static void mdlStart(SimStruct* S) {
-    // Extract camera parameters from S-function block parameters
-    const double focal_length = mxGetScalar(ssGetSFcnParam(S, 0));
-    const double cmos_width = mxGetScalar(ssGetSFcnParam(S, 2));
-    const double cmos_height = mxGetScalar(ssGetSFcnParam(S, 1));
-    const int instance_id = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 3)));
-    const int height = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 4)));
-    const int width = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 5)));
+    // Read all parameters once, steps only use the cached configuration
+    std::unique_ptr<BlockConfig> config(new BlockConfig());
+    const char* error = readBlockConfig(S, *config);
+    if (error != nullptr) {
+        ssSetErrorStatus(S, error);
+        return;
+    }
+
+    // Records are appended in mdlOutputs, the file is sized and mapped here
+    std::unique_ptr<TraceRecorder> recorder;
+    if (!config->trace_path.empty()) {
+        const uint32_t flags =
+            ((config->trace_precision == 16) ? TraceRecorder::FLAG_HALF_VELOCITIES : 0) |
+            (config->trace_positions ? TraceRecorder::FLAG_POSITIONS : 0);
+        try {
+            // Records hold the output capacity, P(18) is tunable and may grow mid-run
+            recorder.reset(new TraceRecorder(config->trace_path, config->trace_capacity,
+                                             MAX_OUTPUT_FEATURES, flags));
+        } catch (const cv::Exception& e) {
+            static char message[512];
+            std::snprintf(message, sizeof(message), "Could not create trace file '%s': %s",
+                          config->trace_path.c_str(), e.what());
+            ssSetErrorStatus(S, message);
+            return;
+        }
+    }
+
+    // All camera planes share the frame size, one ingestion stage serves them all
+    const cv::Size sensor_size(config->width, config->height);
+    std::unique_ptr<ImageIngestion> ingestion(new ImageIngestion(
+        config->height, config->width, config->roi, config->decimation));
+    const cv::Size frame_size = ingestion->outputSize();
+
+    // Every cv::Mat allocated from here on, including OpenCV's internal
+    // temporaries, is served from an arena sized for the processed frames
+    // (plus the prefetch slots and decode buffers of internal sources)
+    const size_t source_budget = config->image_input ? 0 :
+        FramePrefetcher::frameBudget(sensor_size, frame_size);
+    MatArenaAllocator::instance().acquire(
+        config->num_cameras * (MatArenaAllocator::frameBudget(frame_size) + source_budget));
+
+    // Sources start decoding right away, the first frames are queued before the first step
+    FrameSources sources;
+    for (const std::string& spec : config->source_specs) {
+        try {
+            sources.emplace_back(new FramePrefetcher(
+                FrameSource::open(spec, sensor_size), *ingestion));
+        } catch (const cv::Exception& e) {
+            // Simulink reads the message after mdlStart returns
+            static char message[512];
+            std::snprintf(message, sizeof(message), "Could not open frame source '%s': %s",
+                          spec.c_str(), e.what());
+            sources.clear();
+            MatArenaAllocator::instance().release();
+            ssSetErrorStatus(S, message);
+            return;
+        }
+    }
+
+    // Method selects the optical flow backend, initial delta_t = 1.0 second
+    // The batch owns the per-camera frame planes and preallocated results
+    // Trackers work on the ingested frames, their FOV is narrowed to the pixels used
+#if defined(OPTICAL_FLOW_FIXED_HEIGHT) && defined(OPTICAL_FLOW_FIXED_WIDTH)
+    std::unique_ptr<TrackerBatch> batch(new TrackerBatch(
+        config->method, 1.0f, config->cameras[0], config->feature_procedure));
+#else
+    std::unique_ptr<TrackerBatch> batch(new TrackerBatch(
+        config->method, 1.0f, config->cameras, frame_size.height, frame_size.width,
+        MAX_OUTPUT_FEATURES, config->feature_procedure));
+#endif
+    applyTunableParameters(*batch, *config, nullptr);
+    batch->setRotationCompensation(config->rate_input);
+    if (config->keyframe_displacement > 0.0f) {
+        batch->setKeyframeMode(true, config->keyframe_displacement);
+    }
+    batch->setEarlyOut(config->early_out);
+    batch->setParallelTracking(config->tracking_tiles);
+    batch->setPipelineMode(config->pipeline_mode);
+    batch->setRegionOfInterest(sensor_size,
+                               cv::Rect(config->roi.x, config->roi.y,
+                                        frame_size.width * config->decimation,
+                                        frame_size.height * config->decimation));
+    for (size_t camera = 0; camera < config->lens_matrices.size(); ++camera) {
+        batch->setLensDistortion(static_cast<int>(camera), config->lens_matrices[camera],
+                                 config->lens_distortion[camera]);
+    }
 
 #ifndef USE_PERSISTENT_MEMORY
-    // Static memory mode: Store tracker and image buffer in global maps indexed by instance ID
+    // Static memory mode: Claim the registry slot of this instance ID
     // This allows multiple S-function blocks to coexist in the same model
-    obj_map[instance_id] = std::make_shared<OpticalFlowTracking>(
-        100, 1.0f, static_cast<float>(focal_length),
-        static_cast<float>(cmos_width), static_cast<float>(cmos_height));
-    img_map[instance_id] = std::make_shared<cv::Mat>(height, width, CV_8UC1, cv::Scalar(0));
-#else
-    // Persistent memory mode: Allocate tracker and image buffer on heap
-    // Method 100 = Lucas-Kanade optical flow, initial delta_t = 1.0 second
-    OpticalFlowTracking* tracker = new OpticalFlowTracking(
-        100, 1.0f, static_cast<float>(focal_length),
-        static_cast<float>(cmos_width), static_cast<float>(cmos_height));
-
-    if (tracker == nullptr) {
-        ssSetErrorStatus(S, "Failed to instantiate OpticalFlowTracking object.");
+    BlockInstance* instance = instance_registry.acquire(config->instance_id);
+    if (instance == nullptr) {
+        sources.clear();
+        batch.reset();
+        ingestion.reset();
+        MatArenaAllocator::instance().release();
+        ssSetErrorStatus(S, "Instance ID (P4) must be unique and between 0 and 255.");
         return;
     }
+    instance->config = std::move(*config);
+    instance->sources = std::move(sources);
+    instance->recorder = std::move(recorder);
+    instance->batch = std::move(batch);
+    instance->ingestion = std::move(ingestion);
 
-    // Allocate image buffer for converting Simulink data to OpenCV format
-    cv::Mat* image = new cv::Mat(height, width, CV_8UC1);
+    // Resolve the slot once, mdlOutputs uses the cached pointer
+    ssSetUserData(S, static_cast<void*>(instance));
+#else
+    // Persistent memory mode: Store the heap objects in the persistent work vector
+    ssSetPWorkValue(S, 0, static_cast<void*>(batch.release()));
+    ssSetPWorkValue(S, 1, static_cast<void*>(ingestion.release()));
+    ssSetPWorkValue(S, 2, static_cast<void*>(new FrameSources(std::move(sources))));
+    ssSetPWorkValue(S, 3, static_cast<void*>(recorder.release()));
+    ssSetPWorkValue(S, 4, static_cast<void*>(config.release()));
+#endif
+}
 
-    // Store pointers in persistent work vector for access in mdlOutputs
-    ssSetPWorkValue(S, 0, static_cast<void*>(tracker));
-    ssSetPWorkValue(S, 1, static_cast<void*>(image));
+#define MDL_PROCESS_PARAMETERS
+/**
+ * @brief Apply parameters changed while the simulation runs
+ *
+ * Simulink has validated the new values with mdlCheckParameters. Only the
+ * tunable parameters can change, they are copied into the cached
+ * configuration and applied to the trackers.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ */
+static void mdlProcessParameters(SimStruct* S) {
+#ifdef USE_PERSISTENT_MEMORY
+    BlockConfig* config = static_cast<BlockConfig*>(ssGetPWorkValue(S, 4));
+    TrackerBatch* batch = static_cast<TrackerBatch*>(ssGetPWorkValue(S, 0));
+#else
+    BlockInstance* instance = static_cast<BlockInstance*>(ssGetUserData(S));
+    BlockConfig* config = (instance != nullptr) ? &instance->config : nullptr;
+    TrackerBatch* batch = (instance != nullptr) ? instance->batch.get() : nullptr;
 #endif
+    if (config == nullptr || batch == nullptr) {
+        return;
+    }
+
+    BlockConfig updated;
+    const char* error = readBlockConfig(S, updated);
+    if (error != nullptr) {
+        ssSetErrorStatus(S, error);
+        return;
+    }
+
+    const BlockConfig previous = *config;
+    config->lk_window_size = updated.lk_window_size;
+    config->lk_max_level = updated.lk_max_level;
+    config->conversion_mode = updated.conversion_mode;
+    config->inlier_threshold = updated.inlier_threshold;
+    config->detector = updated.detector;
+    config->max_corners = updated.max_corners;
+    config->quality_level = updated.quality_level;
+    config->min_distance = updated.min_distance;
+    config->block_size = updated.block_size;
+    config->detector_threshold = updated.detector_threshold;
+    config->max_track_error = updated.max_track_error;
+    config->max_fb_error = updated.max_fb_error;
+    config->height_above_ground = updated.height_above_ground;
+    config->latency_target = updated.latency_target;
+    applyTunableParameters(*batch, *config, &previous);
 }
 
 /**
  * @brief Main computation function called at each simulation step
  *
- * Receives image data from Simulink, converts it to OpenCV format,
- * performs optical flow tracking, and outputs velocity estimates.
+ * Receives image data from Simulink, or takes the next prefetched frame of
+ * every internal source, converts every camera plane to OpenCV format,
+ * tracks all cameras in parallel, and outputs velocity estimates. The
+ * simulation is stopped when an internal source reaches its end.
  *
  * @param S SimStruct pointer containing S-Function state
  * @param tid Task ID (unused for single-tasking)
  */
 static void mdlOutputs(SimStruct* S, int_T tid) {
-    // Retrieve image dimensions and instance ID
-    const int height = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 4)));
-    const int width = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 5)));
-    const int instance_id = static_cast<int>(mxGetScalar(ssGetSFcnParam(S, 3)));
-
 #ifdef USE_PERSISTENT_MEMORY
     // Persistent memory mode: Retrieve pointers from work vector
-    OpticalFlowTracking* tracker = static_cast<OpticalFlowTracking*>(ssGetPWorkValue(S, 0));
-    cv::Mat* image = static_cast<cv::Mat*>(ssGetPWorkValue(S, 1));
+    TrackerBatch* batch = static_cast<TrackerBatch*>(ssGetPWorkValue(S, 0));
+    ImageIngestion* ingestion = static_cast<ImageIngestion*>(ssGetPWorkValue(S, 1));
+    FrameSources* sources = static_cast<FrameSources*>(ssGetPWorkValue(S, 2));
+    TraceRecorder* recorder = static_cast<TraceRecorder*>(ssGetPWorkValue(S, 3));
+    const BlockConfig* config = static_cast<const BlockConfig*>(ssGetPWorkValue(S, 4));
 #else
-    // Static memory mode: Retrieve from global maps
-    std::shared_ptr<cv::Mat> image = img_map[instance_id];
-    std::shared_ptr<OpticalFlowTracking> tracker = obj_map[instance_id];
+    // Static memory mode: Use the registry slot cached in mdlStart
+    BlockInstance* instance = static_cast<BlockInstance*>(ssGetUserData(S));
+    if (instance == nullptr) {
+        ssSetErrorStatus(S, "Block instance not registered.");
+        return;
+    }
+    TrackerBatch* batch = instance->batch.get();
+    ImageIngestion* ingestion = instance->ingestion.get();
+    FrameSources* sources = &instance->sources;
+    TraceRecorder* recorder = instance->recorder.get();
+    const BlockConfig* config = &instance->config;
 #endif
 
-    // Validate that tracker was properly initialized
-    if (tracker == nullptr) {
+    // Validate that the trackers were properly initialized
+    if (batch == nullptr || config == nullptr) {
         ssSetErrorStatus(S, "Optical flow tracker not initialized.");
         return;
     }
-    if (image == nullptr) {
-        ssSetErrorStatus(S, "Image buffer not initialized.");
+    if (ingestion == nullptr) {
+        ssSetErrorStatus(S, "Image ingestion stage not initialized.");
         return;
     }
 
     // Start timing for performance measurement
-    auto start_time = std::chrono::high_resolution_clock::now();
+    const auto start_time = std::chrono::steady_clock::now();
+    const uint64_t allocations_before = MatArenaAllocator::instance().systemAllocations();
 
     // Get pointers to input signals from Simulink
-    InputRealPtrsType input_image = ssGetInputPortRealSignalPtrs(S, 0);
-    InputRealPtrsType delta_t_ptr = ssGetInputPortRealSignalPtrs(S, 1);
+    const bool image_input = config->image_input;
+    const int delta_port = image_input ? 1 : 0;
+    InputRealPtrsType delta_t_ptr = ssGetInputPortRealSignalPtrs(S, delta_port);
 
     // Update time step for velocity calculation
-    tracker->_set_delta_t_(delta_t_ptr[0][0]);
-
-    // Convert Simulink image data (normalized 0-1) to OpenCV format (0-255)
-    // Simulink stores matrices in column-major order, so we iterate accordingly
-    for (int r = 0; r < height; r++) {
-        for (int c = 0; c < width; c++) {
-            image->at<uchar>(r, c) = static_cast<uchar>(
-                clamp(input_image[r + c * height][0] * 255.0, 0.0, 255.0));
+    batch->_set_delta_t_(delta_t_ptr[0][0]);
+
+    // A positive height on the height port replaces P(31) for this step
+    float height_above_ground = config->height_above_ground;
+    int port = delta_port + 1;
+    if (config->height_input) {
+        const real_T height = ssGetInputPortRealSignalPtrs(S, port++)[0][0];
+        if (height > 0.0) {
+            height_above_ground = static_cast<float>(height);
+        }
+    }
+    if (config->rate_input) {
+        InputRealPtrsType rate_ptr = ssGetInputPortRealSignalPtrs(S, port);
+        batch->setAngularRate(cv::Vec3f(static_cast<float>(*rate_ptr[0]),
+                                        static_cast<float>(*rate_ptr[1]),
+                                        static_cast<float>(*rate_ptr[2])));
+    }
+
+    const int num_cameras = batch->size();
+    if (!image_input) {
+        // Frames were read and ingested ahead by the prefetch threads
+        for (int camera = 0; camera < num_cameras; ++camera) {
+            OPTICAL_FLOW_PROFILE_SCOPE(&batch->tracker(camera).profiler(),
+                                       StageProfiler::STAGE_INGESTION);
+            FramePrefetcher& source = *(*sources)[camera];
+            if (source.pop(batch->frame(camera))) {
+                continue;
+            }
+            if (!source.error().empty()) {
+                // Copied, the source is gone by the time Simulink reports the error
+                static char message[512];
+                std::snprintf(message, sizeof(message), "Frame source of camera %d failed: %s",
+                              camera + 1, source.error().c_str());
+                ssSetErrorStatus(S, message);
+            } else {
+                // End of a recording, finish the simulation like a stop block
+                ssSetStopRequested(S, 1);
+            }
+            return;
         }
     }
 
-    // Perform optical flow velocity estimation
-    std::vector<float> vel_x, vel_y;
+    // Convert every camera plane (column-major) to OpenCV format (row-major, 0-255)
+    const void* input_image = image_input ? ssGetInputPortSignal(S, 0) : nullptr;
+    const size_t plane_size = static_cast<size_t>(ingestion->height()) * ingestion->width();
+    const DTypeId image_type = image_input ? ssGetInputPortDataType(S, 0) : SS_UINT8;
+    for (int camera = 0; image_input && camera < num_cameras; ++camera) {
+        OPTICAL_FLOW_PROFILE_SCOPE(&batch->tracker(camera).profiler(),
+                                   StageProfiler::STAGE_INGESTION);
+        const size_t offset = plane_size * camera;
+        switch (image_type) {
+            case SS_UINT8:
+                ingestion->ingest(static_cast<const uint8_T*>(input_image) + offset,
+                                  batch->frame(camera));
+                break;
+            case SS_SINGLE:
+                ingestion->ingest(static_cast<const real32_T*>(input_image) + offset,
+                                  batch->frame(camera));
+                break;
+            default:
+                ingestion->ingest(static_cast<const real_T*>(input_image) + offset,
+                                  batch->frame(camera));
+                break;
+        }
+    }
 
-    try {
-        // Calculate real-world velocities assuming 1.0m height above ground
-        // (height can be made a parameter if needed)
-        auto result = tracker->calculateRealVel(*image, 1.0f);
-        vel_x = std::get<0>(result);
-        vel_y = std::get<1>(result);
-    } catch (const cv::Exception& e) {
-        // Catch OpenCV exceptions and issue warning instead of crashing simulation
-        ssWarning(S, e.what());
-        vel_x.clear();
-        vel_y.clear();
+    // Perform optical flow velocity estimation for all cameras in parallel
+    // Real-world velocities are scaled by the height above ground (P(31) or port)
+    if (!batch->calculateRealVel(height_above_ground)) {
+        // OpenCV exceptions are caught per camera, warn instead of crashing simulation
+        for (int camera = 0; camera < num_cameras; ++camera) {
+            if (!batch->error(camera).empty()) {
+                ssWarning(S, batch->error(camera).c_str());
+            }
+        }
+    }
+
+    // Get pointers to output signals, the other ports follow the optional per-feature port
+    const bool per_feature = config->per_feature;
+    const int port_base = per_feature ? 1 : 0;
+    real_T* stage_timing = ssGetOutputPortRealSignal(S, port_base + 0);
+    real_T* num_features = ssGetOutputPortRealSignal(S, port_base + 1);
+    real_T* ego_velocity = ssGetOutputPortRealSignal(S, port_base + 2);
+    real_T* heap_allocations = ssGetOutputPortRealSignal(S, port_base + 3);
+    real_T* feature_budget = ssGetOutputPortRealSignal(S, port_base + 4);
+    if (per_feature) {
+        // One page per camera, a variable-size port only as wide as the most features tracked
+        int columns = MAX_OUTPUT_FEATURES;
+        if (config->variable_features) {
+            columns = featureColumns(*batch);
+            ssSetCurrentOutputPortDimensions(S, 0, 1, columns);
+        }
+        void* output_velocities = ssGetOutputPortSignal(S, 0);
+        if (config->single_features) {
+            writeFeatureVelocities(*batch, columns, static_cast<real32_T*>(output_velocities));
+        } else {
+            writeFeatureVelocities(*batch, columns, static_cast<real_T*>(output_velocities));
+        }
     }
 
-    // Get output port dimensions
-    const int_T num_rows = ssGetOutputPortDimensions(S, 0)[0];
-    const int_T num_cols = ssGetOutputPortDimensions(S, 0)[1];
+    for (int camera = 0; camera < num_cameras; ++camera) {
+        const OpticalFlowResult& result = batch->result(camera);
+
+        // Valid features, limited to the columns of the per-feature port
+        const int valid_features =
+            per_feature ? std::min(result.count, MAX_OUTPUT_FEATURES) : result.count;
 
-    // Get pointers to output signals
-    real_T* output_velocities = ssGetOutputPortRealSignal(S, 0);
-    real_T* computation_time = ssGetOutputPortRealSignal(S, 1);
-    real_T* num_features = ssGetOutputPortRealSignal(S, 2);
+        // Write the robust aggregate velocity
+        real_T* ego = ego_velocity + camera * EGO_VELOCITY_WIDTH;
+        ego[0] = result.ego_vel_x;
+        ego[1] = result.ego_vel_y;
+        ego[2] = static_cast<double>(result.inlier_count);
+        ego[3] = result.residual;
 
-    // Determine how many valid features were tracked
-    const int valid_features = std::min(static_cast<int>(vel_x.size()), static_cast<int>(num_cols));
+        num_features[camera] = static_cast<double>(valid_features);
 
-    // Write velocity estimates to output (column-major order)
-    for (int i = 0; i < valid_features; i++) {
-        output_velocities[0 + i * num_rows] = vel_x[i];
-        output_velocities[1 + i * num_rows] = vel_y[i];
+        // Budget the frame was processed with, below the configured values under load
+        real_T* budget = feature_budget + camera * FEATURE_BUDGET_WIDTH;
+        budget[0] = static_cast<double>(result.budget_corners);
+        budget[1] = static_cast<double>(result.budget_levels);
+        budget[2] = static_cast<double>(result.budget_iterations);
+
+        // A copy into the mapped trace file, written back by the recorder thread
+        if (recorder != nullptr) {
+            recorder->append(ssGetT(S), camera, result);
+        }
     }
 
-    // Zero out unused columns to avoid undefined output values
-    for (int i = valid_features; i < num_cols; i++) {
-        output_velocities[0 + i * num_rows] = 0.0;
-        output_velocities[1 + i * num_rows] = 0.0;
+    // Calculate and report the total and per-stage computation times
+    // The block total is shared by all cameras since they run concurrently
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    for (int camera = 0; camera < num_cameras; ++camera) {
+        StageProfiler& profiler = batch->tracker(camera).profiler();
+        profiler.record(StageProfiler::STAGE_TOTAL, elapsed);
+        real_T* timing = stage_timing + camera * STAGE_TIMING_WIDTH;
+        for (int stage = 0; stage < STAGE_TIMING_WIDTH; ++stage) {
+            timing[stage] = profiler.last(stage);
+        }
     }
 
-    // Calculate and report computation time
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto elapsed = std::chrono::duration<double>(end_time - start_time).count();
+    // Allocations the arena could not serve, other blocks stepping concurrently are included
+    heap_allocations[0] = static_cast<real_T>(
+        MatArenaAllocator::instance().systemAllocations() - allocations_before);
+}
+
+#if defined(MATLAB_MEX_FILE)
+#define MDL_OPERATING_POINT
+/**
+ * @brief Capture the tracker state in the operating point
+ *
+ * The reference frames, tracked features and keyframes of all cameras are
+ * serialized into one uint8 row vector (about one byte per processed pixel
+ * and camera), so simulations restored or forked from the operating point
+ * track their first frame instead of starting over with a detection.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @return uint8 vector with the tracker state, nullptr on an error
+ */
+static mxArray* mdlGetOperatingPoint(SimStruct* S) {
+#ifdef USE_PERSISTENT_MEMORY
+    TrackerBatch* batch = static_cast<TrackerBatch*>(ssGetPWorkValue(S, 0));
+#else
+    BlockInstance* instance = static_cast<BlockInstance*>(ssGetUserData(S));
+    TrackerBatch* batch = (instance != nullptr) ? instance->batch.get() : nullptr;
+#endif
+    if (batch == nullptr) {
+        ssSetErrorStatus(S, "Optical flow tracker not initialized.");
+        return nullptr;
+    }
 
-    *computation_time = elapsed;
-    *num_features = static_cast<double>(valid_features);
+    std::vector<uint8_t> state;
+    try {
+        batch->saveState(state);
+    } catch (const cv::Exception& e) {
+        static char message[512];
+        std::snprintf(message, sizeof(message), "Could not save the tracker state: %s", e.what());
+        ssSetErrorStatus(S, message);
+        return nullptr;
+    }
+    mxArray* operating_point = mxCreateNumericMatrix(1, state.size(), mxUINT8_CLASS, mxREAL);
+    std::copy(state.begin(), state.end(), static_cast<uint8_T*>(mxGetData(operating_point)));
+    return operating_point;
 }
 
+/**
+ * @brief Continue from the tracker state of an operating point
+ *
+ * Called after mdlStart, so the trackers are configured from the current
+ * parameters and only the saved frames and features are restored. The
+ * operating point must come from a block with the same processed frame
+ * size, number of cameras and keyframe setting.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ * @param operating_point uint8 vector written by mdlGetOperatingPoint
+ */
+static void mdlSetOperatingPoint(SimStruct* S, const mxArray* operating_point) {
+#ifdef USE_PERSISTENT_MEMORY
+    TrackerBatch* batch = static_cast<TrackerBatch*>(ssGetPWorkValue(S, 0));
+#else
+    BlockInstance* instance = static_cast<BlockInstance*>(ssGetUserData(S));
+    TrackerBatch* batch = (instance != nullptr) ? instance->batch.get() : nullptr;
+#endif
+    if (batch == nullptr) {
+        ssSetErrorStatus(S, "Optical flow tracker not initialized.");
+        return;
+    }
+    if (!mxIsUint8(operating_point)) {
+        ssSetErrorStatus(S, "Operating point of the optical flow block must be a uint8 vector.");
+        return;
+    }
+
+    try {
+        batch->restoreState(static_cast<const uint8_t*>(mxGetData(operating_point)),
+                            mxGetNumberOfElements(operating_point));
+    } catch (const cv::Exception& e) {
+        static char message[512];
+        std::snprintf(message, sizeof(message), "Could not restore the tracker state: %s",
+                      e.what());
+        ssSetErrorStatus(S, message);
+    }
+}
+#endif
+
 /**
  * @brief Clean up resources when simulation ends
  *
- * Deallocates the OpticalFlowTracking instance when using persistent memory.
- * Static memory instances are automatically cleaned up.
+ * Prints the per-stage latency summary, then stops the frame sources and
+ * deallocates the trackers and the ingestion stage when using persistent
+ * memory.
+ * In static memory mode the instance state is destroyed and its registry
+ * slot is freed for the next simulation.
  *
  * @param S SimStruct pointer containing S-Function state
  */
 static void mdlTerminate(SimStruct* S) {
 #ifdef USE_PERSISTENT_MEMORY
-    // Clean up heap-allocated tracker object
-    OpticalFlowTracking* tracker = static_cast<OpticalFlowTracking*>(ssGetPWorkValue(S, 0));
-    if (tracker != nullptr) {
-        delete tracker;
+    // Write back and close the trace
+    TraceRecorder* recorder = static_cast<TraceRecorder*>(ssGetPWorkValue(S, 3));
+    if (recorder != nullptr) {
+        delete recorder;
+        ssSetPWorkValue(S, 3, nullptr);
+    }
+
+    // Stop the prefetch threads first, their frames come from the arena
+    FrameSources* sources = static_cast<FrameSources*>(ssGetPWorkValue(S, 2));
+    if (sources != nullptr) {
+        delete sources;
+        ssSetPWorkValue(S, 2, nullptr);
+    }
+
+    // Clean up heap-allocated trackers, frame arena and results
+    TrackerBatch* batch = static_cast<TrackerBatch*>(ssGetPWorkValue(S, 0));
+    const bool acquired_arena = (batch != nullptr);
+    if (batch != nullptr) {
+        printProfileSummary(S, *batch);
+        delete batch;
         ssSetPWorkValue(S, 0, nullptr);
     }
 
-    // Clean up heap-allocated image buffer
-    cv::Mat* image = static_cast<cv::Mat*>(ssGetPWorkValue(S, 1));
-    if (image != nullptr) {
-        delete image;
+    // Clean up heap-allocated ingestion stage
+    ImageIngestion* ingestion = static_cast<ImageIngestion*>(ssGetPWorkValue(S, 1));
+    if (ingestion != nullptr) {
+        delete ingestion;
         ssSetPWorkValue(S, 1, nullptr);
     }
+
+    BlockConfig* config = static_cast<BlockConfig*>(ssGetPWorkValue(S, 4));
+    if (config != nullptr) {
+        delete config;
+        ssSetPWorkValue(S, 4, nullptr);
+    }
+
+    // Last, the ingestion stage also holds Mats from the arena
+    if (acquired_arena) {
+        MatArenaAllocator::instance().release();
+    }
 #else
-    // In static memory mode, shared_ptr automatically handles cleanup
-    // No explicit action needed here
+    // Static memory mode: Destroy the instance state and free its registry slot
+    BlockInstance* instance = static_cast<BlockInstance*>(ssGetUserData(S));
+    if (instance != nullptr) {
+        const bool acquired_arena = (instance->batch != nullptr);
+        if (acquired_arena) {
+            printProfileSummary(S, *instance->batch);
+        }
+        instance_registry.release(instance->config.instance_id);
+        if (acquired_arena) {
+            MatArenaAllocator::instance().release();
+        }
+        ssSetUserData(S, nullptr);
+    }
 #endif
 }
 
+#if defined(MATLAB_MEX_FILE)
+#define MDL_RTW
+/**
+ * @brief Write the block configuration for s_function.tlc
+ *
+ * Generated code calls the optical_flow_codegen.h interface with these
+ * values, tunable parameters are inlined with their values at build time.
+ * Internal frame sources and result traces are only available in
+ * simulation.
+ *
+ * @param S SimStruct pointer containing S-Function state
+ */
+static void mdlRTW(SimStruct* S) {
+    BlockConfig config;
+    const char* error = readBlockConfig(S, config);
+    if (error != nullptr) {
+        ssSetErrorStatus(S, error);
+        return;
+    }
+    if (!config.image_input || !config.trace_path.empty()) {
+        ssSetErrorStatus(S, "Code generation requires the image input port (P26 = 0) and no trace file (P28).");
+        return;
+    }
+
+    std::vector<real_T> focal_length(config.num_cameras);
+    std::vector<real_T> cmos_height(config.num_cameras);
+    std::vector<real_T> cmos_width(config.num_cameras);
+    for (int camera = 0; camera < config.num_cameras; ++camera) {
+        focal_length[camera] = config.cameras[camera].focal_length;
+        cmos_height[camera] = config.cameras[camera].cmos_height;
+        cmos_width[camera] = config.cameras[camera].cmos_width;
+    }
+    // Lens models as 0-based [fx, fy, cx, cy] and the coefficients, one block per camera
+    const bool lens_model = !config.lens_matrices.empty();
+    const int num_distortion =
+        lens_model ? static_cast<int>(config.lens_distortion[0].size()) : 4;
+    std::vector<real_T> lens_intrinsics(4 * config.num_cameras, 0.0);
+    std::vector<real_T> lens_distortion(num_distortion * config.num_cameras, 0.0);
+    for (int camera = 0; lens_model && camera < config.num_cameras; ++camera) {
+        const cv::Matx33d& matrix = config.lens_matrices[camera];
+        lens_intrinsics[4 * camera] = matrix(0, 0);
+        lens_intrinsics[4 * camera + 1] = matrix(1, 1);
+        lens_intrinsics[4 * camera + 2] = matrix(0, 2);
+        lens_intrinsics[4 * camera + 3] = matrix(1, 2);
+        std::copy(config.lens_distortion[camera].begin(), config.lens_distortion[camera].end(),
+                  lens_distortion.begin() + num_distortion * camera);
+    }
+    const real_T roi[4] = {static_cast<real_T>(config.roi.x), static_cast<real_T>(config.roi.y),
+                           static_cast<real_T>(config.roi.width),
+                           static_cast<real_T>(config.roi.height)};
+
+    ssWriteRTWParamSettings(S, 37,
+        SSWRITE_VALUE_NUM, "Height", static_cast<real_T>(config.height),
+        SSWRITE_VALUE_NUM, "Width", static_cast<real_T>(config.width),
+        SSWRITE_VALUE_NUM, "NumCameras", static_cast<real_T>(config.num_cameras),
+        SSWRITE_VALUE_VECT, "FocalLength", focal_length.data(), config.num_cameras,
+        SSWRITE_VALUE_VECT, "CmosHeight", cmos_height.data(), config.num_cameras,
+        SSWRITE_VALUE_VECT, "CmosWidth", cmos_width.data(), config.num_cameras,
+        SSWRITE_VALUE_VECT, "Roi", roi, 4,
+        SSWRITE_VALUE_NUM, "Decimation", static_cast<real_T>(config.decimation),
+        SSWRITE_VALUE_NUM, "FeatureProcedure", static_cast<real_T>(config.feature_procedure),
+        SSWRITE_VALUE_NUM, "LkWindowSize", static_cast<real_T>(config.lk_window_size),
+        SSWRITE_VALUE_NUM, "LkMaxLevel", static_cast<real_T>(config.lk_max_level),
+        SSWRITE_VALUE_NUM, "ConversionMode", static_cast<real_T>(config.conversion_mode),
+        SSWRITE_VALUE_NUM, "PerFeature", static_cast<real_T>(config.per_feature ? 1 : 0),
+        SSWRITE_VALUE_NUM, "InlierThreshold", static_cast<real_T>(config.inlier_threshold),
+        SSWRITE_VALUE_NUM, "PipelineMode", static_cast<real_T>(config.pipeline_mode),
+        SSWRITE_VALUE_NUM, "Method", static_cast<real_T>(config.method),
+        SSWRITE_VALUE_NUM, "Detector", static_cast<real_T>(config.detector),
+        SSWRITE_VALUE_NUM, "MaxCorners", static_cast<real_T>(config.max_corners),
+        SSWRITE_VALUE_NUM, "QualityLevel", static_cast<real_T>(config.quality_level),
+        SSWRITE_VALUE_NUM, "MinDistance", static_cast<real_T>(config.min_distance),
+        SSWRITE_VALUE_NUM, "BlockSize", static_cast<real_T>(config.block_size),
+        SSWRITE_VALUE_NUM, "DetectorThreshold", static_cast<real_T>(config.detector_threshold),
+        SSWRITE_VALUE_NUM, "MaxTrackError", static_cast<real_T>(config.max_track_error),
+        SSWRITE_VALUE_NUM, "MaxFbError", static_cast<real_T>(config.max_fb_error),
+        SSWRITE_VALUE_NUM, "HeightAboveGround", static_cast<real_T>(config.height_above_ground),
+        SSWRITE_VALUE_NUM, "HeightInput", static_cast<real_T>(config.height_input ? 1 : 0),
+        SSWRITE_VALUE_NUM, "RateInput", static_cast<real_T>(config.rate_input ? 1 : 0),
+        SSWRITE_VALUE_NUM, "LensModel", static_cast<real_T>(lens_model ? 1 : 0),
+        SSWRITE_VALUE_VECT, "LensIntrinsics", lens_intrinsics.data(), 4 * config.num_cameras,
+        SSWRITE_VALUE_NUM, "NumDistortion", static_cast<real_T>(num_distortion),
+        SSWRITE_VALUE_VECT, "LensDistortion", lens_distortion.data(),
+        num_distortion * config.num_cameras,
+        SSWRITE_VALUE_NUM, "LatencyTarget", static_cast<real_T>(config.latency_target),
+        SSWRITE_VALUE_NUM, "KeyframeDisplacement",
+        static_cast<real_T>(config.keyframe_displacement),
+        SSWRITE_VALUE_NUM, "EarlyOut", static_cast<real_T>(config.early_out),
+        SSWRITE_VALUE_NUM, "TrackingTiles", static_cast<real_T>(config.tracking_tiles),
+        SSWRITE_VALUE_NUM, "VariableFeatures",
+        static_cast<real_T>(config.variable_features ? 1 : 0),
+        SSWRITE_VALUE_NUM, "SingleFeatures", static_cast<real_T>(config.single_features ? 1 : 0));
+}
+#endif
+
 #ifdef MATLAB_MEX_FILE
 #include "simulink.c"
 #else
@@ -0,0 +1,135 @@
+/**
+ * @file stage_profiler.cpp
+ * @brief Implementation of the per-stage latency instrumentation
+ *
+ * This file implements the StageProfiler recording and summary methods.
+ */
+
+#include "stage_profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Display names indexed by stage
+ */
+const char* const STAGE_NAMES[StageProfiler::NUM_STAGES] = {
+    "total", "ingestion", "pyramid", "tracking", "conversion", "detection", "aggregation"
+};
+
+/**
+ * @brief Convert nanoseconds to seconds
+ */
+double toSeconds(uint64_t ns) {
+    return static_cast<double>(ns) * 1e-9;
+}
+
+} // namespace
+
+StageProfiler::StageProfiler() {
+    reset();
+}
+
+void StageProfiler::record(int stage, std::chrono::steady_clock::duration elapsed) {
+    if (stage < 0 || stage >= RECORDED_STAGES) {
+        return;
+    }
+    const long long signed_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    const uint64_t ns = signed_ns > 0 ? static_cast<uint64_t>(signed_ns) : 0;
+
+    // Claim a ring slot, concurrent writers never share one
+    const uint64_t index = _count[stage].fetch_add(1, std::memory_order_relaxed);
+    _samples[stage][index % HISTORY_SIZE].store(ns, std::memory_order_relaxed);
+    _last[stage].store(ns, std::memory_order_relaxed);
+
+    uint64_t current = _max[stage].load(std::memory_order_relaxed);
+    while (ns > current &&
+           !_max[stage].compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+    }
+}
+
+double StageProfiler::last(int stage) const {
+    if (stage < 0 || stage >= RECORDED_STAGES) {
+        return 0.0;
+    }
+    return toSeconds(_last[stage].load(std::memory_order_relaxed));
+}
+
+uint64_t StageProfiler::count(int stage) const {
+    if (stage < 0 || stage >= RECORDED_STAGES) {
+        return 0;
+    }
+    return _count[stage].load(std::memory_order_relaxed);
+}
+
+StageProfiler::Summary StageProfiler::summary(int stage) const {
+    Summary result = {0, 0.0, 0.0, 0.0};
+    if (stage < 0 || stage >= RECORDED_STAGES) {
+        return result;
+    }
+
+    result.count = _count[stage].load(std::memory_order_relaxed);
+    result.max = toSeconds(_max[stage].load(std::memory_order_relaxed));
+    const int n = static_cast<int>(std::min<uint64_t>(result.count, HISTORY_SIZE));
+    if (n == 0) {
+        return result;
+    }
+
+    // Percentiles over a snapshot of the retained history
+    std::vector<uint64_t> history(n);
+    for (int i = 0; i < n; ++i) {
+        history[i] = _samples[stage][i].load(std::memory_order_relaxed);
+    }
+    const int i50 = (n - 1) / 2;
+    const int i99 = (n - 1) * 99 / 100;
+    std::nth_element(history.begin(), history.begin() + i50, history.end());
+    result.p50 = toSeconds(history[i50]);
+    std::nth_element(history.begin(), history.begin() + i99, history.end());
+    result.p99 = toSeconds(history[i99]);
+    return result;
+}
+
+const char* StageProfiler::stageName(int stage) {
+    return (stage >= 0 && stage < NUM_STAGES) ? STAGE_NAMES[stage] : "unknown";
+}
+
+int StageProfiler::format(char* buffer, size_t size) const {
+    if (buffer == nullptr || size == 0) {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    size_t used = 0;
+    auto append = [&](int written) {
+        if (written > 0) {
+            used = std::min(size - 1, used + static_cast<size_t>(written));
+        }
+    };
+
+    append(std::snprintf(buffer, size, "%-12s %10s %12s %12s %12s\n",
+                         "stage", "samples", "p50 [ms]", "p99 [ms]", "max [ms]"));
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        const Summary s = summary(stage);
+        if (s.count == 0) {
+            continue;
+        }
+        append(std::snprintf(buffer + used, size - used, "%-12s %10llu %12.3f %12.3f %12.3f\n",
+                             stageName(stage), static_cast<unsigned long long>(s.count),
+                             s.p50 * 1e3, s.p99 * 1e3, s.max * 1e3));
+    }
+    return static_cast<int>(used);
+}
+
+void StageProfiler::reset() {
+    for (int stage = 0; stage < RECORDED_STAGES; ++stage) {
+        for (int i = 0; i < HISTORY_SIZE; ++i) {
+            _samples[stage][i].store(0, std::memory_order_relaxed);
+        }
+        _count[stage].store(0, std::memory_order_relaxed);
+        _last[stage].store(0, std::memory_order_relaxed);
+        _max[stage].store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,323 @@
+/**
+ * @file trace_recorder.cpp
+ * @brief Implementation of the memory-mapped result trace
+ *
+ * This file implements the TraceRecorder class methods and the float to
+ * half-precision conversion of the velocity arrays.
+ */
+
+#include "trace_recorder.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__AVX__) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Header field offsets in bytes
+ */
+constexpr size_t OFFSET_VERSION = 8;
+constexpr size_t OFFSET_HEADER_BYTES = 12;
+constexpr size_t OFFSET_RECORD_BYTES = 16;
+constexpr size_t OFFSET_CAPACITY = 20;
+constexpr size_t OFFSET_MAX_FEATURES = 24;
+constexpr size_t OFFSET_FLAGS = 28;
+constexpr size_t OFFSET_WRITTEN = 32;
+
+/**
+ * @brief Fixed part of a record, see the TraceRecorder file layout
+ */
+struct RecordHeader {
+    uint64_t sequence;              ///< 1-based record number, 0 while being written
+    double timestamp;               ///< Simulation time (seconds)
+    uint32_t camera;                ///< Camera index
+    uint32_t count;                 ///< Features stored in the arrays
+    float ego_vel_x;                ///< Robust aggregate velocity X (m/s)
+    float ego_vel_y;                ///< Robust aggregate velocity Y (m/s)
+    float residual;                 ///< RMS inlier deviation (m/s)
+    uint32_t inlier_count;          ///< Features agreeing with the aggregate
+    uint32_t success;               ///< Non-zero when the frame was processed
+    uint32_t padding;               ///< Keeps the arrays 8-byte aligned
+};
+
+static_assert(sizeof(RecordHeader) == TraceRecorder::RECORD_HEADER_BYTES,
+              "Record header size must match the documented layout");
+
+/**
+ * @brief Convert a float to IEEE 754 half precision, rounding to nearest even
+ *
+ * Overflow saturates to infinity, NaN stays NaN.
+ */
+uint16_t toHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    bits &= 0x7fffffffu;
+
+    uint32_t half;
+    if (bits >= 0x47800000u) {
+        // Beyond the half range, infinity or NaN
+        half = (bits > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+    } else if (bits < 0x38800000u) {
+        // Subnormal half: let the float adder do the shift and rounding
+        const uint32_t magic_bits = 0x3f000000u;
+        float magic;
+        std::memcpy(&magic, &magic_bits, sizeof(magic));
+        float scaled;
+        std::memcpy(&scaled, &bits, sizeof(scaled));
+        scaled += magic;
+        std::memcpy(&half, &scaled, sizeof(half));
+        half -= magic_bits;
+    } else {
+        // Normal half: rebias the exponent and round the dropped mantissa bits
+        const uint32_t odd = (bits >> 13) & 1u;
+        bits += 0xc8000fffu + odd;
+        half = bits >> 13;
+    }
+    return static_cast<uint16_t>(half | sign);
+}
+
+/**
+ * @brief Convert an array of floats to half precision
+ */
+void convertToHalf(const float* src, uint16_t* dst, int n) {
+    int i = 0;
+#if defined(__AVX__) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = toHalf(src[i]);
+    }
+}
+
+/**
+ * @brief Store a header field
+ */
+template <typename T>
+void storeField(unsigned char* header, size_t offset, T value) {
+    std::memcpy(header + offset, &value, sizeof(value));
+}
+
+} // namespace
+
+size_t TraceRecorder::recordBytes(int max_features, uint32_t flags) {
+    const size_t velocity_bytes = (flags & FLAG_HALF_VELOCITIES) ? 2 : 4;
+    size_t bytes = RECORD_HEADER_BYTES + 2 * velocity_bytes * max_features;
+    if (flags & FLAG_POSITIONS) {
+        bytes += 4 * sizeof(float) * max_features;
+    }
+
+    // Keep every record header 8-byte aligned
+    return (bytes + 7) / 8 * 8;
+}
+
+TraceRecorder::TraceRecorder(const std::string &path, uint32_t capacity, int max_features,
+                             uint32_t flags)
+    : _capacity(capacity),
+      _max_features(max_features),
+      _flags(flags),
+      _record_bytes(recordBytes(max_features, flags)),
+      _file_bytes(HEADER_BYTES + static_cast<size_t>(capacity) * recordBytes(max_features, flags)),
+      _data(nullptr),
+      _written(0),
+      _flushed(0),
+#ifdef _WIN32
+      _file(INVALID_HANDLE_VALUE),
+      _mapping(nullptr),
+#else
+      _fd(-1),
+#endif
+      _mutex(),
+      _stop_cv(),
+      _stop(false),
+      _thread() {
+    CV_Assert(capacity > 0 && max_features > 0);
+
+    // The whole ring is reserved now, a full disk fails here and not mid-run
+#ifdef _WIN32
+    _file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+        CV_Error(cv::Error::StsError, "Could not create the trace file " + path);
+    }
+    const uint64_t size = _file_bytes;
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                  static_cast<DWORD>(size & 0xffffffffu), nullptr);
+    if (_mapping != nullptr) {
+        _data = static_cast<unsigned char*>(MapViewOfFile(_mapping, FILE_MAP_WRITE, 0, 0,
+                                                          _file_bytes));
+    }
+    if (_data == nullptr) {
+        if (_mapping != nullptr) {
+            CloseHandle(_mapping);
+        }
+        CloseHandle(_file);
+        CV_Error(cv::Error::StsError, "Could not map the trace file " + path);
+    }
+#else
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        CV_Error(cv::Error::StsError, "Could not create the trace file " + path);
+    }
+#ifdef __linux__
+    const bool sized = posix_fallocate(_fd, 0, static_cast<off_t>(_file_bytes)) == 0;
+    const int map_flags = MAP_SHARED | MAP_POPULATE;
+#else
+    const bool sized = ftruncate(_fd, static_cast<off_t>(_file_bytes)) == 0;
+    const int map_flags = MAP_SHARED;
+#endif
+    void* data = sized ? mmap(nullptr, _file_bytes, PROT_READ | PROT_WRITE, map_flags, _fd, 0)
+                       : MAP_FAILED;
+    if (data == MAP_FAILED) {
+        ::close(_fd);
+        CV_Error(cv::Error::StsError, "Could not allocate and map the trace file " + path);
+    }
+    _data = static_cast<unsigned char*>(data);
+#endif
+
+    std::memset(_data, 0, HEADER_BYTES);
+    std::memcpy(_data, "OFTRACE1", 8);
+    storeField<uint32_t>(_data, OFFSET_VERSION, FORMAT_VERSION);
+    storeField<uint32_t>(_data, OFFSET_HEADER_BYTES, static_cast<uint32_t>(HEADER_BYTES));
+    storeField<uint32_t>(_data, OFFSET_RECORD_BYTES, static_cast<uint32_t>(_record_bytes));
+    storeField<uint32_t>(_data, OFFSET_CAPACITY, capacity);
+    storeField<uint32_t>(_data, OFFSET_MAX_FEATURES, static_cast<uint32_t>(max_features));
+    storeField<uint32_t>(_data, OFFSET_FLAGS, flags);
+    storeField<uint64_t>(_data, OFFSET_WRITTEN, 0);
+
+    _thread = std::thread(&TraceRecorder::run, this);
+}
+
+TraceRecorder::~TraceRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _stop_cv.notify_all();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+
+    // The flush thread is gone, write back whatever is left and close
+    flush();
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    FlushFileBuffers(_file);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+#else
+    munmap(_data, _file_bytes);
+    ::close(_fd);
+#endif
+}
+
+void TraceRecorder::append(double timestamp, int camera, const OpticalFlowResult &result) {
+    const uint64_t sequence = _written.load(std::memory_order_relaxed) + 1;
+    unsigned char* record = _data + HEADER_BYTES +
+                            ((sequence - 1) % _capacity) * _record_bytes;
+    const int count = std::max(0, std::min(result.count, _max_features));
+
+    RecordHeader header;
+    header.sequence = 0;
+    header.timestamp = timestamp;
+    header.camera = static_cast<uint32_t>(camera);
+    header.count = static_cast<uint32_t>(count);
+    header.ego_vel_x = result.ego_vel_x;
+    header.ego_vel_y = result.ego_vel_y;
+    header.residual = result.residual;
+    header.inlier_count = static_cast<uint32_t>(result.inlier_count);
+    header.success = result.success ? 1u : 0u;
+    header.padding = 0;
+    std::memcpy(record, &header, sizeof(header));
+
+    // Only the valid prefix of each array is written, the rest keeps stale data
+    unsigned char* arrays = record + RECORD_HEADER_BYTES;
+    if (_flags & FLAG_HALF_VELOCITIES) {
+        uint16_t* vel = reinterpret_cast<uint16_t*>(arrays);
+        convertToHalf(result.vel_x.data(), vel, count);
+        convertToHalf(result.vel_y.data(), vel + _max_features, count);
+        arrays += 2 * sizeof(uint16_t) * _max_features;
+    } else {
+        float* vel = reinterpret_cast<float*>(arrays);
+        std::memcpy(vel, result.vel_x.data(), count * sizeof(float));
+        std::memcpy(vel + _max_features, result.vel_y.data(), count * sizeof(float));
+        arrays += 2 * sizeof(float) * _max_features;
+    }
+    if (_flags & FLAG_POSITIONS) {
+        float* positions = reinterpret_cast<float*>(arrays);
+        std::memcpy(positions, result.prev_x.data(), count * sizeof(float));
+        std::memcpy(positions + _max_features, result.prev_y.data(), count * sizeof(float));
+        std::memcpy(positions + 2 * _max_features, result.curr_x.data(), count * sizeof(float));
+        std::memcpy(positions + 3 * _max_features, result.curr_y.data(), count * sizeof(float));
+    }
+
+    // A reader sees the sequence number only once the record is complete
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(record, &sequence, sizeof(sequence));
+    storeField<uint64_t>(_data, OFFSET_WRITTEN, sequence);
+    _written.store(sequence, std::memory_order_release);
+}
+
+void TraceRecorder::run() {
+    constexpr int interval_ms = FLUSH_INTERVAL_MS;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        _stop_cv.wait_for(lock, std::chrono::milliseconds(interval_ms));
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void TraceRecorder::flush() {
+    const uint64_t written = _written.load(std::memory_order_acquire);
+    if (written == _flushed) {
+        return;
+    }
+
+    // Records wrapped more than once since the last flush: the whole ring is dirty
+    const uint64_t pending = std::min<uint64_t>(written - _flushed, _capacity);
+    const size_t first = static_cast<size_t>((written - pending) % _capacity);
+    const size_t last = first + static_cast<size_t>(pending);
+    if (last <= _capacity) {
+        flushRange(HEADER_BYTES + first * _record_bytes, pending * _record_bytes);
+    } else {
+        flushRange(HEADER_BYTES + first * _record_bytes, (_capacity - first) * _record_bytes);
+        flushRange(HEADER_BYTES, (last - _capacity) * _record_bytes);
+    }
+    flushRange(0, HEADER_BYTES);
+    _flushed = written;
+}
+
+void TraceRecorder::flushRange(size_t offset, size_t bytes) {
+#ifdef _WIN32
+    FlushViewOfFile(_data + offset, bytes);
+#else
+    // msync() needs a page-aligned start
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned = offset / page * page;
+    msync(_data + aligned, offset - aligned + bytes, MS_SYNC);
+#endif
+}
@@ -0,0 +1,328 @@
+/**
+ * @file velocity_conversion.cpp
+ * @brief Implementation of the fused feature velocity conversion kernel
+ *
+ * This file implements the scalar exact path and the vectorized fast path of
+ * VelocityConversion.
+ */
+
+#include "velocity_conversion.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Number of features processed per vectorized block
+ */
+constexpr int BLOCK_SIZE = 8;
+
+/**
+ * @brief Compute interleaved [vx, vy] velocities for a block of 8 features
+ *
+ * Points are processed in their interleaved [x, y] layout: the displacement
+ * pairs are swapped to [dy, dx] and scaled by [kx, -ky] to obtain the angular
+ * displacements, which then go through the Pade tan approximation.
+ *
+ * @param prev Interleaved previous locations (16 floats)
+ * @param curr Interleaved current locations (16 floats)
+ * @param kx Angle per pixel along X (applied to dy)
+ * @param ky Angle per pixel along Y (applied to -dx)
+ * @param hk Height over time step
+ * @param out Interleaved velocities (16 floats)
+ */
+void convertBlock(const float* prev, const float* curr, float kx, float ky,
+                  float hk, float* out) {
+#if defined(__AVX2__)
+    const __m256 vk = _mm256_setr_ps(kx, -ky, kx, -ky, kx, -ky, kx, -ky);
+    const __m256 vhk = _mm256_set1_ps(hk);
+    const __m256 c945 = _mm256_set1_ps(945.0f);
+    const __m256 c105 = _mm256_set1_ps(-105.0f);
+    const __m256 c420 = _mm256_set1_ps(-420.0f);
+    const __m256 c15 = _mm256_set1_ps(15.0f);
+    for (int h = 0; h < 2 * BLOCK_SIZE; h += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(curr + h), _mm256_loadu_ps(prev + h));
+        __m256 x = _mm256_mul_ps(_mm256_permute_ps(d, 0xB1), vk);
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 num = _mm256_mul_ps(x, _mm256_add_ps(c945, _mm256_mul_ps(x2, _mm256_add_ps(c105, x2))));
+        __m256 den = _mm256_add_ps(c945, _mm256_mul_ps(x2, _mm256_add_ps(c420, _mm256_mul_ps(c15, x2))));
+        _mm256_storeu_ps(out + h, _mm256_mul_ps(vhk, _mm256_div_ps(num, den)));
+    }
+#elif defined(__SSE4_1__)
+    const __m128 vk = _mm_setr_ps(kx, -ky, kx, -ky);
+    const __m128 vhk = _mm_set1_ps(hk);
+    const __m128 c945 = _mm_set1_ps(945.0f);
+    const __m128 c105 = _mm_set1_ps(-105.0f);
+    const __m128 c420 = _mm_set1_ps(-420.0f);
+    const __m128 c15 = _mm_set1_ps(15.0f);
+    for (int h = 0; h < 2 * BLOCK_SIZE; h += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(curr + h), _mm_loadu_ps(prev + h));
+        __m128 x = _mm_mul_ps(_mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)), vk);
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 num = _mm_mul_ps(x, _mm_add_ps(c945, _mm_mul_ps(x2, _mm_add_ps(c105, x2))));
+        __m128 den = _mm_add_ps(c945, _mm_mul_ps(x2, _mm_add_ps(c420, _mm_mul_ps(c15, x2))));
+        _mm_storeu_ps(out + h, _mm_mul_ps(vhk, _mm_div_ps(num, den)));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float k_init[4] = {kx, -ky, kx, -ky};
+    const float32x4_t vk = vld1q_f32(k_init);
+    const float32x4_t vhk = vdupq_n_f32(hk);
+    const float32x4_t c945 = vdupq_n_f32(945.0f);
+    const float32x4_t c105 = vdupq_n_f32(-105.0f);
+    const float32x4_t c420 = vdupq_n_f32(-420.0f);
+    const float32x4_t c15 = vdupq_n_f32(15.0f);
+    for (int h = 0; h < 2 * BLOCK_SIZE; h += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(curr + h), vld1q_f32(prev + h));
+        float32x4_t x = vmulq_f32(vrev64q_f32(d), vk);
+        float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t num = vmulq_f32(x, vaddq_f32(c945, vmulq_f32(x2, vaddq_f32(c105, x2))));
+        float32x4_t den = vaddq_f32(c945, vmulq_f32(x2, vaddq_f32(c420, vmulq_f32(c15, x2))));
+        vst1q_f32(out + h, vmulq_f32(vhk, vdivq_f32(num, den)));
+    }
+#else
+    for (int h = 0; h < 2 * BLOCK_SIZE; h += 2) {
+        const float dx = curr[h] - prev[h];
+        const float dy = curr[h + 1] - prev[h + 1];
+        out[h] = hk * VelocityConversion::fastTan(dy * kx);
+        out[h + 1] = hk * VelocityConversion::fastTan(-dx * ky);
+    }
+#endif
+}
+
+/**
+ * @brief Bearing at a sub-pixel coordinate, interpolated from a lookup table
+ *
+ * Coordinates outside the table, such as features tracked just past the
+ * image border, are extrapolated from the first or last segment.
+ *
+ * @param table Bearing at every integer coordinate 0..N (N + 1 entries)
+ * @param pos Coordinate along the table
+ */
+inline float bearingAt(const std::vector<float> &table, float pos) {
+    const int last_segment = static_cast<int>(table.size()) - 2;
+    const int index = std::min(std::max(static_cast<int>(std::floor(pos)), 0), last_segment);
+    const float frac = pos - static_cast<float>(index);
+    return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+/**
+ * @brief Fill a bearing lookup table for one image axis
+ *
+ * @param table Output, one entry per integer coordinate 0..pixels
+ * @param fov Field of view along the axis (radians)
+ * @param pixels Image size along the axis
+ */
+void buildBearings(std::vector<float> &table, float fov, int pixels) {
+    // Pinhole model: focal length in pixels from the field of view
+    const double focal_px = 0.5 * pixels / std::tan(0.5 * fov);
+    const double center = 0.5 * (pixels - 1);
+    table.resize(static_cast<size_t>(pixels) + 1);
+    for (int i = 0; i <= pixels; ++i) {
+        table[i] = static_cast<float>(std::atan((i - center) / focal_px));
+    }
+}
+
+} // namespace
+
+VelocityConversion::VelocityConversion(int mode)
+    : _mode(mode),
+      _fov_h(0.0f),
+      _fov_v(0.0f),
+      _img_width(1.0f),
+      _img_height(1.0f),
+      _delta_t(1.0f),
+      _height(1.0f),
+      _rad_per_px_x(0.0f),
+      _rad_per_px_y(0.0f),
+      _height_over_dt(1.0f),
+      _max_error(0.0f),
+      _max_fb_error(0.0f),
+      _max_fb_error_sq(0.0f),
+      _compensate(false),
+      _rot_x(0.0f),
+      _rot_y(0.0f),
+      _rot_z(0.0f),
+      _row_bearing(),
+      _col_bearing(),
+      _undistortion(nullptr) {
+}
+
+void VelocityConversion::setMode(int mode) {
+    _mode = mode;
+}
+
+void VelocityConversion::configure(float fov_h, float fov_v, int img_width, int img_height) {
+    // Called on every re-detection, the bearing tables only change with the geometry
+    const bool changed = fov_h != _fov_h || fov_v != _fov_v ||
+                         static_cast<size_t>(img_width) + 1 != _col_bearing.size() ||
+                         static_cast<size_t>(img_height) + 1 != _row_bearing.size();
+    _fov_h = fov_h;
+    _fov_v = fov_v;
+    _img_width = static_cast<float>(img_width);
+    _img_height = static_cast<float>(img_height);
+
+    // Angle subtended by one pixel, X (forward) follows image rows, Y follows columns
+    _rad_per_px_x = _fov_v / _img_height;
+    _rad_per_px_y = _fov_h / _img_width;
+
+    if (changed && img_width > 0 && img_height > 0) {
+        buildBearings(_row_bearing, _fov_v, img_height);
+        buildBearings(_col_bearing, _fov_h, img_width);
+    }
+}
+
+void VelocityConversion::setFrame(float delta_t, float height) {
+    _delta_t = delta_t;
+    _height = height;
+    _height_over_dt = height * (1.0f / delta_t);
+    _compensate = false;
+    _rot_x = 0.0f;
+    _rot_y = 0.0f;
+    _rot_z = 0.0f;
+}
+
+void VelocityConversion::setFrame(float delta_t, float height, const cv::Vec3f &angular_rate) {
+    setFrame(delta_t, height);
+    _compensate = !_row_bearing.empty() && !_col_bearing.empty();
+    _rot_x = angular_rate[0] * delta_t;
+    _rot_y = angular_rate[1] * delta_t;
+    _rot_z = angular_rate[2] * delta_t;
+}
+
+void VelocityConversion::setRejection(float max_error, float max_fb_error) {
+    _max_error = std::max(0.0f, max_error);
+    _max_fb_error = std::max(0.0f, max_fb_error);
+    _max_fb_error_sq = _max_fb_error * _max_fb_error;
+}
+
+int VelocityConversion::convert(const cv::Point2f* prev, const cv::Point2f* curr,
+                                const uchar* status, const float* error,
+                                const cv::Point2f* back, int n, cv::Size bounds,
+                                OpticalFlowResult &result,
+                                std::vector<cv::Point2f> &survivors,
+                                std::vector<int>* survivor_index) const {
+    survivors.clear();
+    if (survivor_index != nullptr) {
+        survivor_index->clear();
+    }
+    int count = 0;
+    const float max_x = static_cast<float>(bounds.width);
+    const float max_y = static_cast<float>(bounds.height);
+
+    // Disabled tests cost nothing per feature
+    const float* checked_error = (_max_error > 0.0f) ? error : nullptr;
+    const cv::Point2f* checked_back = (_max_fb_error > 0.0f) ? back : nullptr;
+
+    // A feature is kept if tracked and consistent, rejected ones are not carried forward
+    auto accept = [&](int i) {
+        if (!status[i]) {
+            return false;
+        }
+        if (checked_error != nullptr && !(checked_error[i] <= _max_error)) {
+            return false;
+        }
+        if (checked_back != nullptr) {
+            const float ex = checked_back[i].x - prev[i].x;
+            const float ey = checked_back[i].y - prev[i].y;
+            if (!(ex * ex + ey * ey <= _max_fb_error_sq)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Store one tracked feature and keep it for the next frame if still visible
+    auto emit = [&](int i, float vx, float vy) {
+        const cv::Point2f &p = curr[i];
+        if (count < result.capacity) {
+            result.vel_x[count] = vx;
+            result.vel_y[count] = vy;
+            result.prev_x[count] = prev[i].x;
+            result.prev_y[count] = prev[i].y;
+            result.curr_x[count] = p.x;
+            result.curr_y[count] = p.y;
+            count++;
+        }
+        if (p.x >= 0.0f && p.y >= 0.0f && p.x < max_x && p.y < max_y) {
+            survivors.push_back(p);
+            if (survivor_index != nullptr) {
+                survivor_index->push_back(i);
+            }
+        }
+    };
+
+    int i = 0;
+    const LensUndistortion* lens =
+        (_undistortion != nullptr && _undistortion->ready()) ? _undistortion : nullptr;
+    if (_compensate || lens != nullptr) {
+        // Bearings from the lookup tables, rotation (zero unless compensating) removed before the tan
+        for (; i < n; ++i) {
+            if (!accept(i)) {
+                continue;
+            }
+            float prev_col, prev_row, curr_col, curr_row;
+            if (lens != nullptr) {
+                lens->bearings(prev[i], prev_col, prev_row);
+                lens->bearings(curr[i], curr_col, curr_row);
+            } else {
+                prev_col = bearingAt(_col_bearing, prev[i].x);
+                prev_row = bearingAt(_row_bearing, prev[i].y);
+                curr_col = bearingAt(_col_bearing, curr[i].x);
+                curr_row = bearingAt(_row_bearing, curr[i].y);
+            }
+            const float theta_x = curr_row - prev_row + _rot_y + _rot_z * prev_col;
+            const float theta_y = prev_col - curr_col - _rot_x + _rot_z * prev_row;
+            emit(i, _height_over_dt * fastTan(theta_x), _height_over_dt * fastTan(theta_y));
+        }
+    } else if (_mode == MODE_FAST) {
+        // cv::Point2f is two packed floats, process the arrays in place
+        const float* prev_f = reinterpret_cast<const float*>(prev);
+        const float* curr_f = reinterpret_cast<const float*>(curr);
+        float vel[2 * BLOCK_SIZE];
+
+        for (; i + BLOCK_SIZE <= n; i += BLOCK_SIZE) {
+            convertBlock(prev_f + 2 * i, curr_f + 2 * i, _rad_per_px_x, _rad_per_px_y,
+                         _height_over_dt, vel);
+            for (int j = 0; j < BLOCK_SIZE; ++j) {
+                if (accept(i + j)) {
+                    emit(i + j, vel[2 * j], vel[2 * j + 1]);
+                }
+            }
+        }
+
+        for (; i < n; ++i) {
+            if (accept(i)) {
+                const float dx = curr[i].x - prev[i].x;
+                const float dy = curr[i].y - prev[i].y;
+                emit(i, _height_over_dt * fastTan(dy * _rad_per_px_x),
+                     _height_over_dt * fastTan(-dx * _rad_per_px_y));
+            }
+        }
+    } else {
+        for (; i < n; ++i) {
+            if (!accept(i)) {
+                continue;
+            }
+
+            // Same operation order as the reference implementation
+            // Note: dy maps to X (forward) and -dx maps to Y (left) for UAV coordinate system
+            const float dx = curr[i].x - prev[i].x;
+            const float dy = curr[i].y - prev[i].y;
+            const float vel_px_x = dy / _delta_t;
+            const float vel_px_y = -dx / _delta_t;
+            const float angular_vel_x = vel_px_x * _fov_v / _img_height;
+            const float angular_vel_y = vel_px_y * _fov_h / _img_width;
+            emit(i, _height * std::tan(angular_vel_x * _delta_t) / _delta_t,
+                 _height * std::tan(angular_vel_y * _delta_t) / _delta_t);
+        }
+    }
+
+    result.count = count;
+    return count;
+}
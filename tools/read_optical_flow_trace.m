@@ -0,0 +1,108 @@
+function trace = read_optical_flow_trace(filename)
+%READ_OPTICAL_FLOW_TRACE Read a trace file written by the s_function block.
+%   TRACE = READ_OPTICAL_FLOW_TRACE(FILENAME) returns a struct with one
+%   column per record, oldest record first:
+%     sequence, timestamp, camera, count, ego_vel_x, ego_vel_y, residual,
+%     inlier_count, success   (1 x K)
+%     vel_x, vel_y            (max_features x K, NaN beyond count)
+%     prev_x, prev_y, curr_x, curr_y (only when positions were recorded)
+%   and the file header in TRACE.header. When the ring wrapped, the file
+%   holds the latest header.capacity records.
+
+    FLAG_HALF_VELOCITIES = 1;
+    FLAG_POSITIONS = 2;
+
+    fid = fopen(filename, 'r', 'ieee-le');
+    if fid < 0
+        error('read_optical_flow_trace:open', 'Could not open %s.', filename);
+    end
+    cleanup = onCleanup(@() fclose(fid));
+
+    magic = fread(fid, [1 8], '*char');
+    fields = fread(fid, 6, 'uint32=>double');
+    written = fread(fid, 1, 'uint64=>double');
+    if ~strcmp(magic, 'OFTRACE1') || fields(1) ~= 1
+        error('read_optical_flow_trace:format', '%s is not an optical flow trace (version 1).', filename);
+    end
+    header = struct('version', fields(1), 'header_bytes', fields(2), ...
+                    'record_bytes', fields(3), 'capacity', fields(4), ...
+                    'max_features', fields(5), 'flags', fields(6), 'written', written);
+
+    % Whole ring as bytes, one column per slot, reordered oldest first
+    fseek(fid, header.header_bytes, 'bof');
+    ring = fread(fid, [header.record_bytes, header.capacity], 'uint8=>uint8');
+    sequence = max(1, written - header.capacity + 1):written;
+    records = ring(:, mod(sequence - 1, header.capacity) + 1);
+
+    % Skip slots whose rewrite was cut short
+    stored = field(records, 0, 'uint64', 1);
+    valid = stored == sequence;
+    records = records(:, valid);
+
+    n = header.max_features;
+    trace.header = header;
+    trace.sequence = stored(valid);
+    trace.timestamp = field(records, 8, 'double', 1);
+    trace.camera = field(records, 16, 'uint32', 1);
+    trace.count = field(records, 20, 'uint32', 1);
+    trace.ego_vel_x = field(records, 24, 'single', 1);
+    trace.ego_vel_y = field(records, 28, 'single', 1);
+    trace.residual = field(records, 32, 'single', 1);
+    trace.inlier_count = field(records, 36, 'uint32', 1);
+    trace.success = field(records, 40, 'uint32', 1) ~= 0;
+
+    offset = 48;
+    if bitand(header.flags, FLAG_HALF_VELOCITIES)
+        trace.vel_x = halfToSingle(field(records, offset, 'uint16', n));
+        trace.vel_y = halfToSingle(field(records, offset + 2 * n, 'uint16', n));
+        offset = offset + 4 * n;
+    else
+        trace.vel_x = field(records, offset, 'single', n);
+        trace.vel_y = field(records, offset + 4 * n, 'single', n);
+        offset = offset + 8 * n;
+    end
+    names = {'vel_x', 'vel_y'};
+    if bitand(header.flags, FLAG_POSITIONS)
+        position_names = {'prev_x', 'prev_y', 'curr_x', 'curr_y'};
+        for k = 1:numel(position_names)
+            trace.(position_names{k}) = field(records, offset + 4 * n * (k - 1), 'single', n);
+        end
+        names = [names, position_names];
+    end
+
+    % Entries beyond the feature count hold stale data
+    stale = (1:n)' > double(trace.count);
+    for k = 1:numel(names)
+        trace.(names{k})(stale) = NaN;
+    end
+end
+
+function values = field(records, offset, type, count)
+% Typecast COUNT values of TYPE at byte OFFSET of every record column
+    switch type
+        case 'double', bytes = 8;
+        case 'uint64', bytes = 8;
+        case 'uint16', bytes = 2;
+        otherwise, bytes = 4;
+    end
+    raw = records(offset + 1:offset + bytes * count, :);
+    values = reshape(typecast(raw(:), type), count, []);
+    if strcmp(type, 'uint64')
+        values = double(values);
+    end
+end
+
+function values = halfToSingle(bits)
+% Decode IEEE 754 half-precision values stored as uint16
+    bits = double(bits);
+    sign = 1 - 2 * floor(bits / 32768);
+    exponent = mod(floor(bits / 1024), 32);
+    mantissa = mod(bits, 1024) / 1024;
+    values = sign .* (1 + mantissa) .* 2 .^ (exponent - 15);
+    subnormal = exponent == 0;
+    values(subnormal) = sign(subnormal) .* mantissa(subnormal) * 2 ^ -14;
+    special = exponent == 31;
+    values(special & mantissa == 0) = sign(special & mantissa == 0) * Inf;
+    values(special & mantissa ~= 0) = NaN;
+    values = single(values);
+end
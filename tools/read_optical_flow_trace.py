@@ -0,0 +1,89 @@
+"""Read optical flow trace files written by the S-function (TraceRecorder).
+
+As a module it returns one dict per record, oldest first:
+
+    from read_optical_flow_trace import read_trace
+    header, records = read_trace("flight.oftrace")
+    records[0]["ego_vel_x"], records[0]["vel_x"]   # vel_x holds count values
+
+As a script it prints a summary of the file. Only the standard library is
+required. When the ring wrapped, the file holds the latest `capacity` records.
+"""
+
+import mmap
+import struct
+import sys
+
+FLAG_HALF_VELOCITIES = 1
+FLAG_POSITIONS = 2
+
+_HEADER = struct.Struct("<8s6IQ")
+_RECORD = struct.Struct("<QdII3fIII")
+_HEADER_FIELDS = ("version", "header_bytes", "record_bytes", "capacity",
+                  "max_features", "flags", "written")
+_RECORD_FIELDS = ("sequence", "timestamp", "camera", "count", "ego_vel_x",
+                  "ego_vel_y", "residual", "inlier_count", "success")
+
+
+def _parse_record(buffer, offset, header):
+    values = _RECORD.unpack_from(buffer, offset)
+    record = dict(zip(_RECORD_FIELDS, values))
+    record["success"] = bool(record["success"])
+
+    n = header["max_features"]
+    count = record["count"]
+    offset += _RECORD.size
+    half = header["flags"] & FLAG_HALF_VELOCITIES
+    code, size = ("e", 2) if half else ("f", 4)
+    for name in ("vel_x", "vel_y"):
+        record[name] = list(struct.unpack_from("<%d%s" % (count, code), buffer, offset))
+        offset += size * n
+    if header["flags"] & FLAG_POSITIONS:
+        for name in ("prev_x", "prev_y", "curr_x", "curr_y"):
+            record[name] = list(struct.unpack_from("<%df" % count, buffer, offset))
+            offset += 4 * n
+    return record
+
+
+def read_trace(path):
+    """Return (header, records) of a trace file."""
+    with open(path, "rb") as stream:
+        buffer = mmap.mmap(stream.fileno(), 0, access=mmap.ACCESS_READ)
+    try:
+        values = _HEADER.unpack_from(buffer, 0)
+        if values[0] != b"OFTRACE1" or values[1] != 1:
+            raise ValueError("%s is not an optical flow trace (version 1)" % path)
+        header = dict(zip(_HEADER_FIELDS, values[1:]))
+
+        capacity = header["capacity"]
+        written = header["written"]
+        records = []
+        for sequence in range(max(1, written - capacity + 1), written + 1):
+            offset = header["header_bytes"] + ((sequence - 1) % capacity) * header["record_bytes"]
+            record = _parse_record(buffer, offset, header)
+
+            # Skip a slot whose rewrite was cut short
+            if record["sequence"] == sequence:
+                records.append(record)
+        return header, records
+    finally:
+        buffer.close()
+
+
+def main(argv):
+    if len(argv) != 2:
+        print("usage: %s TRACE_FILE" % argv[0])
+        return 1
+    header, records = read_trace(argv[1])
+    print("%d records (%d written, capacity %d), %d features per record, flags %d"
+          % (len(records), header["written"], header["capacity"],
+             header["max_features"], header["flags"]))
+    if records:
+        mean_count = sum(r["count"] for r in records) / float(len(records))
+        print("time %.3f to %.3f s, mean features %.1f"
+              % (records[0]["timestamp"], records[-1]["timestamp"], mean_count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))